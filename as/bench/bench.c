@@ -0,0 +1,105 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "printf.h"
+#include "memory.h"
+#include "arena.h"
+#include "intern.h"
+#include "object.h"
+#include "dasm16.h"
+
+/*
+ * assembles a large synthetic DCPU-16 source again and again in one
+ * arena, reset between passes as it would be between files, and
+ * reports how fast that goes.
+ */
+
+#define LINES  30000
+#define PASSES 50
+
+static unsigned long bench_seed = 1;
+
+static unsigned long bench_random(unsigned long n)
+{
+	bench_seed = (bench_seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+	return (bench_seed >> 8) % n;
+}
+
+/* a mix of what real programs have: labels, forward and backward
+ * references, memory operands, data and comments */
+static char *bench_source(size_t *length)
+{
+	static const char *const registers = "abcxyzij";
+	size_t capacity = 64 * LINES, n = 0;
+	char *source = emalloc(capacity);
+	int i;
+
+	for (i = 0; i < LINES; i++) {
+		if (i % 16 == 0)
+			n += sprintf(source + n, "label%d:\n", i / 16);
+
+		switch (bench_random(8)) {
+		case 0:
+		case 1:
+			n += sprintf(source + n, "\tset %c, %lu\t; a comment\n",
+				registers[bench_random(8)], bench_random(40));
+			break;
+		case 2:
+			n += sprintf(source + n, "\tadd %c, [%c + 4]\n",
+				registers[bench_random(8)], registers[bench_random(8)]);
+			break;
+		case 3:
+			n += sprintf(source + n, "\tifn [label%lu + 2], %c\n",
+				bench_random(LINES / 16), registers[bench_random(8)]);
+			break;
+		case 4:
+			n += sprintf(source + n, "\tSET PC, label%lu\n", bench_random(LINES / 16));
+			break;
+		case 5:
+			n += sprintf(source + n, "\tjsr label%lu\n", bench_random(LINES / 16));
+			break;
+		case 6:
+			n += sprintf(source + n, "\tset push, %c\n", registers[bench_random(8)]);
+			break;
+		default:
+			n += sprintf(source + n, "\tdat 0x%04lx, \"ok\", label%lu\n",
+				bench_random(0x10000), bench_random(LINES / 16));
+			break;
+		}
+	}
+
+	*length = n;
+	return source;
+}
+
+int main(void)
+{
+	struct dasm16 *program = NULL;
+	struct arena arena;
+	size_t length;
+	char *source = bench_source(&length);
+	clock_t start;
+	double ms;
+	int i;
+
+	arena_init(&arena);
+	start = clock();
+	for (i = 0; i < PASSES; i++) {
+		arena_reset(&arena);
+		program = dasm16_assemble(&arena, "bench", source, length, 0, stderr);
+		if (program->errors != 0)
+			return EXIT_FAILURE;
+		dasm16_relax(program);
+	}
+	ms = 1000.0 * (clock() - start) / CLOCKS_PER_SEC / PASSES;
+
+	efprintf(stdout, "%d lines, %lu bytes, %ld words, %lu names\n",
+		LINES + LINES / 16, (unsigned long)length, program->length, program->names.count);
+	efprintf(stdout, "%.3f ms a pass, %.0f lines/ms\n", ms, (LINES + LINES / 16) / ms);
+
+	arena_free(&arena);
+	free(source);
+	return 0;
+}
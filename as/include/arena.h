@@ -0,0 +1,24 @@
+/*
+ * a region of memory handed out by bumping a pointer. nothing in it is
+ * freed on its own: arena_reset() takes back everything at once, and
+ * keeps the blocks to be handed out again, so an assembler can use one
+ * arena for file after file without going back to malloc.
+ */
+
+struct arena_block {
+	struct arena_block *next;
+	size_t size;
+};
+
+struct arena {
+	struct arena_block *blocks;  /* newest first */
+	struct arena_block *spare;   /* taken back by arena_reset() */
+	char *next;
+	char *end;
+};
+
+void arena_init(struct arena *arena);
+void *arena_alloc(struct arena *arena, size_t n);
+void *arena_calloc(struct arena *arena, size_t n, size_t m);
+void arena_reset(struct arena *arena);
+void arena_free(struct arena *arena);
@@ -0,0 +1,149 @@
+/*
+ * a single-pass assembler for DCPU-16 1.7. the syntax is the one the
+ * examples are written in:
+ *
+ *     .define vram 0x8000
+ *
+ *     :start  set a, [vram + x]   ; labels as :name or name:
+ *     loop:   ifn [data + 4], 0
+ *               set pc, loop
+ *             dat "text", 0, loop
+ *             .fill 16 0
+ *
+ * mnemonics and register names are case-insensitive; symbols aren't.
+ * operands are expressions of numbers, 'c'haracters and symbols joined
+ * by + and -.
+ *
+ * symbols can be used before they're defined: the word they go into is
+ * written with what is known, and a fixup adds each symbol's value when
+ * it is. so labels are always given a next word at first, and only
+ * expressions of numbers and constants already .defined are packed into
+ * the instruction.
+ *
+ * dasm16_relax() then packs what it can of the rest, once every label is
+ * known: an a operand whose value comes to -1..30 loses its next word,
+ * and `set pc, label' that can't becomes `add pc, n' or `sub pc, n' if
+ * the label is near. that does change ex, and moves every instruction
+ * after it, so code that relies on either should be assembled without.
+ *
+ * assembled as an object, a program can use symbols other objects
+ * define, and .global name makes one of its own available to them.
+ * labels it uses whose address counts, rather than their distance
+ * apart or from the instruction, stay in next words, to be relocated.
+ *
+ * errors are reported as file:line: message and counted; assembly goes
+ * on so that they can all be reported at once.
+ *
+ * a program, its names and its words all live in the arena it's
+ * assembled in, until that's reset. the caller includes arena.h and
+ * intern.h first, and object.h for dasm16_object().
+ */
+
+/* a word waiting for a symbol's value, to be added (or subtracted) */
+struct dasm16_fixup {
+	unsigned short address;
+	int negate;
+	int line;
+	struct dasm16_fixup *next;
+};
+
+struct dasm16_symbol {
+	struct atom *atom;
+
+	int defined;
+	int constant;  /* .define, rather than a label */
+	unsigned short value;
+	int line;
+
+	/* until it's defined */
+	struct dasm16_fixup *fixups;
+
+	int called;  /* by jsr, which makes it a function for dasm16_report() */
+	int global;
+	int index;   /* in the symbols of dasm16_object() */
+
+	struct dasm16_symbol *next;
+};
+
+struct dasm16_ref {
+	struct dasm16_symbol *symbol;
+	int negate;
+};
+
+/* a word that is a constant plus or minus labels, to redo if they move */
+struct dasm16_use {
+	unsigned short address;
+	unsigned short constant;
+	int nrefs;
+	struct dasm16_ref *refs;
+	struct dasm16_use *next;
+};
+
+enum dasm16_form {
+	DASM16_LONG,   /* a next word */
+	DASM16_SHORT,  /* a short literal */
+	DASM16_ADD_PC,
+	DASM16_SUB_PC
+};
+
+/* where the words of a line of source start, for a debug map */
+struct dasm16_line {
+	unsigned short address;
+	int line;
+	struct dasm16_line *next;
+};
+
+/* an instruction whose a operand is a next word that might be packed */
+struct dasm16_site {
+	unsigned short address;
+	int jump;  /* set pc, which can be made relative */
+	int form;
+	struct dasm16_use *use;  /* or NULL, when the word is a number */
+	struct dasm16_site *next;
+};
+
+struct dasm16 {
+	const char *filename;
+	int line;
+	int errors;
+
+	/* where errors are said */
+	FILE *diagnostics;
+
+	/* undefined symbols are left to the linker */
+	int object;
+
+	struct arena *arena;
+
+	/* the text, which atoms' names point into */
+	char *source;
+
+	/* names, from mnemonics to labels; symbols in the order seen, newest first */
+	struct intern names;
+	struct dasm16_symbol *symbols;
+
+	/* all of memory, to be filled from 0 */
+	unsigned short *words;
+	long length;
+	int overflowed;
+
+	/* lines that made words, in address order */
+	struct dasm16_line *lines;
+	struct dasm16_line **last_line;
+
+	/* what dasm16_relax() can move and pack; sites in address order */
+	struct dasm16_use *uses;
+	struct dasm16_site *sites;
+	struct dasm16_site **last_site;
+
+	/* the line of a .define or .fill that needs a label's address now */
+	int pinned;
+};
+
+struct dasm16 *dasm16_assemble(struct arena *arena, const char *filename,
+	const char *source, size_t length, int object, FILE *diagnostics);
+struct dasm16 *dasm16_assemble_file(struct arena *arena, const char *filename, FILE *file,
+	int object, FILE *diagnostics);
+void dasm16_relax(struct dasm16 *program);
+void dasm16_report(const struct dasm16 *program, FILE *file);
+struct object *dasm16_object(struct dasm16 *program, struct arena *arena);
@@ -0,0 +1,101 @@
+/*
+ * an assembler for DFPU-17 text. a .dasm17 file declares the layout of
+ * the DATA bank before and after the text runs, with `initial' and
+ * `final', and then gives the text, one instruction to a line:
+ *
+ *     initial f32 top, left, 16.0f;
+ *     final f32 result[256];
+ *     .equ ITERATIONS 16
+ *
+ *     L1: ld   %0,top      ; element 0
+ *         set  @0,$ITERATIONS
+ *         loop @0,L1
+ *
+ * names of data, labels and .equ constants may all be used wherever an
+ * integer immediate is, with or without the `$'. numbers are decimal,
+ * or hexadecimal after 0x.
+ *
+ * the assembler packs pairs of adjacent instructions that have short
+ * forms into single words. the device always runs both halves of such
+ * a word, the first then the second, so a pair can't start with a jump
+ * (the second half would run even when it's taken) and can't end with
+ * an instruction that is jumped to (it would have no address).
+ */
+
+enum dasm17_operand_kind {
+	DASM17_FREG = '%',
+	DASM17_IREG = '@',
+	DASM17_IMM  = '$'
+};
+
+struct dasm17_operand {
+	int kind;
+	long value;
+
+	/* an immediate naming a symbol, which value is added to */
+	char *symbol;
+};
+
+struct dasm17_instruction {
+	const struct dasm17_form *form;
+	int noperands;
+	struct dasm17_operand operands[3];
+
+	int line;
+	char *source;
+
+	int target;  /* a label names this instruction */
+	int paired;  /* first (1) or second (2) half of a pair, or 0 */
+	int address;
+};
+
+enum dasm17_symbol_kind {
+	DASM17_LABEL,
+	DASM17_EQU,
+	DASM17_INITIAL,
+	DASM17_FINAL
+};
+
+struct dasm17_symbol {
+	char *name;
+	int kind;
+	long value;    /* address, constant or element index */
+	long count;    /* elements declared, for data */
+	int line;
+	struct dasm17_symbol *next;
+};
+
+enum dasm17_precision {
+	DASM17_SINGLE,
+	DASM17_DOUBLE,
+	DASM17_HALF
+};
+
+struct dasm17 {
+	const char *filename;
+	int precision;
+
+	struct dasm17_instruction *instructions;
+	int count;
+	int capacity;
+
+	/* in the order they were defined */
+	struct dasm17_symbol *symbols;
+	struct dasm17_symbol **last;
+
+	/* elements laid out in each view of DATA so far */
+	long initial;
+	long final;
+
+	unsigned short text[256];
+	int words;
+	int pairs;
+
+	unsigned short data[512];
+};
+
+struct dasm17 *dasm17_parse(const char *filename, FILE *file);
+void dasm17_pair(struct dasm17 *program);
+void dasm17_assemble(struct dasm17 *program);
+void dasm17_write(const struct dasm17 *program, FILE *file, const char *prefix);
+void dasm17_free(struct dasm17 *program);
@@ -0,0 +1,31 @@
+/*
+ * a table of names, each kept once, so that two names are the same
+ * exactly when their atoms are. an atom carries what its user knows
+ * about the name: what the language makes of it, and what the program
+ * being assembled defines it as.
+ *
+ * names aren't copied; they must last as long as the table, which
+ * lives in an arena.
+ */
+
+#define INTERN_UNKNOWN (-1)
+
+struct atom {
+	const char *name;
+	int length;
+	unsigned long hash;
+
+	int keyword;   /* INTERN_UNKNOWN until its user looks */
+	void *symbol;
+};
+
+struct intern {
+	struct arena *arena;
+	struct atom **slots;
+	unsigned long size;  /* a power of two */
+	unsigned long count;
+};
+
+void intern_init(struct intern *table, struct arena *arena, unsigned long size);
+struct atom *intern(struct intern *table, const char *name, int length);
+struct atom *intern_lookup(const struct intern *table, const char *name, int length);
@@ -0,0 +1,14 @@
+/*
+ * linking objects into an image. sections with the same name are put
+ * together, in the order objects are given, and each name becomes a
+ * segment; segments are laid out from address 0 in the order their
+ * names are first seen.
+ *
+ * the entry point is the global symbol named, or start if there is
+ * one, or 0.
+ *
+ * the caller includes arena.h, intern.h and object.h first.
+ */
+
+struct object_image *link_objects(struct arena *arena, struct object **objects, int n,
+	const char *entry);
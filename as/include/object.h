@@ -0,0 +1,116 @@
+/*
+ * relocatable objects, for assembling a program a file at a time and
+ * linking the pieces. an object is stored as big-endian words, like a
+ * .bin, and a name as its length in bytes and then the bytes, two to a
+ * word, the last padded with a zero:
+ *
+ *     'D' 'O', version
+ *     the number of sections, and for each: name, length, words
+ *     the number of symbols, and for each: name, flags, section, value
+ *     the number of relocations, and for each:
+ *         section, address, flags, symbol (or section)
+ *     the name of the source, and the number of lines, and for each:
+ *         section, address, line (in two words, high first)
+ *
+ * a relocation adds the final value of a symbol, or the base of a
+ * section, to the word at address in section; or, with OBJECT_NEGATE,
+ * takes it away.
+ *
+ * an image, what link.c makes of objects, is stored the same way:
+ *
+ *     'D' 'I', version, entry
+ *     the number of segments, and for each: name, address, length, words
+ *
+ * and a debug map of objects, once they're linked, is text for the vm
+ * to read, one record to a line, addresses in hex:
+ *
+ *     file <number> <name>
+ *     label <address> <name>
+ *     line <address> <file> <line>
+ *
+ * where a line covers the words from its address up to the next's.
+ *
+ * the caller includes arena.h first.
+ */
+
+#define OBJECT_VERSION 2
+
+enum object_symbol_flags {
+	OBJECT_DEFINED  = 0x1,
+	OBJECT_GLOBAL   = 0x2,  /* other objects can use it */
+	OBJECT_ABSOLUTE = 0x4   /* a constant, rather than a place in a section */
+};
+
+enum object_reloc_flags {
+	OBJECT_NEGATE  = 0x1,
+	OBJECT_SECTION = 0x2  /* by a section's base, not a symbol's value */
+};
+
+struct object_section {
+	const char *name;
+	unsigned short length;
+	unsigned short *words;
+
+	/* where it goes, once it's linked */
+	unsigned short base;
+};
+
+struct object_symbol {
+	const char *name;  /* not always terminated */
+	int length;
+	int flags;
+	int section;
+	unsigned short value;
+};
+
+struct object_reloc {
+	int section;
+	unsigned short address;
+	int flags;
+	int symbol;
+};
+
+/* where the words of a line of source start */
+struct object_line {
+	int section;
+	unsigned short address;
+	long line;
+};
+
+struct object {
+	const char *filename;
+	const char *source;
+
+	int nsections;
+	struct object_section *sections;
+	int nsymbols;
+	struct object_symbol *symbols;
+	int nrelocs;
+	struct object_reloc *relocs;
+	int nlines;
+	struct object_line *lines;
+};
+
+struct object_segment {
+	const char *name;
+	unsigned short address;
+	unsigned short length;
+	const unsigned short *words;
+};
+
+struct object_image {
+	unsigned short entry;
+	int nsegments;
+	struct object_segment *segments;
+
+	/* all of memory, as it's loaded, up to the end of the last segment */
+	unsigned short *memory;
+	long length;
+};
+
+struct object *object_read(struct arena *arena, const char *filename, FILE *file);
+int object_write(const struct object *object, FILE *file);
+int object_write_image(const struct object_image *image, FILE *file);
+int object_write_bin(const unsigned short *words, long length, FILE *file);
+int object_write_hex(const unsigned short *words, long length, FILE *file);
+int object_write_map(struct object **objects, int n, FILE *file);
@@ -0,0 +1,110 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+#include "arena.h"
+
+#define ARENA_BLOCK 65536
+
+/* everything handed out is aligned for any of these */
+union arena_align {
+	long l;
+	double d;
+	void *p;
+	void (*f)(void);
+};
+
+#define ARENA_ROUND(n) (((n) + sizeof(union arena_align) - 1) & ~(sizeof(union arena_align) - 1))
+#define ARENA_HEADER   ARENA_ROUND(sizeof(struct arena_block))
+
+void arena_init(struct arena *arena)
+{
+	arena->blocks = NULL;
+	arena->spare = NULL;
+	arena->next = NULL;
+	arena->end = NULL;
+}
+
+static struct arena_block *arena_block(struct arena *arena, size_t n)
+{
+	struct arena_block *block, **spare;
+
+	for (spare = &arena->spare; *spare != NULL; spare = &(*spare)->next) {
+		if ((*spare)->size >= n) {
+			block = *spare;
+			*spare = block->next;
+			return block;
+		}
+	}
+
+	block = emalloc(ARENA_HEADER + n);
+	block->size = n;
+	return block;
+}
+
+void *arena_alloc(struct arena *arena, size_t n)
+{
+	struct arena_block *block;
+	char *p;
+
+	n = ARENA_ROUND(n);
+	if ((size_t)(arena->end - arena->next) >= n) {
+		p = arena->next;
+		arena->next += n;
+		return p;
+	}
+
+	/* something big gets a block to itself, behind the one in use,
+	 * so what's left of that can still be handed out */
+	if (n > ARENA_BLOCK / 4 && arena->blocks != NULL) {
+		block = arena_block(arena, n);
+		block->next = arena->blocks->next;
+		arena->blocks->next = block;
+		return (char *)block + ARENA_HEADER;
+	}
+
+	block = arena_block(arena, n > ARENA_BLOCK ? n : ARENA_BLOCK);
+	block->next = arena->blocks;
+	arena->blocks = block;
+
+	p = (char *)block + ARENA_HEADER;
+	arena->next = p + n;
+	arena->end = p + block->size;
+	return p;
+}
+
+void *arena_calloc(struct arena *arena, size_t n, size_t m)
+{
+	void *p = arena_alloc(arena, n * m);
+
+	memset(p, 0, n * m);
+	return p;
+}
+
+void arena_reset(struct arena *arena)
+{
+	struct arena_block *block, *next;
+
+	for (block = arena->blocks; block != NULL; block = next) {
+		next = block->next;
+		block->next = arena->spare;
+		arena->spare = block;
+	}
+
+	arena->blocks = NULL;
+	arena->next = NULL;
+	arena->end = NULL;
+}
+
+void arena_free(struct arena *arena)
+{
+	struct arena_block *block, *next;
+
+	arena_reset(arena);
+	for (block = arena->spare; block != NULL; block = next) {
+		next = block->next;
+		free(block);
+	}
+	arena->spare = NULL;
+}
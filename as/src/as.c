@@ -1,16 +1,457 @@
+#define _DEFAULT_SOURCE
+#include <ctype.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include "printf.h"
 #include "memory.h"
+#include "arena.h"
+#include "intern.h"
+#include "object.h"
+#include "link.h"
+#include "dasm16.h"
+#include "dasm17.h"
 
-int main()
+static void usage(const char *name)
 {
-	void *x;
+	efprintf(stderr, "usage: %s [-u] [-g map] [-o output.bin|output.hex] file.dasm16\n"
+	                 "       %s [-u] -c [-o file.o16] file.dasm16\n"
+	                 "       %s [-u] [-c] [-j jobs] file.dasm16 file.dasm16...\n"
+	                 "       %s [-e entry] [-g map] [-o output.img16|output.bin|output.hex] file.o16...\n"
+	                 "       %s [-u] [-o output] file.dasm17\n", name, name, name, name, name);
+	exit(EXIT_FAILURE);
+}
+
+/* a label prefix from the file's name: mandelbrot.dasm17 is mandelbrot */
+static char *prefix_of(const char *filename)
+{
+	const char *base = strrchr(filename, '/'), *dot;
+	char *prefix;
+	size_t i, length;
+
+	base = base ? base + 1 : filename;
+	dot = strchr(base, '.');
+	length = dot ? (size_t)(dot - base) : strlen(base);
+
+	prefix = emalloc(length + 2);
+	for (i = 0; i < length; i++)
+		prefix[i] = isalnum((unsigned char)base[i]) ? base[i] : '_';
+	prefix[length] = '\0';
+
+	if (length == 0 || isdigit((unsigned char)prefix[0])) {
+		memmove(prefix + 1, prefix, length + 1);
+		prefix[0] = '_';
+	}
+	return prefix;
+}
+
+static int has_suffix(const char *s, const char *suffix)
+{
+	size_t n = strlen(s), m = strlen(suffix);
+
+	return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+/* file.dasm16 is file.o16, or file.hex, where it is */
+static char *output_file_of(const char *input, const char *suffix)
+{
+	const char *base = strrchr(input, '/'), *dot;
+	size_t length;
+	char *name;
+
+	base = base ? base + 1 : input;
+	dot = strrchr(base, '.');
+	length = dot && dot != base ? (size_t)(dot - input) : strlen(input);
+
+	name = emalloc(length + strlen(suffix) + 1);
+	memcpy(name, input, length);
+	strcpy(name + length, suffix);
+	return name;
+}
+
+/*
+ * outputs are written to a temporary name beside them and renamed into
+ * place once they're complete, so nothing ever sees half of one, and a
+ * failure leaves whatever was there before.
+ */
+static FILE *open_output(const char *output, char **temporary)
+{
+	FILE *file;
+
+	*temporary = emalloc(strlen(output) + 32);
+	sprintf(*temporary, "%s.%ld.tmp", output, (long)getpid());
+	if ((file = fopen(*temporary, "wb")) == NULL) {
+		free(*temporary);
+		*temporary = NULL;
+	}
+	return file;
+}
+
+/* nonzero if it couldn't all be written, in which case it's gone */
+static int close_output(FILE *file, const char *output, char *temporary, int failed)
+{
+	if (fclose(file) != 0)
+		failed = 1;
+	if (!failed && rename(temporary, output) != 0)
+		failed = 1;
+	if (failed)
+		remove(temporary);
+	free(temporary);
+	return failed;
+}
+
+/* a debug map of objects, already linked; nonzero if it can't be written */
+static int write_map(const char *name, const char *map, struct object **objects, int n)
+{
+	char *temporary;
+	FILE *file;
+
+	if ((file = open_output(map, &temporary)) == NULL) {
+		efprintf(stderr, "%s: can't open %s\n", name, map);
+		return 1;
+	}
+	if (close_output(file, map, temporary, object_write_map(objects, n, file))) {
+		efprintf(stderr, "%s: can't write %s\n", name, map);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * an object with -c, a .bin, or for anything else the hex include format.
+ * everything is allocated in arena, which the caller resets, and what's
+ * wrong is said to diagnostics.
+ */
+static int assemble_dasm16(struct arena *arena, FILE *diagnostics, const char *name,
+	const char *input, const char *output, const char *map, int relax, int object)
+{
+	struct object *linked;
+	struct dasm16 *program;
+	FILE *in, *out;
+	char *objname = NULL, *temporary = NULL;
+	int status = EXIT_FAILURE, failed;
+
+	if ((in = fopen(input, "r")) == NULL) {
+		efprintf(diagnostics, "%s: can't open %s\n", name, input);
+		return EXIT_FAILURE;
+	}
+	program = dasm16_assemble_file(arena, input, in, object, diagnostics);
+	fclose(in);
+	if (object && output == NULL)
+		output = objname = output_file_of(input, ".o16");
+
+	if (program == NULL) {
+		efprintf(diagnostics, "%s: can't read %s\n", name, input);
+	} else if (program->errors != 0) {
+		efprintf(diagnostics, "%s: %d error%s\n", input, program->errors,
+			program->errors == 1 ? "" : "s");
+	} else if (output != NULL && (out = open_output(output, &temporary)) == NULL) {
+		efprintf(diagnostics, "%s: can't open %s\n", name, output);
+	} else {
+		if (relax)
+			dasm16_relax(program);
+		if (output == NULL)
+			out = stdout;
+		if (object)
+			failed = object_write(dasm16_object(program, arena), out);
+		else if (output != NULL && has_suffix(output, ".bin"))
+			failed = object_write_bin(program->words, program->length, out);
+		else
+			failed = object_write_hex(program->words, program->length, out);
+
+		if (out != stdout)
+			failed = close_output(out, output, temporary, failed);
+		if (failed)
+			efprintf(diagnostics, "%s: can't write %s\n", name, output ? output : "the output");
+		else
+			status = 0;
+		if (relax)
+			dasm16_report(program, diagnostics);
+		if (map != NULL && status == 0) {
+			linked = dasm16_object(program, arena);
+			if (write_map(name, map, &linked, 1))
+				status = EXIT_FAILURE;
+		}
+	}
+
+	free(objname);
+	return status;
+}
+
+/* files being assembled on several threads, each taking the next as it's free */
+struct batch {
+	const char *name;
+	char **inputs;
+	int n;
+	int relax, object;
+
+	pthread_mutex_t lock;
+	int next;      /* the next input no thread has taken */
+	int failures;
+};
+
+/* what one thread said about a file, copied to stderr all together */
+static void batch_say(FILE *diagnostics, long start)
+{
+	char buffer[4096];
+	size_t n;
+
+	fflush(diagnostics);
+	fseek(diagnostics, start, SEEK_SET);
+	while ((n = fread(buffer, 1, sizeof buffer, diagnostics)) != 0)
+		fwrite(buffer, 1, n, stderr);
+	fseek(diagnostics, 0, SEEK_END);
+}
+
+/*
+ * a thread's arena is reset after every file, so it's only as big as the
+ * biggest; each file still has its own program, and symbol table, in it.
+ */
+static void *batch_worker(void *data)
+{
+	struct batch *batch = data;
+	struct arena arena;
+	FILE *diagnostics;
+	char *output;
+	long start;
+	int i, status;
+
+	arena_init(&arena);
+	if ((diagnostics = tmpfile()) == NULL)
+		diagnostics = stderr;
+
+	for (;;) {
+		pthread_mutex_lock(&batch->lock);
+		i = batch->next++;
+		pthread_mutex_unlock(&batch->lock);
+		if (i >= batch->n)
+			break;
+
+		start = diagnostics == stderr ? 0 : ftell(diagnostics);
+		output = output_file_of(batch->inputs[i], batch->object ? ".o16" : ".hex");
+		status = assemble_dasm16(&arena, diagnostics, batch->name, batch->inputs[i],
+			output, NULL, batch->relax, batch->object);
+		free(output);
+		arena_reset(&arena);
+
+		pthread_mutex_lock(&batch->lock);
+		if (diagnostics != stderr)
+			batch_say(diagnostics, start);
+		if (status != 0)
+			batch->failures++;
+		pthread_mutex_unlock(&batch->lock);
+	}
+
+	if (diagnostics != stderr)
+		fclose(diagnostics);
+	arena_free(&arena);
+	return NULL;
+}
+
+static double seconds_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* each file beside its input, as file.o16 with -c or file.hex, on up to jobs threads */
+static int assemble_batch(const char *name, char **inputs, int n, int jobs, int relax,
+	int object)
+{
+	struct batch batch;
+	struct timespec start;
+	pthread_t *threads;
+	double seconds;
+	int i, started;
+
+	if (jobs <= 0 && (jobs = (int)sysconf(_SC_NPROCESSORS_ONLN)) <= 0)
+		jobs = 1;
+	if (jobs > n)
+		jobs = n;
+
+	batch.name = name;
+	batch.inputs = inputs;
+	batch.n = n;
+	batch.relax = relax;
+	batch.object = object;
+	batch.next = 0;
+	batch.failures = 0;
+	pthread_mutex_init(&batch.lock, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	threads = emalloc(jobs * sizeof *threads);
+	for (started = 0; started < jobs; started++)
+		if (pthread_create(&threads[started], NULL, batch_worker, &batch) != 0)
+			break;
+	/* with no threads at all, this one does the work */
+	if (started == 0)
+		batch_worker(&batch);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	seconds = seconds_since(&start);
+	free(threads);
+	pthread_mutex_destroy(&batch.lock);
+
+	efprintf(stderr, "%s: %d file%s on %d thread%s in %.3f s, %.1f files/s", name, n,
+		n == 1 ? "" : "s", started ? started : 1, started > 1 ? "s" : "", seconds,
+		seconds > 0 ? n / seconds : 0.0);
+	if (batch.failures != 0)
+		efprintf(stderr, "; %d failed", batch.failures);
+	efprintf(stderr, "\n");
+	return batch.failures == 0 ? 0 : EXIT_FAILURE;
+}
+
+/* objects linked into an image, or a .bin or the hex of memory as it's loaded */
+static int link_files(const char *name, char **inputs, int n, const char *output, const char *map,
+	const char *entry)
+{
+	struct object **objects = emalloc(n * sizeof *objects);
+	struct object_image *image = NULL;
+	struct arena arena;
+	FILE *in, *out;
+	char *temporary = NULL;
+	int i, status = EXIT_FAILURE, failed;
+
+	arena_init(&arena);
+	for (i = 0; i < n; i++) {
+		if ((in = fopen(inputs[i], "rb")) == NULL) {
+			efprintf(stderr, "%s: can't open %s\n", name, inputs[i]);
+			break;
+		}
+		objects[i] = object_read(&arena, inputs[i], in);
+		fclose(in);
+		if (objects[i] == NULL)
+			break;
+	}
+
+	if (i == n)
+		image = link_objects(&arena, objects, n, entry);
+	if (image == NULL) {
+		/* said why already */
+	} else if (output != NULL && (out = open_output(output, &temporary)) == NULL) {
+		efprintf(stderr, "%s: can't open %s\n", name, output);
+	} else {
+		if (output == NULL)
+			out = stdout;
+		if (output != NULL && has_suffix(output, ".img16"))
+			failed = object_write_image(image, out);
+		else if (output != NULL && has_suffix(output, ".bin"))
+			failed = object_write_bin(image->memory, image->length, out);
+		else
+			failed = object_write_hex(image->memory, image->length, out);
+
+		if (out != stdout)
+			failed = close_output(out, output, temporary, failed);
+		if (failed)
+			efprintf(stderr, "%s: can't write %s\n", name, output ? output : "the output");
+		else if (map == NULL || !write_map(name, map, objects, n))
+			status = 0;
+	}
+
+	free(objects);
+	arena_free(&arena);
+	return status;
+}
+
+int main(int argc, char **argv)
+{
+	const char *output = NULL, *input, *entry = NULL, *map = NULL;
+	struct dasm17 *program;
+	struct arena arena;
+	FILE *in, *out;
+	char *prefix, **inputs, *temporary = NULL;
+	int i, n = 0, optimise = 1, object = 0, jobs = 0;
+
+	inputs = emalloc(argc * sizeof *inputs);
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-u") == 0)
+			optimise = 0;
+		else if (strcmp(argv[i], "-c") == 0)
+			object = 1;
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			output = argv[++i];
+		else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+			entry = argv[++i];
+		else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+			map = argv[++i];
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			jobs = atoi(argv[++i]);
+		else if (argv[i][0] == '-')
+			usage(argv[0]);
+		else
+			inputs[n++] = argv[i];
+	}
+
+	/* objects are linked; several sources are assembled each to its own output */
+	if (n != 0 && has_suffix(inputs[0], ".o16")) {
+		for (i = 0; i < n; i++)
+			if (!has_suffix(inputs[i], ".o16") || object)
+				usage(argv[0]);
+		i = link_files(argv[0], inputs, n, output, map, entry);
+		free(inputs);
+		return i;
+	}
+	if (n > 1) {
+		for (i = 0; i < n; i++)
+			if (has_suffix(inputs[i], ".o16") || has_suffix(inputs[i], ".dasm17"))
+				usage(argv[0]);
+		if (output != NULL || map != NULL || entry != NULL)
+			usage(argv[0]);
+		i = assemble_batch(argv[0], inputs, n, jobs, optimise, object);
+		free(inputs);
+		return i;
+	}
+	if (n != 1 || entry != NULL)
+		usage(argv[0]);
+	input = inputs[0];
+	free(inputs);
+
+	if (!has_suffix(input, ".dasm17")) {
+		arena_init(&arena);
+		i = assemble_dasm16(&arena, stderr, argv[0], input, output, object ? NULL : map,
+			optimise, object);
+		arena_free(&arena);
+		return i;
+	}
+	if (object || map != NULL)
+		usage(argv[0]);
+
+	if ((in = fopen(input, "r")) == NULL) {
+		efprintf(stderr, "%s: can't open %s\n", argv[0], input);
+		return EXIT_FAILURE;
+	}
+	program = dasm17_parse(input, in);
+	fclose(in);
+
+	if (optimise)
+		dasm17_pair(program);
+	dasm17_assemble(program);
+
+	if (output == NULL) {
+		out = stdout;
+	} else if ((out = open_output(output, &temporary)) == NULL) {
+		efprintf(stderr, "%s: can't open %s\n", argv[0], output);
+		return EXIT_FAILURE;
+	}
+	prefix = prefix_of(input);
+	dasm17_write(program, out, prefix);
+	free(prefix);
+	if (out != stdout && close_output(out, output, temporary, ferror(out))) {
+		efprintf(stderr, "%s: can't write %s\n", argv[0], output);
+		return EXIT_FAILURE;
+	}
 
-	efprintf(stdout, "Hello, world!\n");
-	x = emalloc(sizeof(int));
-	free(x);
+	efprintf(stderr, "%s: %d instructions in %d words\n", input, program->count, program->words);
+	if (program->pairs != 0)
+		efprintf(stderr, "%s: pairing saved %d word%s, and a step each time a pair runs\n",
+			input, program->pairs, program->pairs == 1 ? "" : "s");
 
+	dasm17_free(program);
 	return 0;
 }
@@ -0,0 +1,1164 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+#include "printf.h"
+#include "arena.h"
+#include "intern.h"
+#include "object.h"
+#include "dasm16.h"
+
+/* labels one operand can mention */
+#define DASM16_REFS 8
+
+enum dasm16_register {
+	DASM16_A, DASM16_B, DASM16_C, DASM16_X, DASM16_Y, DASM16_Z, DASM16_I, DASM16_J,
+	DASM16_SP, DASM16_PC, DASM16_EX, DASM16_PUSH, DASM16_POP, DASM16_PEEK, DASM16_PICK,
+	DASM16_NONE = -1
+};
+
+/* an operand as it will be encoded: its field, and maybe a next word */
+struct dasm16_value {
+	int code;
+	int next;
+	unsigned short word;
+
+	/* numbers, and constants already defined, only */
+	int known;
+
+	/* the labels in it, and symbols not yet defined */
+	int nrefs;
+	struct dasm16_ref refs[DASM16_REFS];
+};
+
+struct dasm16_opcode {
+	char name[4];
+	unsigned char opcode;
+	unsigned char special;
+};
+
+static const struct dasm16_opcode dasm16_opcodes[] = {
+	{"set", 0x01, 0}, {"add", 0x02, 0}, {"sub", 0x03, 0}, {"mul", 0x04, 0},
+	{"mli", 0x05, 0}, {"div", 0x06, 0}, {"dvi", 0x07, 0}, {"mod", 0x08, 0},
+	{"mdi", 0x09, 0}, {"and", 0x0a, 0}, {"bor", 0x0b, 0}, {"xor", 0x0c, 0},
+	{"shr", 0x0d, 0}, {"asr", 0x0e, 0}, {"shl", 0x0f, 0}, {"ifb", 0x10, 0},
+	{"ifc", 0x11, 0}, {"ife", 0x12, 0}, {"ifn", 0x13, 0}, {"ifg", 0x14, 0},
+	{"ifa", 0x15, 0}, {"ifl", 0x16, 0}, {"ifu", 0x17, 0}, {"adx", 0x1a, 0},
+	{"sbx", 0x1b, 0}, {"sti", 0x1e, 0}, {"std", 0x1f, 0},
+
+	{"jsr", 0x01, 1}, {"int", 0x08, 1}, {"iag", 0x09, 1}, {"ias", 0x0a, 1},
+	{"rfi", 0x0b, 1}, {"iaq", 0x0c, 1}, {"hwn", 0x10, 1}, {"hwq", 0x11, 1},
+	{"hwi", 0x12, 1}
+};
+
+#define DASM16_OPCODES ((int)(sizeof dasm16_opcodes / sizeof *dasm16_opcodes))
+
+static void dasm16_error(struct dasm16 *program, int line, const char *fmt, ...)
+{
+	va_list args;
+
+	efprintf(program->diagnostics, "%s:%d: ", program->filename, line);
+	va_start(args, fmt);
+	evfprintf(program->diagnostics, fmt, args);
+	va_end(args);
+	efprintf(program->diagnostics, "\n");
+
+	program->errors++;
+}
+
+#define DASM16_START 0x1  /* can start an identifier */
+#define DASM16_IDENT 0x2  /* can be in one */
+#define DASM16_SPACE 0x4
+#define DASM16_END   0x8  /* ends a statement */
+
+static const unsigned char dasm16_class[256] = {
+	8, 0, 0, 0, 0, 0, 0, 0, 0, 4, 8, 4, 4, 4, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 8, 0, 0, 0, 0,
+	0, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 0, 0, 0, 0, 3,
+	0, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 0, 0, 0, 0, 0
+};
+
+#define dasm16_space(c)            (dasm16_class[(unsigned char)(c)] & DASM16_SPACE)
+#define dasm16_identifier_start(c) (dasm16_class[(unsigned char)(c)] & DASM16_START)
+#define dasm16_identifier_char(c)  (dasm16_class[(unsigned char)(c)] & DASM16_IDENT)
+#define dasm16_end(c)              (dasm16_class[(unsigned char)(c)] & DASM16_END)
+#define dasm16_lower(c)            ((c) | 0x20)
+
+/* whether a value can be a short literal, and its code if it can */
+#define dasm16_fits(word)    ((word) <= 30 || (word) == 0xffff)
+#define dasm16_literal(word) ((word) == 0xffff ? 0x20 : 0x21 + (word))
+
+static const char *dasm16_skip(const char *p)
+{
+	while (dasm16_space(*p))
+		p++;
+	return p;
+}
+
+/**
+ * what the language makes of a name: a register, an opcode, or a
+ * directive. they're interned lowercase when the program starts, and
+ * any other spelling is folded and looked up the first time it's seen.
+ */
+enum dasm16_keyword {
+	DASM16_REGISTER = 1,
+	DASM16_OPCODE = DASM16_REGISTER + DASM16_PICK + 1,
+	DASM16_DAT = DASM16_OPCODE + 64,
+	DASM16_DEFINE,
+	DASM16_FILL,
+	DASM16_DOT_DAT,
+	DASM16_GLOBAL
+};
+
+static const char *const dasm16_registers[] = {
+	"a", "b", "c", "x", "y", "z", "i", "j",
+	"sp", "pc", "ex", "push", "pop", "peek", "pick"
+};
+
+static void dasm16_keywords(struct dasm16 *program)
+{
+	static const char *const directives[] = {"dat", ".define", ".fill", ".dat", ".global"};
+	int i;
+
+	for (i = 0; i <= DASM16_PICK; i++)
+		intern(&program->names, dasm16_registers[i],
+			(int)strlen(dasm16_registers[i]))->keyword = DASM16_REGISTER + i;
+	for (i = 0; i < DASM16_OPCODES; i++)
+		intern(&program->names, dasm16_opcodes[i].name, 3)->keyword = DASM16_OPCODE + i;
+	for (i = 0; i < (int)(sizeof directives / sizeof *directives); i++)
+		intern(&program->names, directives[i], (int)strlen(directives[i]))->keyword = DASM16_DAT + i;
+}
+
+static int dasm16_keyword(struct dasm16 *program, struct atom *atom)
+{
+	struct atom *folded;
+	char lower[8];
+	int i;
+
+	if (atom->keyword != INTERN_UNKNOWN)
+		return atom->keyword;
+
+	atom->keyword = 0;
+	if (atom->length <= (int)sizeof lower) {
+		for (i = 0; i < atom->length; i++)
+			lower[i] = (char)dasm16_lower((unsigned char)atom->name[i]);
+		folded = intern_lookup(&program->names, lower, atom->length);
+		if (folded != NULL && folded->keyword > 0)
+			atom->keyword = folded->keyword;
+	}
+	return atom->keyword;
+}
+
+/* the identifier at *p, interned */
+static struct atom *dasm16_name(struct dasm16 *program, const char **p)
+{
+	const char *name = *p;
+
+	while (dasm16_identifier_char(**p))
+		(*p)++;
+	return intern(&program->names, name, (int)(*p - name));
+}
+
+static int dasm16_register(struct dasm16 *program, struct atom *atom)
+{
+	int keyword = dasm16_keyword(program, atom);
+
+	if (keyword >= DASM16_REGISTER && keyword <= DASM16_REGISTER + DASM16_PICK)
+		return keyword - DASM16_REGISTER;
+	return DASM16_NONE;
+}
+
+/* the symbol atom names, added undefined if it hasn't been seen yet */
+static struct dasm16_symbol *dasm16_symbol(struct dasm16 *program, struct atom *atom)
+{
+	struct dasm16_symbol *symbol = atom->symbol;
+
+	if (symbol != NULL)
+		return symbol;
+
+	symbol = arena_alloc(program->arena, sizeof *symbol);
+	symbol->atom = atom;
+	symbol->defined = 0;
+	symbol->constant = 0;
+	symbol->value = 0;
+	symbol->line = program->line;
+	symbol->fixups = NULL;
+	symbol->called = 0;
+	symbol->global = 0;
+	symbol->index = -1;
+
+	symbol->next = program->symbols;
+	program->symbols = symbol;
+	atom->symbol = symbol;
+	return symbol;
+}
+
+/* give symbol its value, and patch the words that were waiting for it */
+static void dasm16_define(struct dasm16 *program, struct dasm16_symbol *symbol,
+	int constant, unsigned short value)
+{
+	struct dasm16_fixup *fixup;
+
+	if (symbol->defined) {
+		dasm16_error(program, program->line, "`%.*s' is already defined on line %d",
+			symbol->atom->length, symbol->atom->name, symbol->line);
+		return;
+	}
+
+	symbol->defined = 1;
+	symbol->constant = constant;
+	symbol->value = value;
+	symbol->line = program->line;
+
+	for (fixup = symbol->fixups; fixup != NULL; fixup = fixup->next) {
+		if (fixup->negate)
+			program->words[fixup->address] -= value;
+		else
+			program->words[fixup->address] += value;
+	}
+	symbol->fixups = NULL;
+}
+
+static void dasm16_emit(struct dasm16 *program, unsigned short word)
+{
+	if (program->length == 0x10000) {
+		if (!program->overflowed)
+			dasm16_error(program, program->line, "the program doesn't fit in memory");
+		program->overflowed = 1;
+		return;
+	}
+
+	program->words[program->length++] = word;
+}
+
+/**
+ * emit the next word of value, with fixups for what isn't known yet. if
+ * it names labels, it's returned as a use, to be redone if they move.
+ */
+static struct dasm16_use *dasm16_emit_value(struct dasm16 *program, const struct dasm16_value *value)
+{
+	struct dasm16_symbol *symbol;
+	struct dasm16_fixup *fixup;
+	struct dasm16_use *use;
+	int i;
+
+	if (program->length == 0x10000) {
+		dasm16_emit(program, value->word);
+		return NULL;
+	}
+
+	for (i = 0; i < value->nrefs; i++) {
+		symbol = value->refs[i].symbol;
+		if (symbol->defined)
+			continue;
+		fixup = arena_alloc(program->arena, sizeof *fixup);
+		fixup->address = (unsigned short)program->length;
+		fixup->negate = value->refs[i].negate;
+		fixup->line = program->line;
+		fixup->next = symbol->fixups;
+		symbol->fixups = fixup;
+	}
+
+	use = NULL;
+	if (value->nrefs != 0) {
+		use = arena_alloc(program->arena, sizeof *use);
+		use->address = (unsigned short)program->length;
+		use->constant = 0;
+		use->nrefs = value->nrefs;
+		use->refs = arena_alloc(program->arena, value->nrefs * sizeof *use->refs);
+		memcpy(use->refs, value->refs, value->nrefs * sizeof *use->refs);
+		use->next = program->uses;
+		program->uses = use;
+	}
+
+	dasm16_emit(program, value->word);
+	return use;
+}
+
+static int dasm16_escape(const char **p)
+{
+	int c = *(*p)++;
+
+	if (c != '\\')
+		return c;
+	switch (c = *(*p)++) {
+	case 'n': return '\n';
+	case 't': return '\t';
+	case 'r': return '\r';
+	case '0': return '\0';
+	default:  return c;
+	}
+}
+
+static int dasm16_number(const char **p, unsigned long *value)
+{
+	const char *s = *p;
+	unsigned long n = 0;
+	int base = 10, digit, digits = 0;
+
+	if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+		base = 16;
+		s += 2;
+	} else if (s[0] == '0' && (s[1] == 'b' || s[1] == 'B')) {
+		base = 2;
+		s += 2;
+	}
+
+	for (;; s++, digits++) {
+		if (*s >= '0' && *s <= '9')
+			digit = *s - '0';
+		else if (dasm16_lower((unsigned char)*s) >= 'a' && dasm16_lower((unsigned char)*s) <= 'f')
+			digit = dasm16_lower((unsigned char)*s) - 'a' + 10;
+		else
+			break;
+		if (digit >= base)
+			break;
+		n = (n * base + digit) & 0xffffffffUL;
+	}
+
+	if (digits == 0 || dasm16_identifier_char((unsigned char)*s))
+		return 0;
+	*p = s;
+	*value = n;
+	return 1;
+}
+
+/**
+ * an operand: a register, an expression, or [an expression with maybe
+ * one register in it]. a is whether it's the a operand, the only one
+ * that can be a short literal.
+ */
+static int dasm16_operand(struct dasm16 *program, const char **pp, int a, struct dasm16_value *value)
+{
+	const char *p = dasm16_skip(*pp);
+	struct dasm16_symbol *symbol;
+	struct atom *atom;
+	unsigned long number, total = 0;
+	int bracket = 0, reg = DASM16_NONE, terms = 0, negate, first = 1;
+
+	value->next = 0;
+	value->known = 1;
+	value->nrefs = 0;
+
+	if (*p == '[') {
+		bracket = 1;
+		p = dasm16_skip(p + 1);
+		if (p[0] == '-' && p[1] == '-') {
+			p = dasm16_skip(p + 2);
+			if (dasm16_register(program, dasm16_name(program, &p)) != DASM16_SP)
+				goto bad;
+			reg = DASM16_PUSH;
+		}
+	}
+
+	while (reg != DASM16_PUSH) {
+		negate = 0;
+		if (*p == '-' || *p == '+') {
+			negate = *p == '-';
+			p = dasm16_skip(p + 1);
+		} else if (!first) {
+			break;
+		}
+		first = 0;
+
+		if (dasm16_identifier_start((unsigned char)*p)) {
+			atom = dasm16_name(program, &p);
+			p = dasm16_skip(p);
+
+			switch (dasm16_register(program, atom)) {
+			case DASM16_NONE:
+				break;
+			case DASM16_PICK:
+				if (bracket || reg != DASM16_NONE || terms || negate)
+					goto bad;
+				reg = DASM16_PICK;
+				first = 1;
+				continue;
+			case DASM16_SP:
+				if (bracket && p[0] == '+' && p[1] == '+') {
+					if (reg != DASM16_NONE || terms || negate)
+						goto bad;
+					p = dasm16_skip(p + 2);
+					reg = DASM16_POP;
+					goto done;
+				}
+				/* fall through */
+			default:
+				if (reg != DASM16_NONE || negate)
+					goto bad;
+				reg = dasm16_register(program, atom);
+				continue;
+			}
+
+			terms++;
+			symbol = dasm16_symbol(program, atom);
+			if (symbol->defined && symbol->constant) {
+				total += negate ? -(unsigned long)symbol->value : symbol->value;
+				continue;
+			}
+
+			value->known = 0;
+			if (symbol->defined)
+				total += negate ? -(unsigned long)symbol->value : symbol->value;
+			if (value->nrefs == DASM16_REFS) {
+				dasm16_error(program, program->line, "too many symbols in one operand");
+			} else {
+				value->refs[value->nrefs].symbol = symbol;
+				value->refs[value->nrefs++].negate = negate;
+			}
+		} else if (*p == '\'') {
+			p++;
+			number = (unsigned long)dasm16_escape(&p);
+			if (*p++ != '\'')
+				goto bad;
+			p = dasm16_skip(p);
+			terms++;
+			total += negate ? -number : number;
+		} else if (dasm16_number(&p, &number)) {
+			p = dasm16_skip(p);
+			terms++;
+			total += negate ? -number : number;
+		} else {
+			goto bad;
+		}
+	}
+
+done:
+	if (bracket) {
+		if (*p++ != ']')
+			goto bad;
+		p = dasm16_skip(p);
+	}
+	value->word = (unsigned short)(total & 0xffff);
+
+	if (reg >= DASM16_PUSH && reg <= DASM16_PEEK) {
+		/* push, pop, peek, [--sp], [sp++], [sp] */
+		if (terms || (bracket && reg == DASM16_PEEK))
+			goto bad;
+		value->code = reg == DASM16_PEEK ? 0x19 : 0x18;
+	} else if (reg == DASM16_PICK) {
+		value->code = 0x1a;
+		value->next = 1;
+	} else if (reg >= DASM16_SP && reg <= DASM16_EX && !bracket) {
+		if (terms)
+			goto bad;
+		value->code = 0x1b + (reg - DASM16_SP);
+	} else if (reg == DASM16_SP) {
+		value->code = terms ? 0x1a : 0x19;
+		value->next = terms != 0;
+	} else if (reg > DASM16_SP) {
+		goto bad;
+	} else if (reg != DASM16_NONE) {
+		if (!bracket && terms)
+			goto bad;
+		value->code = !bracket ? reg : terms ? 0x10 + reg : 0x08 + reg;
+		value->next = bracket && terms;
+	} else if (!terms) {
+		goto bad;
+	} else if (bracket) {
+		value->code = 0x1e;
+		value->next = 1;
+	} else if (a && value->known && dasm16_fits(value->word)) {
+		value->code = dasm16_literal(value->word);
+	} else {
+		value->code = 0x1f;
+		value->next = 1;
+	}
+
+	*pp = p;
+	return 1;
+
+bad:
+	p = dasm16_skip(*pp);
+	dasm16_error(program, program->line, "bad operand at `%.*s'", (int)strcspn(p, ";\n"), p);
+	return 0;
+}
+
+/* note an instruction whose a operand dasm16_relax() might pack */
+static void dasm16_site(struct dasm16 *program, long address, int jump, struct dasm16_use *use)
+{
+	struct dasm16_site *site;
+
+	if (program->length == 0x10000)
+		return;
+
+	site = arena_alloc(program->arena, sizeof *site);
+	site->address = (unsigned short)address;
+	site->jump = jump;
+	site->form = DASM16_SHORT;
+	site->use = use;
+	site->next = NULL;
+
+	*program->last_site = site;
+	program->last_site = &site->next;
+}
+
+static const char *dasm16_instruction(struct dasm16 *program, const struct dasm16_opcode *opcode,
+	const char *p)
+{
+	struct dasm16_value a, b;
+	struct dasm16_use *use;
+	long address;
+	int i, jump;
+
+	/* `hwi, [x]' is seen in the wild */
+	if (*p == ',')
+		p = dasm16_skip(p + 1);
+
+	/* like dtasm, never give a special opcode a short literal: the vm
+	 * decodes their operand as a b, which can't be one */
+	if (opcode->special) {
+		if (opcode->opcode == 0x0b && dasm16_end(*p)) {
+			/* rfi's operand is ignored */
+			a.code = 0x1f;
+			a.next = 1;
+			a.word = 0;
+			a.nrefs = 0;
+		} else if (!dasm16_operand(program, &p, 0, &a)) {
+			return NULL;
+		}
+		if (opcode->opcode == 0x01)
+			for (i = 0; i < a.nrefs; i++)
+				a.refs[i].symbol->called |= !a.refs[i].negate;
+		dasm16_emit(program, (unsigned short)(opcode->opcode << 5 | a.code << 10));
+		if (a.next)
+			dasm16_emit_value(program, &a);
+		return p;
+	}
+
+	if (!dasm16_operand(program, &p, 0, &b))
+		return NULL;
+	if (*p++ != ',') {
+		dasm16_error(program, program->line, "expected `,' after the first operand");
+		return NULL;
+	}
+	if (!dasm16_operand(program, &p, 1, &a))
+		return NULL;
+
+	/* the cpu reads a's next word first */
+	address = program->length;
+	dasm16_emit(program, (unsigned short)(opcode->opcode | b.code << 5 | a.code << 10));
+	if (a.next) {
+		use = dasm16_emit_value(program, &a);
+		jump = opcode->opcode == 0x01 && b.code == 0x1c;
+		if (a.code == 0x1f && (!a.known || jump))
+			dasm16_site(program, address, jump, use);
+	}
+	if (b.next)
+		dasm16_emit_value(program, &b);
+	return p;
+}
+
+static const char *dasm16_dat(struct dasm16 *program, const char *p)
+{
+	struct dasm16_value value;
+
+	do {
+		p = dasm16_skip(p);
+		if (*p == '"') {
+			p++;
+			while (*p != '"') {
+				if (*p == '\0' || *p == '\n') {
+					dasm16_error(program, program->line, "unterminated string");
+					return NULL;
+				}
+				dasm16_emit(program, (unsigned short)(unsigned char)dasm16_escape(&p));
+			}
+			p = dasm16_skip(p + 1);
+		} else {
+			if (!dasm16_operand(program, &p, 0, &value))
+				return NULL;
+			if (value.code != 0x1f) {
+				dasm16_error(program, program->line, "dat takes values, not registers");
+				return NULL;
+			}
+			dasm16_emit_value(program, &value);
+		}
+	} while (*p++ == ',');
+
+	return p - 1;
+}
+
+/* an expression whose value is known now, for .define and .fill */
+static int dasm16_known(struct dasm16 *program, const char **p, unsigned short *word)
+{
+	struct dasm16_value value;
+	int i, count = 0;
+
+	if (!dasm16_operand(program, p, 0, &value))
+		return 0;
+	for (i = 0; i < value.nrefs; i++) {
+		if (!value.refs[i].symbol->defined)
+			break;
+		count += value.refs[i].negate ? -1 : 1;
+	}
+	if (value.code != 0x1f || i < value.nrefs) {
+		dasm16_error(program, program->line, "expected a value that's already known");
+		return 0;
+	}
+	if (program->object && count != 0) {
+		dasm16_error(program, program->line, "a label's address isn't known until it's linked");
+		return 0;
+	}
+
+	/* a label's address, which dasm16_relax() mustn't change */
+	if (value.nrefs != 0 && program->pinned == 0)
+		program->pinned = program->line;
+
+	*word = value.word;
+	return 1;
+}
+
+static const char *dasm16_directive(struct dasm16 *program, struct atom *directive, const char *p)
+{
+	struct dasm16_symbol *symbol;
+	unsigned short count, word;
+
+	switch (dasm16_keyword(program, directive)) {
+	case DASM16_DEFINE:
+		if (!dasm16_identifier_start(*p)) {
+			dasm16_error(program, program->line, "expected a name after .define");
+			return NULL;
+		}
+		symbol = dasm16_symbol(program, dasm16_name(program, &p));
+		p = dasm16_skip(p);
+		if (*p == ',')
+			p++;
+		if (!dasm16_known(program, &p, &word))
+			return NULL;
+		dasm16_define(program, symbol, 1, word);
+		return p;
+	case DASM16_FILL:
+		if (!dasm16_known(program, &p, &count))
+			return NULL;
+		if (*p == ',')
+			p++;
+		if (!dasm16_known(program, &p, &word))
+			return NULL;
+		while (count-- != 0)
+			dasm16_emit(program, word);
+		return p;
+	case DASM16_DOT_DAT:
+		return dasm16_dat(program, p);
+	case DASM16_GLOBAL:
+		do {
+			p = dasm16_skip(p);
+			if (!dasm16_identifier_start(*p)) {
+				dasm16_error(program, program->line, "expected a name after .global");
+				return NULL;
+			}
+			dasm16_symbol(program, dasm16_name(program, &p))->global = 1;
+			p = dasm16_skip(p);
+		} while (*p++ == ',');
+		return p - 1;
+	default:
+		dasm16_error(program, program->line, "unknown directive `%.*s'",
+			directive->length, directive->name);
+		return NULL;
+	}
+}
+
+static const char *dasm16_line(struct dasm16 *program, const char *p)
+{
+	struct atom *atom;
+	const char *name;
+	int keyword;
+
+	for (;;) {
+		p = dasm16_skip(p);
+		if (*p == ':') {
+			if (!dasm16_identifier_start(*++p)) {
+				dasm16_error(program, program->line, "expected a label after `:'");
+				return NULL;
+			}
+		} else if (dasm16_identifier_start(*p)) {
+			for (name = p; dasm16_identifier_char(*p); p++)
+				;
+			if (*p != ':') {
+				p = name;
+				break;
+			}
+			p = name;
+		} else {
+			break;
+		}
+
+		atom = dasm16_name(program, &p);
+		if (*p == ':')
+			p++;
+		dasm16_define(program, dasm16_symbol(program, atom), 0, (unsigned short)program->length);
+	}
+
+	if (dasm16_end(*p))
+		return p;
+
+	name = p;
+	if (*p == '.')
+		p++;
+	if (!dasm16_identifier_start(*p)) {
+		dasm16_error(program, program->line, "unexpected `%c'", *name);
+		return NULL;
+	}
+	p = name;
+	if (*p == '.')
+		p++;
+	while (dasm16_identifier_char(*p))
+		p++;
+	atom = intern(&program->names, name, (int)(p - name));
+	p = dasm16_skip(p);
+
+	keyword = dasm16_keyword(program, atom);
+	if (*name == '.')
+		p = dasm16_directive(program, atom, p);
+	else if (keyword == DASM16_DAT)
+		p = dasm16_dat(program, p);
+	else if (keyword >= DASM16_OPCODE && keyword < DASM16_OPCODE + DASM16_OPCODES)
+		p = dasm16_instruction(program, &dasm16_opcodes[keyword - DASM16_OPCODE], p);
+	else {
+		dasm16_error(program, program->line, "unknown instruction `%.*s'", atom->length, atom->name);
+		return NULL;
+	}
+
+	if (p == NULL)
+		return NULL;
+	p = dasm16_skip(p);
+	if (!dasm16_end(*p)) {
+		dasm16_error(program, program->line, "junk at end of line: `%.*s'",
+			(int)strcspn(p, ";\n"), p);
+		return NULL;
+	}
+	return p;
+}
+
+/**
+ * words still waiting at the end name symbols that were never defined,
+ * unless it's an object, when they're for the linker.
+ */
+static void dasm16_unresolved(struct dasm16 *program)
+{
+	const struct dasm16_symbol *symbol;
+	const struct dasm16_fixup *fixup;
+
+	if (program->object)
+		return;
+	for (symbol = program->symbols; symbol != NULL; symbol = symbol->next)
+		for (fixup = symbol->fixups; fixup != NULL; fixup = fixup->next)
+			dasm16_error(program, fixup->line, "`%.*s' isn't defined",
+				symbol->atom->length, symbol->atom->name);
+}
+
+/**
+ * everything, the program included, is allocated in arena, and goes
+ * when it's reset.
+ */
+struct dasm16 *dasm16_assemble(struct arena *arena, const char *filename,
+	const char *source, size_t length, int object, FILE *diagnostics)
+{
+	struct dasm16 *program = arena_calloc(arena, 1, sizeof *program);
+	char *buffer = arena_alloc(arena, length + 1);
+	const char *p = buffer, *end, *limit = buffer + length;
+	struct dasm16_line *line;
+	long start;
+
+	memcpy(buffer, source, length);
+	buffer[length] = '\0';
+
+	program->filename = filename;
+	program->object = object;
+	program->diagnostics = diagnostics;
+	program->arena = arena;
+	program->source = buffer;
+	program->words = arena_alloc(arena, 0x10000 * sizeof *program->words);
+	program->last_site = &program->sites;
+	program->last_line = &program->lines;
+	intern_init(&program->names, arena, length / 32);
+	dasm16_keywords(program);
+
+	for (program->line = 1; ; program->line++) {
+		start = program->length;
+		if ((end = dasm16_line(program, p)) == NULL)
+			end = p;
+		if (program->length != start) {
+			line = arena_alloc(arena, sizeof *line);
+			line->address = (unsigned short)start;
+			line->line = program->line;
+			line->next = NULL;
+			*program->last_line = line;
+			program->last_line = &line->next;
+		}
+		if (*end != '\n' && (end = memchr(end, '\n', limit - end)) == NULL)
+			break;
+		p = end + 1;
+	}
+
+	dasm16_unresolved(program);
+	return program;
+}
+
+struct dasm16 *dasm16_assemble_file(struct arena *arena, const char *filename, FILE *file,
+	int object, FILE *diagnostics)
+{
+	struct dasm16 *program;
+	char *buffer = NULL;
+	size_t length = 0, capacity = 0, n;
+
+	do {
+		if (capacity - length < 4096) {
+			capacity = capacity ? 2 * capacity : 65536;
+			buffer = erealloc(buffer, capacity);
+		}
+		n = fread(buffer + length, 1, capacity - length, file);
+		length += n;
+	} while (n != 0);
+
+	program = ferror(file) ? NULL : dasm16_assemble(arena, filename, buffer, length, object,
+		diagnostics);
+	free(buffer);
+	return program;
+}
+
+/* what a use comes to, with labels moved back over the words removed before them */
+static unsigned short dasm16_evaluate(const struct dasm16_use *use, const unsigned short *shift)
+{
+	const struct dasm16_symbol *symbol;
+	unsigned short value = use->constant, moved;
+	int i;
+
+	for (i = 0; i < use->nrefs; i++) {
+		symbol = use->refs[i].symbol;
+		moved = symbol->value;
+		if (!symbol->constant)
+			moved -= shift[moved];
+		value = use->refs[i].negate ? value - moved : value + moved;
+	}
+	return value;
+}
+
+/* shift[address] is how many words before address are gone, up to length */
+static void dasm16_shift(const struct dasm16 *program, unsigned short *shift)
+{
+	const struct dasm16_site *site = program->sites;
+	unsigned short removed = 0;
+	long address;
+
+	for (address = 0; address <= program->length; address++) {
+		shift[address] = removed;
+		if (site != NULL && site->address + 1 == address) {
+			removed += site->form != DASM16_LONG;
+			site = site->next;
+		}
+	}
+}
+
+static unsigned short dasm16_site_value(const struct dasm16 *program, const struct dasm16_site *site,
+	const unsigned short *shift)
+{
+	return site->use ? dasm16_evaluate(site->use, shift) : program->words[site->address + 1];
+}
+
+/**
+ * how many times a use counts the address its labels will be linked at:
+ * 0 for a difference of labels, 1 for a label plus a constant. -1 if
+ * it names a symbol from another object, which can't be known.
+ */
+static int dasm16_relocated(const struct dasm16_use *use)
+{
+	const struct dasm16_symbol *symbol;
+	int i, count = 0;
+
+	for (i = 0; use != NULL && i < use->nrefs; i++) {
+		symbol = use->refs[i].symbol;
+		if (!symbol->defined)
+			return -1;
+		if (!symbol->constant)
+			count += use->refs[i].negate ? -1 : 1;
+	}
+	return count;
+}
+
+/**
+ * the shortest form a site can take, for where things are now. in an
+ * object, only what linking doesn't change can be packed: a value that
+ * doesn't depend on the address, or a jump relative to a label in it.
+ */
+static int dasm16_form(const struct dasm16 *program, const struct dasm16_site *site,
+	const unsigned short *shift)
+{
+	unsigned short value = dasm16_site_value(program, site, shift);
+	unsigned short next = (unsigned short)(site->address - shift[site->address] + 1);
+	int relocated = program->object ? dasm16_relocated(site->use) : 0;
+
+	if (dasm16_fits(value) && relocated == 0)
+		return DASM16_SHORT;
+	if (!site->jump || relocated != (program->object ? 1 : 0))
+		return DASM16_LONG;
+	if ((unsigned short)(value - next) <= 30)
+		return DASM16_ADD_PC;
+	if ((unsigned short)(next - value) <= 30)
+		return DASM16_SUB_PC;
+	return DASM16_LONG;
+}
+
+/**
+ * pack the sites' operands, and close up the words they leave. every
+ * site starts short, and is made long for good when its value won't
+ * fit. packing only moves labels back, but that can take a relative
+ * jump or a difference of labels out of range as well as into it, so
+ * sites never go back: with that, it has to stop, and when no site
+ * changes every short one fits.
+ */
+void dasm16_relax(struct dasm16 *program)
+{
+	struct dasm16_symbol *symbol;
+	struct dasm16_site *site;
+	struct dasm16_line *line;
+	struct dasm16_use *use, **link;
+	unsigned short *shift, value, next, word;
+	long address;
+	int i, changed;
+
+	if (program->errors != 0 || program->overflowed || program->pinned || program->sites == NULL)
+		return;
+
+	/* take the labels back out of the words they went into */
+	for (use = program->uses; use != NULL; use = use->next) {
+		use->constant = program->words[use->address];
+		for (i = 0; i < use->nrefs; i++)
+			if (use->refs[i].negate)
+				use->constant += use->refs[i].symbol->value;
+			else
+				use->constant -= use->refs[i].symbol->value;
+	}
+
+	shift = arena_alloc(program->arena, (program->length + 1) * sizeof *shift);
+	do {
+		dasm16_shift(program, shift);
+		changed = 0;
+		for (site = program->sites; site != NULL; site = site->next) {
+			if (site->form == DASM16_LONG)
+				continue;
+			site->form = dasm16_form(program, site, shift);
+			changed |= site->form == DASM16_LONG;
+		}
+	} while (changed);
+
+	/* rewrite in place, then move everything down over what's gone */
+	for (site = program->sites; site != NULL; site = site->next) {
+		if (site->form == DASM16_LONG)
+			continue;
+		value = dasm16_site_value(program, site, shift);
+		next = (unsigned short)(site->address - shift[site->address] + 1);
+		word = program->words[site->address] & 0x03ff;
+		if (site->form == DASM16_ADD_PC) {
+			word = (word & ~0x1f) | 0x02;
+			value -= next;
+		} else if (site->form == DASM16_SUB_PC) {
+			word = (word & ~0x1f) | 0x03;
+			value = next - value;
+		}
+		program->words[site->address] = (unsigned short)(word | dasm16_literal(value) << 10);
+	}
+
+	for (link = &program->uses; (use = *link) != NULL; ) {
+		if (shift[use->address + 1] != shift[use->address]) {
+			*link = use->next;
+			continue;
+		}
+		program->words[use->address] = dasm16_evaluate(use, shift);
+		link = &use->next;
+	}
+
+	for (address = 0; address < program->length; address++)
+		if (shift[address + 1] == shift[address])
+			program->words[address - shift[address]] = program->words[address];
+
+	for (use = program->uses; use != NULL; use = use->next)
+		use->address -= shift[use->address];
+	for (site = program->sites; site != NULL; site = site->next)
+		site->address -= shift[site->address];
+	for (line = program->lines; line != NULL; line = line->next)
+		line->address -= shift[line->address];
+	for (symbol = program->symbols; symbol != NULL; symbol = symbol->next)
+		if (!symbol->constant)
+			symbol->value -= shift[symbol->value];
+	program->length -= shift[program->length];
+}
+
+static int dasm16_by_address(const void *a, const void *b)
+{
+	const struct dasm16_symbol *x = *(const struct dasm16_symbol *const *)a;
+	const struct dasm16_symbol *y = *(const struct dasm16_symbol *const *)b;
+
+	return (x->value > y->value) - (x->value < y->value);
+}
+
+static void dasm16_report_function(const struct dasm16 *program, FILE *file,
+	const struct dasm16_symbol *function, int words, int cycles)
+{
+	if (words == 0)
+		return;
+	if (function != NULL)
+		efprintf(file, "%s:   %.*s: ", program->filename, function->atom->length, function->atom->name);
+	else
+		efprintf(file, "%s:   before any function: ", program->filename);
+	efprintf(file, "%d word%s, %d cycle%s\n", words, words == 1 ? "" : "s", cycles, cycles == 1 ? "" : "s");
+}
+
+/**
+ * what dasm16_relax() saved, in all and for each function: from a label
+ * jsr names to the next. a cycle is saved for each short literal each
+ * time it runs; a relative jump takes as long as the one it replaces.
+ */
+void dasm16_report(const struct dasm16 *program, FILE *file)
+{
+	const struct dasm16_symbol *symbol, **functions;
+	const struct dasm16_site *site;
+	int words = 0, cycles = 0, nfunctions = 0, i;
+
+	if (program->pinned) {
+		efprintf(file, "%s:%d: a label's address is needed here, so nothing was packed\n",
+			program->filename, program->pinned);
+		return;
+	}
+
+	for (site = program->sites; site != NULL; site = site->next) {
+		words += site->form != DASM16_LONG;
+		cycles += site->form == DASM16_SHORT;
+	}
+	if (words == 0)
+		return;
+	efprintf(file, "%s: packing saved %d word%s, and %d cycle%s if each instruction runs once\n",
+		program->filename, words, words == 1 ? "" : "s", cycles, cycles == 1 ? "" : "s");
+
+	for (symbol = program->symbols; symbol != NULL; symbol = symbol->next)
+		nfunctions += symbol->called && symbol->defined && !symbol->constant;
+	functions = emalloc((nfunctions + 1) * sizeof *functions);
+	nfunctions = 0;
+	for (symbol = program->symbols; symbol != NULL; symbol = symbol->next)
+		if (symbol->called && symbol->defined && !symbol->constant)
+			functions[nfunctions++] = symbol;
+	qsort(functions, nfunctions, sizeof *functions, dasm16_by_address);
+
+	/* sites are in address order too */
+	words = cycles = 0;
+	i = -1;
+	for (site = program->sites; site != NULL; site = site->next) {
+		if (i + 1 < nfunctions && functions[i + 1]->value <= site->address) {
+			dasm16_report_function(program, file, i < 0 ? NULL : functions[i], words, cycles);
+			words = cycles = 0;
+			while (i + 1 < nfunctions && functions[i + 1]->value <= site->address)
+				i++;
+		}
+		words += site->form != DASM16_LONG;
+		cycles += site->form == DASM16_SHORT;
+	}
+	dasm16_report_function(program, file, i < 0 ? NULL : functions[i], words, cycles);
+
+	free(functions);
+}
+
+static int dasm16_exported(const struct dasm16_symbol *symbol)
+{
+	return !symbol->defined || !symbol->constant || symbol->global;
+}
+
+/**
+ * the program as an object with one section, text: its labels, global
+ * constants and the symbols it needs, in the order they were seen, and
+ * a relocation for each time a word counts a label's address.
+ */
+struct object *dasm16_object(struct dasm16 *program, struct arena *arena)
+{
+	struct object *object = arena_alloc(arena, sizeof *object);
+	struct object_symbol *out;
+	struct object_reloc *reloc;
+	struct dasm16_symbol *symbol;
+	const struct dasm16_use *use;
+	const struct dasm16_line *line;
+	int i, n, count;
+
+	object->filename = program->filename;
+	object->source = program->filename;
+	object->nsections = 1;
+	object->sections = arena_alloc(arena, sizeof *object->sections);
+	object->sections->name = "text";
+	object->sections->length = (unsigned short)program->length;
+	object->sections->words = program->words;
+	object->sections->base = 0;
+
+	n = 0;
+	for (symbol = program->symbols; symbol != NULL; symbol = symbol->next)
+		n += dasm16_exported(symbol);
+	object->nsymbols = n;
+	object->symbols = arena_alloc(arena, n * sizeof *object->symbols + 1);
+	for (symbol = program->symbols; symbol != NULL; symbol = symbol->next) {
+		if (!dasm16_exported(symbol))
+			continue;
+		symbol->index = --n;
+		out = &object->symbols[n];
+		out->name = symbol->atom->name;
+		out->length = symbol->atom->length;
+		out->flags = (symbol->defined ? OBJECT_DEFINED : 0) | (symbol->global ? OBJECT_GLOBAL : 0)
+			| (symbol->defined && symbol->constant ? OBJECT_ABSOLUTE : 0);
+		out->section = 0;
+		out->value = symbol->value;
+	}
+
+	n = 0;
+	for (use = program->uses; use != NULL; use = use->next) {
+		count = 0;
+		for (i = 0; i < use->nrefs; i++) {
+			symbol = use->refs[i].symbol;
+			if (!symbol->defined)
+				n++;
+			else if (!symbol->constant)
+				count += use->refs[i].negate ? -1 : 1;
+		}
+		n += count < 0 ? -count : count;
+	}
+	object->nrelocs = n;
+	object->relocs = reloc = arena_alloc(arena, n * sizeof *object->relocs + 1);
+
+	for (use = program->uses; use != NULL; use = use->next) {
+		count = 0;
+		for (i = 0; i < use->nrefs; i++) {
+			symbol = use->refs[i].symbol;
+			if (symbol->defined) {
+				if (!symbol->constant)
+					count += use->refs[i].negate ? -1 : 1;
+				continue;
+			}
+			reloc->section = 0;
+			reloc->address = use->address;
+			reloc->flags = use->refs[i].negate ? OBJECT_NEGATE : 0;
+			reloc->symbol = symbol->index;
+			reloc++;
+		}
+		for (; count != 0; count += count < 0 ? 1 : -1) {
+			reloc->section = 0;
+			reloc->address = use->address;
+			reloc->flags = OBJECT_SECTION | (count < 0 ? OBJECT_NEGATE : 0);
+			reloc->symbol = 0;
+			reloc++;
+		}
+	}
+
+	n = 0;
+	for (line = program->lines; line != NULL; line = line->next)
+		n++;
+	object->nlines = n;
+	object->lines = arena_alloc(arena, n * sizeof *object->lines + 1);
+	for (n = 0, line = program->lines; line != NULL; line = line->next, n++) {
+		object->lines[n].section = 0;
+		object->lines[n].address = line->address;
+		object->lines[n].line = line->line;
+	}
+
+	return object;
+}
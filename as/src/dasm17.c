@@ -0,0 +1,748 @@
+#include <ctype.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+#include "printf.h"
+#include "dasm17.h"
+
+/* the instruction transfers control, so can't be the first of a pair */
+#define DASM17_JUMPS 0x1
+
+/**
+ * one way of writing an instruction: a mnemonic and the kinds of its
+ * operands, and where each operand's value goes in the word. the same
+ * mnemonic can have several forms, like jmp @a and jmp $b.
+ */
+struct dasm17_form {
+	const char *name;
+	const char *operands;
+	unsigned short opcode;
+	unsigned char shift[3];
+	unsigned char max[3];
+
+	/* the seven-bit short form for operands up to 3, or -1 */
+	int shortform;
+	int flags;
+};
+
+static const struct dasm17_form dasm17_forms[] = {
+	{"noop",    "",    0x0000, {0},       {0},           -1,   0},
+	{"wait",    "",    0x0001, {0},       {0},           -1,   0},
+	{"halt",    "",    0x0002, {0},       {0},           -1,   0},
+	{"fail",    "",    0x0003, {0},       {0},           -1,   0},
+	{"debug",   "",    0x07ff, {0},       {0},           -1,   0},
+
+	{"jc",      "@@",  0x0800, {2, 0},    {3, 3},        0x10, DASM17_JUMPS},
+	{"set",     "@@",  0x0810, {2, 0},    {3, 3},        0x20, 0},
+	{"swap",    "@@",  0x0820, {2, 0},    {3, 3},        0x30, 0},
+	{"zero",    "@",   0x0900, {0},       {3},           0x00, 0},
+	{"jmp",     "@",   0x0904, {0},       {3},           0x0c, DASM17_JUMPS},
+	{"inc",     "@",   0x0908, {0},       {3},           0x04, 0},
+	{"dec",     "@",   0x090c, {0},       {3},           0x08, 0},
+	{"push",    "@",   0x0910, {0},       {3},           -1,   0},
+	{"pop",     "@",   0x0914, {0},       {3},           -1,   0},
+	{"peek",    "@",   0x0918, {0},       {3},           -1,   0},
+	{"ld",      "%@",  0x0a00, {0, 4},    {15, 3},       -1,   0},
+	{"st",      "@%",  0x0a40, {4, 0},    {3, 15},       -1,   0},
+	{"jmp",     "$",   0x0f00, {0},       {255},         -1,   DASM17_JUMPS},
+
+	{"loop",    "@$",  0x1000, {8, 0},    {3, 255},      -1,   DASM17_JUMPS},
+	{"jc",      "@$",  0x1400, {8, 0},    {3, 255},      -1,   DASM17_JUMPS},
+	{"set",     "@$",  0x1800, {8, 0},    {3, 255},      -1,   0},
+	{"cmp",     "@$",  0x1c00, {8, 0},    {3, 255},      -1,   0},
+	{"ld",      "%$",  0x2000, {8, 0},    {15, 255},     -1,   0},
+	{"st",      "$%",  0x3000, {0, 8},    {255, 15},     -1,   0},
+
+	{"sin",     "%",   0x4000, {0},       {15},          -1,   0},
+	{"cos",     "%",   0x4010, {0},       {15},          -1,   0},
+	{"tan",     "%",   0x4020, {0},       {15},          -1,   0},
+	{"asin",    "%",   0x4030, {0},       {15},          -1,   0},
+	{"acos",    "%",   0x4040, {0},       {15},          -1,   0},
+	{"atan",    "%",   0x4050, {0},       {15},          -1,   0},
+	{"sqrt",    "%",   0x4060, {0},       {15},          -1,   0},
+	{"rnd",     "%",   0x4070, {0},       {15},          -1,   0},
+	{"log10",   "%",   0x4080, {0},       {15},          -1,   0},
+	{"log2",    "%",   0x4090, {0},       {15},          -1,   0},
+	{"log",     "%",   0x40a0, {0},       {15},          -1,   0},
+	{"abs",     "%",   0x40c0, {0},       {15},          -1,   0},
+
+	{"ldz",     "%",   0x4100, {0},       {15},          -1,   0},
+	{"ld1",     "%",   0x4110, {0},       {15},          -1,   0},
+	{"ldpi",    "%",   0x4120, {0},       {15},          -1,   0},
+	{"lde",     "%",   0x4130, {0},       {15},          -1,   0},
+	{"ldsr2",   "%",   0x4140, {0},       {15},          -1,   0},
+	{"ldphi",   "%",   0x4150, {0},       {15},          -1,   0},
+	{"ldl2e",   "%",   0x4180, {0},       {15},          -1,   0},
+	{"ldl2x",   "%",   0x4190, {0},       {15},          -1,   0},
+	{"ldlg2",   "%",   0x41a0, {0},       {15},          -1,   0},
+	{"ldln2",   "%",   0x41b0, {0},       {15},          -1,   0},
+
+	{"mov",     "%%",  0x4800, {0, 4},    {15, 15},      0x40, 0},
+	{"xchg",    "%%",  0x4900, {0, 4},    {15, 15},      -1,   0},
+	{"add",     "%%",  0x4a00, {0, 4},    {15, 15},      0x50, 0},
+	{"mul",     "%%",  0x4b00, {0, 4},    {15, 15},      0x70, 0},
+	{"sub",     "%%",  0x4c00, {0, 4},    {15, 15},      0x60, 0},
+	{"rsub",    "%%",  0x4d00, {0, 4},    {15, 15},      -1,   0},
+	{"div",     "%%",  0x4e00, {0, 4},    {15, 15},      -1,   0},
+	{"rdiv",    "%%",  0x4f00, {0, 4},    {15, 15},      -1,   0},
+
+	{"lt",      "@%%", 0x5000, {8, 0, 4}, {3, 15, 15},   -1,   0},
+	{"gt",      "@%%", 0x5400, {8, 0, 4}, {3, 15, 15},   -1,   0},
+	{"eq",      "@%%", 0x5800, {8, 0, 4}, {3, 15, 15},   -1,   0},
+	{"ne",      "@%%", 0x5c00, {8, 0, 4}, {3, 15, 15},   -1,   0},
+	{"atan",    "%%%", 0x6000, {0, 4, 8}, {15, 15, 15},  -1,   0},
+	{"fma",     "%%%", 0x7000, {0, 4, 8}, {15, 15, 15},  -1,   0},
+
+	{"vlen",    "@",   0x8000, {0},       {3},           -1,   0},
+	{"vstride", "@",   0x8004, {0},       {3},           -1,   0},
+	{"vlen",    "$",   0x8100, {0},       {127},         -1,   0},
+	{"vstride", "$",   0x8200, {0},       {127},         -1,   0},
+
+	{"vadd",    "@@@", 0x9000, {4, 2, 0}, {3, 3, 3},     -1,   0},
+	{"vsub",    "@@@", 0x9100, {4, 2, 0}, {3, 3, 3},     -1,   0},
+	{"vmul",    "@@@", 0x9200, {4, 2, 0}, {3, 3, 3},     -1,   0},
+	{"vdiv",    "@@@", 0x9300, {4, 2, 0}, {3, 3, 3},     -1,   0},
+	{"vfma",    "@@@", 0x9400, {4, 2, 0}, {3, 3, 3},     -1,   0},
+	{"vlt",     "@@@", 0x9500, {4, 2, 0}, {3, 3, 3},     -1,   0},
+	{"vgt",     "@@@", 0x9600, {4, 2, 0}, {3, 3, 3},     -1,   0},
+	{"veq",     "@@@", 0x9700, {4, 2, 0}, {3, 3, 3},     -1,   0},
+	{"vne",     "@@@", 0x9800, {4, 2, 0}, {3, 3, 3},     -1,   0},
+	{"vmin",    "@@@", 0x9900, {4, 2, 0}, {3, 3, 3},     -1,   0},
+	{"vmax",    "@@@", 0x9a00, {4, 2, 0}, {3, 3, 3},     -1,   0},
+	{"vmov",    "@@",  0x9b00, {4, 2},    {3, 3},        -1,   0},
+
+	{"vbcast",  "@%",  0xa000, {4, 0},    {3, 15},       -1,   0},
+	{"vadds",   "@%",  0xa100, {4, 0},    {3, 15},       -1,   0},
+	{"vsubs",   "@%",  0xa200, {4, 0},    {3, 15},       -1,   0},
+	{"vmuls",   "@%",  0xa300, {4, 0},    {3, 15},       -1,   0},
+	{"vdivs",   "@%",  0xa400, {4, 0},    {3, 15},       -1,   0},
+
+	{"vsum",    "%@",  0xb000, {0, 4},    {15, 3},       -1,   0},
+	{"vrmin",   "%@",  0xb100, {0, 4},    {15, 3},       -1,   0},
+	{"vrmax",   "%@",  0xb200, {0, 4},    {15, 3},       -1,   0},
+	{"vdot",    "%@@", 0xb800, {4, 2, 0}, {3, 3, 3},     -1,   0}
+};
+
+#define DASM17_FORMS ((int)(sizeof dasm17_forms / sizeof *dasm17_forms))
+
+static const char *const dasm17_types[3] = {"f32", "f64", "f16"};
+
+/* floating-point registers and DATA elements at each precision */
+static const int dasm17_registers[3] = {8, 4, 16};
+static const int dasm17_elements[3] = {256, 128, 256};
+
+static void dasm17_error(const struct dasm17 *program, int line, const char *fmt, ...)
+{
+	va_list args;
+
+	efprintf(stderr, "%s:%d: ", program->filename, line);
+	va_start(args, fmt);
+	evfprintf(stderr, fmt, args);
+	va_end(args);
+	efprintf(stderr, "\n");
+
+	exit(EXIT_FAILURE);
+}
+
+static char *dasm17_strdup(const char *s)
+{
+	char *p = emalloc(strlen(s) + 1);
+
+	strcpy(p, s);
+	return p;
+}
+
+static char *dasm17_skip(char *p)
+{
+	while (isspace((unsigned char)*p))
+		p++;
+	return p;
+}
+
+static int dasm17_identifier_char(int c, int first)
+{
+	return isalpha(c) || c == '_' || c == '.' || (!first && isdigit(c));
+}
+
+/* the identifier at p, null-terminated in place, or NULL if there isn't one */
+static char *dasm17_identifier(char **p)
+{
+	char *start = *p, *end = start;
+
+	if (!dasm17_identifier_char((unsigned char)*end, 1))
+		return NULL;
+	while (dasm17_identifier_char((unsigned char)*end, 0))
+		end++;
+
+	*p = end;
+	return start;
+}
+
+static struct dasm17_symbol *dasm17_lookup(const struct dasm17 *program, const char *name)
+{
+	struct dasm17_symbol *symbol;
+
+	for (symbol = program->symbols; symbol != NULL; symbol = symbol->next)
+		if (strcmp(symbol->name, name) == 0)
+			return symbol;
+	return NULL;
+}
+
+static void dasm17_define(struct dasm17 *program, int line, const char *name,
+	int kind, long value, long count)
+{
+	struct dasm17_symbol *symbol = dasm17_lookup(program, name);
+
+	/* the same array may be named in both views of DATA */
+	if (symbol != NULL && !((symbol->kind == DASM17_INITIAL || symbol->kind == DASM17_FINAL)
+	                        && (kind == DASM17_INITIAL || kind == DASM17_FINAL)
+	                        && symbol->kind != kind
+	                        && symbol->value == value && symbol->count == count))
+		dasm17_error(program, line, "`%s' is already defined on line %d",
+			name, symbol->line);
+
+	symbol = emalloc(sizeof *symbol);
+	symbol->name = dasm17_strdup(name);
+	symbol->kind = kind;
+	symbol->value = value;
+	symbol->count = count;
+	symbol->line = line;
+	symbol->next = NULL;
+
+	*program->last = symbol;
+	program->last = &symbol->next;
+}
+
+static long dasm17_number(const struct dasm17 *program, int line, char **p)
+{
+	char *end;
+	long value = strtol(*p, &end, 0);
+
+	if (end == *p)
+		dasm17_error(program, line, "expected a number at `%s'", *p);
+	*p = end;
+	return value;
+}
+
+/* x as binary16, rounded to nearest even */
+static unsigned short dasm17_half(double x)
+{
+	unsigned short sign = x < 0 ? 0x8000 : 0;
+	double a = fabs(x), m, q;
+	int e;
+
+	if (a != a)
+		return 0x7e00;
+	if (a >= 65520.0)
+		return sign | 0x7c00;
+
+	if (a < 1.0 / 16384) {
+		/* subnormal, in units of 2^-24; rounding up to 0x400 makes
+		 * the smallest normal, as it should */
+		m = a * 16777216.0;
+		e = -14;
+	} else {
+		m = frexp(a, &e) * 2048.0;
+	}
+
+	q = floor(m);
+	if (m - q > 0.5 || (m - q == 0.5 && fmod(q, 2.0) != 0))
+		q += 1;
+
+	if (a < 1.0 / 16384)
+		return sign | (unsigned short)q;
+	if (q == 2048) {
+		q = 1024;
+		e++;
+	}
+	return sign | (unsigned short)((e + 14) << 10) | (unsigned short)(q - 1024);
+}
+
+/**
+ * store x in DATA as element index at the program's precision. the
+ * device's banks are the host's floats viewed as words, and so are
+ * these, except halves, which are converted by hand.
+ */
+static void dasm17_store(struct dasm17 *program, long index, double x)
+{
+	float f = (float)x;
+
+	switch (program->precision) {
+	case DASM17_HALF:
+		program->data[index] = dasm17_half(x);
+		break;
+	case DASM17_SINGLE:
+		memcpy(&program->data[2 * index], &f, sizeof f);
+		break;
+	case DASM17_DOUBLE:
+		memcpy(&program->data[4 * index], &x, sizeof x);
+		break;
+	}
+}
+
+/**
+ * `initial' and `final' lay out the DATA bank as the text finds it and
+ * as it leaves it. each item is a name, an array name[n], or, for
+ * initial, a number, which is stored in the bank.
+ */
+static void dasm17_declare(struct dasm17 *program, int line, int kind, char *p)
+{
+	long *next = kind == DASM17_INITIAL ? &program->initial : &program->final;
+	char *type, *name, *end, saved;
+	long count;
+	double x;
+	int precision;
+
+	p = dasm17_skip(p);
+	type = dasm17_identifier(&p);
+	for (precision = 0; precision < 3; precision++)
+		if (type != NULL && (int)(p - type) == 3 && strncmp(type, dasm17_types[precision], 3) == 0)
+			break;
+	if (precision == 3)
+		dasm17_error(program, line, "expected f16, f32 or f64");
+
+	if (program->initial + program->final == 0)
+		program->precision = precision;
+	else if (program->precision != precision)
+		dasm17_error(program, line, "DATA is already %s", dasm17_types[program->precision]);
+
+	do {
+		p = dasm17_skip(p);
+		if ((name = dasm17_identifier(&p)) != NULL) {
+			saved = *p;
+			*p = '\0';
+			name = dasm17_strdup(name);
+			*p = saved;
+
+			count = 1;
+			p = dasm17_skip(p);
+			if (*p == '[') {
+				p++;
+				p = dasm17_skip(p);
+				count = dasm17_number(program, line, &p);
+				p = dasm17_skip(p);
+				if (*p++ != ']' || count < 1)
+					dasm17_error(program, line, "expected an array size");
+			}
+
+			if (*next + count > dasm17_elements[precision])
+				dasm17_error(program, line, "`%s' doesn't fit in DATA", name);
+			dasm17_define(program, line, name, kind, *next, count);
+			free(name);
+			*next += count;
+		} else {
+			x = strtod(p, &end);
+			if (end == p)
+				dasm17_error(program, line, "expected a name or a number at `%s'", p);
+			p = end;
+			if (*p == 'f' || *p == 'F')
+				p++;
+
+			if (kind == DASM17_FINAL)
+				dasm17_error(program, line, "final data has no values");
+			if (*next + 1 > dasm17_elements[precision])
+				dasm17_error(program, line, "too much data");
+			dasm17_store(program, *next, x);
+			*next += 1;
+		}
+		p = dasm17_skip(p);
+	} while (*p++ == ',');
+
+	if (p[-1] != '\0')
+		dasm17_error(program, line, "expected `,' in declaration");
+}
+
+static void dasm17_operand(const struct dasm17 *program, int line, char *p,
+	struct dasm17_operand *operand)
+{
+	char *name, saved;
+	long sign;
+
+	p = dasm17_skip(p);
+	operand->symbol = NULL;
+	operand->value = 0;
+
+	if (*p == '%' || *p == '@') {
+		operand->kind = *p++;
+		operand->value = dasm17_number(program, line, &p);
+	} else {
+		operand->kind = DASM17_IMM;
+		if (*p == '$')
+			p = dasm17_skip(p + 1);
+
+		if ((name = dasm17_identifier(&p)) != NULL) {
+			saved = *p;
+			*p = '\0';
+			operand->symbol = dasm17_strdup(name);
+			*p = saved;
+
+			p = dasm17_skip(p);
+			if (*p == '+' || *p == '-') {
+				sign = *p++ == '-' ? -1 : 1;
+				p = dasm17_skip(p);
+				operand->value = sign * dasm17_number(program, line, &p);
+			}
+		} else {
+			operand->value = dasm17_number(program, line, &p);
+		}
+	}
+
+	if (*dasm17_skip(p) != '\0')
+		dasm17_error(program, line, "junk after operand: `%s'", p);
+}
+
+static void dasm17_instruction(struct dasm17 *program, int line, const char *source,
+	const char *mnemonic, char *p, int target)
+{
+	struct dasm17_instruction *instruction;
+	char kinds[4], *comma;
+	int i;
+
+	if (program->count == program->capacity) {
+		program->capacity = program->capacity ? 2 * program->capacity : 64;
+		program->instructions = erealloc(program->instructions,
+			program->capacity * sizeof *program->instructions);
+	}
+	instruction = &program->instructions[program->count];
+
+	instruction->noperands = 0;
+	p = dasm17_skip(p);
+	while (*p != '\0') {
+		if (instruction->noperands == 3)
+			dasm17_error(program, line, "too many operands");
+		if ((comma = strchr(p, ',')) != NULL)
+			*comma = '\0';
+		dasm17_operand(program, line, p, &instruction->operands[instruction->noperands]);
+		kinds[instruction->noperands] = (char)instruction->operands[instruction->noperands].kind;
+		instruction->noperands++;
+		if (comma == NULL)
+			break;
+		p = comma + 1;
+	}
+	kinds[instruction->noperands] = '\0';
+
+	for (i = 0; i < DASM17_FORMS; i++)
+		if (strcmp(dasm17_forms[i].name, mnemonic) == 0
+		    && strcmp(dasm17_forms[i].operands, kinds) == 0)
+			break;
+	if (i == DASM17_FORMS) {
+		for (i = 0; i < DASM17_FORMS; i++)
+			if (strcmp(dasm17_forms[i].name, mnemonic) == 0)
+				dasm17_error(program, line, "`%s' doesn't take operands `%s'", mnemonic, kinds);
+		dasm17_error(program, line, "unknown instruction `%s'", mnemonic);
+	}
+
+	instruction->form = &dasm17_forms[i];
+	instruction->line = line;
+	instruction->source = dasm17_strdup(source);
+	instruction->target = target;
+	instruction->paired = 0;
+	instruction->address = 0;
+	program->count++;
+}
+
+/* trim the comment and the space around what's left */
+static char *dasm17_strip(char *line)
+{
+	char *end, *comment = strchr(line, ';');
+
+	if (comment != NULL)
+		*comment = '\0';
+	line = dasm17_skip(line);
+	end = line + strlen(line);
+	while (end > line && isspace((unsigned char)end[-1]))
+		end--;
+	*end = '\0';
+	return line;
+}
+
+static void dasm17_line(struct dasm17 *program, int number, char *line, int *target)
+{
+	char *p, *word, *source, *name, saved;
+	long value;
+
+	line = dasm17_strip(line);
+	for (;;) {
+		p = line;
+		word = dasm17_identifier(&p);
+		if (word == NULL || *p != ':')
+			break;
+		*p = '\0';
+		dasm17_define(program, number, word, DASM17_LABEL, program->count, 0);
+		*target = 1;
+		line = dasm17_skip(p + 1);
+	}
+
+	if (*line == '\0')
+		return;
+
+	source = dasm17_strdup(line);
+	p = line;
+	if ((word = dasm17_identifier(&p)) == NULL)
+		dasm17_error(program, number, "expected an instruction at `%s'", line);
+	if (*p != '\0' && !isspace((unsigned char)*p))
+		dasm17_error(program, number, "expected an instruction at `%s'", line);
+	if (*p != '\0')
+		*p++ = '\0';
+
+	if (strcmp(word, "initial") == 0 || strcmp(word, "final") == 0) {
+		dasm17_declare(program, number, word[0] == 'i' ? DASM17_INITIAL : DASM17_FINAL, p);
+	} else if (strcmp(word, ".equ") == 0) {
+		p = dasm17_skip(p);
+		if ((name = dasm17_identifier(&p)) == NULL)
+			dasm17_error(program, number, "expected a name after .equ");
+		saved = *p;
+		*p = '\0';
+		name = dasm17_strdup(name);
+		*p = saved;
+		p = dasm17_skip(p);
+		value = dasm17_number(program, number, &p);
+		if (*dasm17_skip(p) != '\0')
+			dasm17_error(program, number, "junk after .equ: `%s'", p);
+		dasm17_define(program, number, name, DASM17_EQU, value, 0);
+		free(name);
+	} else {
+		dasm17_instruction(program, number, source, word, p, *target);
+		*target = 0;
+	}
+
+	free(source);
+}
+
+struct dasm17 *dasm17_parse(const char *filename, FILE *file)
+{
+	struct dasm17 *program = ecalloc(1, sizeof *program);
+	char *buffer = NULL, *line, *end;
+	size_t length = 0, capacity = 0, n;
+	int number = 1, target = 0;
+
+	program->filename = filename;
+	program->precision = DASM17_SINGLE;
+	program->last = &program->symbols;
+
+	do {
+		if (capacity - length < 4096) {
+			capacity = capacity ? 2 * capacity : 16384;
+			buffer = erealloc(buffer, capacity);
+		}
+		n = fread(buffer + length, 1, capacity - length - 1, file);
+		length += n;
+	} while (n != 0);
+	if (ferror(file))
+		dasm17_error(program, 0, "can't read the file");
+	buffer[length] = '\0';
+
+	for (line = buffer; line < buffer + length; line = end + 1, number++) {
+		if ((end = strchr(line, '\n')) == NULL)
+			end = buffer + length;
+		*end = '\0';
+		dasm17_line(program, number, line, &target);
+	}
+
+	free(buffer);
+	return program;
+}
+
+static int dasm17_short(const struct dasm17_instruction *instruction)
+{
+	int i;
+
+	if (instruction->form->shortform < 0)
+		return 0;
+	for (i = 0; i < instruction->noperands; i++)
+		if (instruction->operands[i].value > 3)
+			return 0;
+	return 1;
+}
+
+/**
+ * pack adjacent instructions with short forms into pairs. taking each
+ * pair as soon as it's found packs as many as any choice could, as
+ * whether two neighbours can pair doesn't depend on the others.
+ */
+void dasm17_pair(struct dasm17 *program)
+{
+	struct dasm17_instruction *first, *second;
+	int i;
+
+	for (i = 0; i + 1 < program->count; i++) {
+		first = &program->instructions[i];
+		second = &program->instructions[i + 1];
+
+		if (!dasm17_short(first) || !dasm17_short(second))
+			continue;
+		if ((first->form->flags & DASM17_JUMPS) || second->target)
+			continue;
+
+		first->paired = 1;
+		second->paired = 2;
+		program->pairs++;
+		i++;
+	}
+}
+
+static long dasm17_resolve(const struct dasm17 *program, const struct dasm17_instruction *instruction,
+	const struct dasm17_operand *operand)
+{
+	const struct dasm17_symbol *symbol;
+
+	if (operand->symbol == NULL)
+		return operand->value;
+
+	if ((symbol = dasm17_lookup(program, operand->symbol)) == NULL)
+		dasm17_error(program, instruction->line, "`%s' isn't defined", operand->symbol);
+
+	if (symbol->kind == DASM17_LABEL)
+		return operand->value + (symbol->value < program->count
+			? program->instructions[symbol->value].address
+			: program->words);
+	return operand->value + symbol->value;
+}
+
+static unsigned short dasm17_encode(struct dasm17 *program, struct dasm17_instruction *instruction)
+{
+	const struct dasm17_form *form = instruction->form;
+	const struct dasm17_operand *operand;
+	unsigned short word = form->opcode, brief = form->shortform;
+	long value[3];
+	int i;
+
+	for (i = 0; i < instruction->noperands; i++) {
+		operand = &instruction->operands[i];
+		value[i] = dasm17_resolve(program, instruction, operand);
+
+		if (operand->kind == DASM17_FREG && value[i] >= dasm17_registers[program->precision])
+			dasm17_error(program, instruction->line, "there is no %%%ld at %s",
+				value[i], dasm17_types[program->precision]);
+		if (value[i] < 0 || value[i] > form->max[i])
+			dasm17_error(program, instruction->line, "%c%ld is out of range for `%s'",
+				operand->kind, value[i], form->name);
+
+		word |= (unsigned short)(value[i] << form->shift[i]);
+	}
+
+	if (!instruction->paired)
+		return word;
+
+	if (instruction->noperands == 1)
+		return brief | value[0];
+	return brief | value[0] << 2 | value[1];
+}
+
+/* give each instruction its word, then encode them with labels resolved */
+void dasm17_assemble(struct dasm17 *program)
+{
+	struct dasm17_instruction *instruction;
+	unsigned short brief;
+	int i;
+
+	program->words = 0;
+	for (i = 0; i < program->count; i++) {
+		instruction = &program->instructions[i];
+		if (instruction->paired == 2)
+			instruction->address = program->words - 1;
+		else
+			instruction->address = program->words++;
+	}
+	if (program->words > 256)
+		dasm17_error(program, program->instructions[program->count - 1].line,
+			"the text is %d words long, and TEXT has 256", program->words);
+
+	for (i = 0; i < program->count; i++) {
+		instruction = &program->instructions[i];
+		if (instruction->paired == 1) {
+			brief = dasm17_encode(program, instruction);
+			program->text[instruction->address] = 0x8080 | brief << 8
+				| dasm17_encode(program, &program->instructions[++i]);
+		} else {
+			program->text[instruction->address] = dasm17_encode(program, instruction);
+		}
+	}
+}
+
+static void dasm17_write_layout(const struct dasm17 *program, FILE *file, int kind)
+{
+	const struct dasm17_symbol *symbol;
+
+	for (symbol = program->symbols; symbol != NULL; symbol = symbol->next)
+		if (symbol->kind == kind)
+			break;
+	if (symbol == NULL)
+		return;
+
+	efprintf(file, "; %s %s data, by element:\n",
+		kind == DASM17_INITIAL ? "initial" : "final", dasm17_types[program->precision]);
+	for (symbol = program->symbols; symbol != NULL; symbol = symbol->next) {
+		if (symbol->kind != kind)
+			continue;
+		if (symbol->count == 1)
+			efprintf(file, ";   %3ld  %s\n", symbol->value, symbol->name);
+		else
+			efprintf(file, ";   %3ld  %s[%ld]\n", symbol->value, symbol->name, symbol->count);
+	}
+}
+
+/**
+ * write the text and the initial DATA as DCPU-16 assembly, labelled
+ * prefix_text and prefix_data, each filled out to the length the
+ * device transfers.
+ */
+void dasm17_write(const struct dasm17 *program, FILE *file, const char *prefix)
+{
+	const struct dasm17_instruction *instruction;
+	int i, used;
+
+	efprintf(file, "; assembled from %s\n", program->filename);
+	efprintf(file, "; %d instructions in %d words\n", program->count, program->words);
+	dasm17_write_layout(program, file, DASM17_INITIAL);
+	dasm17_write_layout(program, file, DASM17_FINAL);
+
+	efprintf(file, "\n%s_text:\n", prefix);
+	for (i = 0; i < program->count; i++) {
+		instruction = &program->instructions[i];
+		if (instruction->paired == 1) {
+			efprintf(file, "\tdat 0x%04x\t; %s | %s\n", program->text[instruction->address],
+				instruction->source, instruction[1].source);
+			i++;
+		} else {
+			efprintf(file, "\tdat 0x%04x\t; %s\n", program->text[instruction->address],
+				instruction->source);
+		}
+	}
+	if (program->words < 256)
+		efprintf(file, "\t.fill %d 0\n", 256 - program->words);
+
+	for (used = 512; used > 0 && program->data[used - 1] == 0; used--)
+		;
+	efprintf(file, "\n%s_data:\n", prefix);
+	for (i = 0; i < used; i++)
+		efprintf(file, "%s0x%04x%s", i % 8 == 0 ? "\tdat " : "", program->data[i],
+			i % 8 == 7 || i == used - 1 ? "\n" : ", ");
+	if (used < 512)
+		efprintf(file, "\t.fill %d 0\n", 512 - used);
+}
+
+void dasm17_free(struct dasm17 *program)
+{
+	struct dasm17_symbol *symbol, *next;
+	int i, j;
+
+	for (i = 0; i < program->count; i++) {
+		for (j = 0; j < program->instructions[i].noperands; j++)
+			free(program->instructions[i].operands[j].symbol);
+		free(program->instructions[i].source);
+	}
+	free(program->instructions);
+
+	for (symbol = program->symbols; symbol != NULL; symbol = next) {
+		next = symbol->next;
+		free(symbol->name);
+		free(symbol);
+	}
+
+	free(program);
+}
@@ -0,0 +1,91 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "arena.h"
+#include "intern.h"
+
+static unsigned long intern_hash(const char *name, int length)
+{
+	unsigned long hash = 2166136261UL;
+	int i;
+
+	for (i = 0; i < length; i++)
+		hash = ((hash ^ (unsigned char)name[i]) * 16777619UL) & 0xffffffffUL;
+	return hash;
+}
+
+void intern_init(struct intern *table, struct arena *arena, unsigned long size)
+{
+	unsigned long n = 16;
+
+	while (n < 2 * size)
+		n *= 2;
+
+	table->arena = arena;
+	table->slots = arena_calloc(arena, n, sizeof *table->slots);
+	table->size = n;
+	table->count = 0;
+}
+
+/* the slot name belongs in: its atom's, or the empty one ending its run */
+static struct atom **intern_slot(const struct intern *table, const char *name, int length,
+	unsigned long hash)
+{
+	unsigned long mask = table->size - 1, i;
+	struct atom *atom;
+
+	for (i = hash & mask; (atom = table->slots[i]) != NULL; i = (i + 1) & mask)
+		if (atom->hash == hash && atom->length == length
+		    && memcmp(atom->name, name, length) == 0)
+			break;
+	return &table->slots[i];
+}
+
+/* double the table; the old slots stay in the arena until it's reset */
+static void intern_grow(struct intern *table)
+{
+	struct atom **slots = table->slots;
+	unsigned long size = table->size, mask = 2 * size - 1, i, j;
+
+	table->slots = arena_calloc(table->arena, 2 * size, sizeof *table->slots);
+	table->size = 2 * size;
+
+	for (i = 0; i < size; i++) {
+		if (slots[i] == NULL)
+			continue;
+		for (j = slots[i]->hash & mask; table->slots[j] != NULL; j = (j + 1) & mask)
+			;
+		table->slots[j] = slots[i];
+	}
+}
+
+struct atom *intern(struct intern *table, const char *name, int length)
+{
+	unsigned long hash = intern_hash(name, length);
+	struct atom **slot = intern_slot(table, name, length, hash), *atom;
+
+	if (*slot != NULL)
+		return *slot;
+
+	/* keep the table at most half full, so runs stay short */
+	if (2 * (table->count + 1) > table->size) {
+		intern_grow(table);
+		slot = intern_slot(table, name, length, hash);
+	}
+
+	atom = arena_alloc(table->arena, sizeof *atom);
+	atom->name = name;
+	atom->length = length;
+	atom->hash = hash;
+	atom->keyword = INTERN_UNKNOWN;
+	atom->symbol = NULL;
+
+	*slot = atom;
+	table->count++;
+	return atom;
+}
+
+struct atom *intern_lookup(const struct intern *table, const char *name, int length)
+{
+	return *intern_slot(table, name, length, intern_hash(name, length));
+}
@@ -0,0 +1,192 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+#include "printf.h"
+#include "arena.h"
+#include "intern.h"
+#include "object.h"
+#include "link.h"
+
+/* what a global symbol's atom points to */
+struct link_global {
+	const struct object *object;
+	unsigned short value;
+};
+
+/* where a symbol an object defines ends up */
+static unsigned short link_value(const struct object *object, const struct object_symbol *symbol)
+{
+	if (symbol->flags & OBJECT_ABSOLUTE)
+		return symbol->value;
+	return (unsigned short)(object->sections[symbol->section].base + symbol->value);
+}
+
+/* give every section its base, and copy it to memory */
+static int link_layout(struct object_image *image, struct arena *arena,
+	struct object **objects, int n)
+{
+	struct object_segment *segment;
+	struct object_section *section;
+	const char **names;
+	long address = 0;
+	int i, j, k, total = 0;
+
+	for (i = 0; i < n; i++)
+		total += objects[i]->nsections;
+	names = arena_alloc(arena, total * sizeof *names + 1);
+
+	image->nsegments = 0;
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < objects[i]->nsections; j++) {
+			for (k = 0; k < image->nsegments; k++)
+				if (strcmp(names[k], objects[i]->sections[j].name) == 0)
+					break;
+			if (k == image->nsegments)
+				names[image->nsegments++] = objects[i]->sections[j].name;
+		}
+	}
+
+	image->segments = arena_alloc(arena, image->nsegments * sizeof *image->segments + 1);
+	image->memory = arena_calloc(arena, 0x10000, sizeof *image->memory);
+	for (k = 0; k < image->nsegments; k++) {
+		segment = &image->segments[k];
+		segment->name = names[k];
+		segment->address = (unsigned short)address;
+		segment->words = image->memory + address;
+
+		for (i = 0; i < n; i++) {
+			for (j = 0; j < objects[i]->nsections; j++) {
+				section = &objects[i]->sections[j];
+				if (strcmp(section->name, names[k]) != 0)
+					continue;
+				if (address + section->length > 0x10000) {
+					efprintf(stderr, "%s: %s doesn't fit in memory\n",
+						objects[i]->filename, section->name);
+					return 0;
+				}
+				section->base = (unsigned short)address;
+				memcpy(image->memory + address, section->words,
+					section->length * sizeof *section->words);
+				address += section->length;
+			}
+		}
+		segment->length = (unsigned short)(address - segment->address);
+	}
+
+	image->length = address;
+	return 1;
+}
+
+static int link_globals(struct intern *globals, struct arena *arena, struct object **objects, int n)
+{
+	const struct object_symbol *symbol;
+	struct link_global *global;
+	struct atom *atom;
+	int i, j, errors = 0;
+
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < objects[i]->nsymbols; j++) {
+			symbol = &objects[i]->symbols[j];
+			if ((symbol->flags & (OBJECT_DEFINED | OBJECT_GLOBAL)) != (OBJECT_DEFINED | OBJECT_GLOBAL))
+				continue;
+
+			atom = intern(globals, symbol->name, symbol->length);
+			if ((global = atom->symbol) != NULL) {
+				efprintf(stderr, "%s: `%.*s' is already defined in %s\n", objects[i]->filename,
+					symbol->length, symbol->name, global->object->filename);
+				errors++;
+				continue;
+			}
+
+			global = arena_alloc(arena, sizeof *global);
+			global->object = objects[i];
+			global->value = link_value(objects[i], symbol);
+			atom->symbol = global;
+		}
+	}
+	return errors == 0;
+}
+
+/* patch an object's words in memory, with its symbols' values worked out once each */
+static int link_relocate(struct object_image *image, const struct intern *globals,
+	struct arena *arena, const struct object *object)
+{
+	const struct object_symbol *symbol;
+	const struct object_reloc *reloc;
+	const struct link_global *global;
+	const struct atom *atom;
+	unsigned short *values, value, *word;
+	int i, errors = 0;
+
+	values = arena_alloc(arena, object->nsymbols * sizeof *values + 1);
+	for (i = 0; i < object->nsymbols; i++) {
+		symbol = &object->symbols[i];
+		if (symbol->flags & OBJECT_DEFINED) {
+			values[i] = link_value(object, symbol);
+			continue;
+		}
+
+		values[i] = 0;
+		atom = intern_lookup(globals, symbol->name, symbol->length);
+		if (atom != NULL && (global = atom->symbol) != NULL) {
+			values[i] = global->value;
+		} else {
+			efprintf(stderr, "%s: `%.*s' isn't defined\n", object->filename,
+				symbol->length, symbol->name);
+			errors++;
+		}
+	}
+
+	for (i = 0; i < object->nrelocs; i++) {
+		reloc = &object->relocs[i];
+		if (reloc->flags & OBJECT_SECTION)
+			value = object->sections[reloc->symbol].base;
+		else
+			value = values[reloc->symbol];
+
+		word = &image->memory[object->sections[reloc->section].base + reloc->address];
+		if (reloc->flags & OBJECT_NEGATE)
+			*word -= value;
+		else
+			*word += value;
+	}
+	return errors == 0;
+}
+
+/**
+ * everything is allocated in arena, objects' sections included. NULL,
+ * having said why, if they can't be linked.
+ */
+struct object_image *link_objects(struct arena *arena, struct object **objects, int n,
+	const char *entry)
+{
+	struct object_image *image = arena_alloc(arena, sizeof *image);
+	const struct link_global *global = NULL;
+	const struct atom *atom;
+	struct intern globals;
+	int i, ok, total = 0;
+
+	if (!link_layout(image, arena, objects, n))
+		return NULL;
+
+	for (i = 0; i < n; i++)
+		total += objects[i]->nsymbols;
+	intern_init(&globals, arena, total);
+	ok = link_globals(&globals, arena, objects, n);
+	for (i = 0; i < n; i++)
+		ok &= link_relocate(image, &globals, arena, objects[i]);
+
+	atom = intern_lookup(&globals, entry ? entry : "start", (int)strlen(entry ? entry : "start"));
+	if (atom != NULL)
+		global = atom->symbol;
+	if (global == NULL && entry != NULL) {
+		efprintf(stderr, "the entry point, `%s', isn't a global symbol\n", entry);
+		ok = 0;
+	}
+	image->entry = global ? global->value : 0;
+
+	return ok ? image : NULL;
+}
@@ -0,0 +1,301 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+#include "printf.h"
+#include "arena.h"
+#include "object.h"
+
+static void object_word(FILE *file, unsigned int word)
+{
+	putc((word >> 8) & 0xff, file);
+	putc(word & 0xff, file);
+}
+
+static void object_name(FILE *file, const char *name, int length)
+{
+	int i;
+
+	object_word(file, length);
+	for (i = 0; i < length; i += 2)
+		object_word(file, (unsigned char)name[i] << 8
+			| (i + 1 < length ? (unsigned char)name[i + 1] : 0));
+}
+
+/* nonzero if it couldn't all be written */
+int object_write(const struct object *object, FILE *file)
+{
+	const struct object_section *section;
+	const struct object_symbol *symbol;
+	const struct object_reloc *reloc;
+	int i, j;
+
+	object_word(file, 'D' << 8 | 'O');
+	object_word(file, OBJECT_VERSION);
+
+	object_word(file, object->nsections);
+	for (i = 0; i < object->nsections; i++) {
+		section = &object->sections[i];
+		object_name(file, section->name, (int)strlen(section->name));
+		object_word(file, section->length);
+		for (j = 0; j < section->length; j++)
+			object_word(file, section->words[j]);
+	}
+
+	object_word(file, object->nsymbols);
+	for (i = 0; i < object->nsymbols; i++) {
+		symbol = &object->symbols[i];
+		object_name(file, symbol->name, symbol->length);
+		object_word(file, symbol->flags);
+		object_word(file, symbol->section);
+		object_word(file, symbol->value);
+	}
+
+	object_word(file, object->nrelocs);
+	for (i = 0; i < object->nrelocs; i++) {
+		reloc = &object->relocs[i];
+		object_word(file, reloc->section);
+		object_word(file, reloc->address);
+		object_word(file, reloc->flags);
+		object_word(file, reloc->symbol);
+	}
+
+	object_name(file, object->source, (int)strlen(object->source));
+	object_word(file, object->nlines);
+	for (i = 0; i < object->nlines; i++) {
+		object_word(file, object->lines[i].section);
+		object_word(file, object->lines[i].address);
+		object_word(file, (unsigned int)(object->lines[i].line >> 16));
+		object_word(file, (unsigned int)(object->lines[i].line & 0xffff));
+	}
+
+	return ferror(file);
+}
+
+int object_write_image(const struct object_image *image, FILE *file)
+{
+	const struct object_segment *segment;
+	int i, j;
+
+	object_word(file, 'D' << 8 | 'I');
+	object_word(file, OBJECT_VERSION);
+	object_word(file, image->entry);
+
+	object_word(file, image->nsegments);
+	for (i = 0; i < image->nsegments; i++) {
+		segment = &image->segments[i];
+		object_name(file, segment->name, (int)strlen(segment->name));
+		object_word(file, segment->address);
+		object_word(file, segment->length);
+		for (j = 0; j < segment->length; j++)
+			object_word(file, segment->words[j]);
+	}
+
+	return ferror(file);
+}
+
+/* words are stored big-endian, as other DCPU-16 tools expect */
+int object_write_bin(const unsigned short *words, long length, FILE *file)
+{
+	unsigned char *bytes = emalloc(2 * length + 1);
+	long i;
+	int status;
+
+	for (i = 0; i < length; i++) {
+		bytes[2 * i + 0] = (unsigned char)(words[i] >> 8);
+		bytes[2 * i + 1] = (unsigned char)(words[i] & 0xff);
+	}
+	status = fwrite(bytes, 2, length, file) != (size_t)length;
+	free(bytes);
+	return status;
+}
+
+/* eight words to a line, ready to #include in an array initialiser */
+int object_write_hex(const unsigned short *words, long length, FILE *file)
+{
+	long i;
+
+	for (i = 0; i < length; i++)
+		efprintf(file, "0x%x, %s", words[i], i % 8 == 7 || i == length - 1 ? "\n" : "");
+	return ferror(file);
+}
+
+/**
+ * objects' labels and lines, at the addresses they were linked at. the
+ * vm sorts what it reads, so they're written object by object.
+ */
+int object_write_map(struct object **objects, int n, FILE *file)
+{
+	const struct object_symbol *symbol;
+	const struct object_line *line;
+	const struct object *object;
+	int i, j;
+
+	for (i = 0; i < n; i++) {
+		object = objects[i];
+		efprintf(file, "file %d %s\n", i, object->source);
+		for (j = 0; j < object->nsymbols; j++) {
+			symbol = &object->symbols[j];
+			if ((symbol->flags & (OBJECT_DEFINED | OBJECT_ABSOLUTE)) == OBJECT_DEFINED)
+				efprintf(file, "label %04x %.*s\n",
+					(unsigned short)(object->sections[symbol->section].base + symbol->value),
+					symbol->length, symbol->name);
+		}
+		for (j = 0; j < object->nlines; j++) {
+			line = &object->lines[j];
+			efprintf(file, "line %04x %d %ld\n",
+				(unsigned short)(object->sections[line->section].base + line->address),
+				i, line->line);
+		}
+	}
+	return ferror(file);
+}
+
+/* a cursor over the bytes of an object being read */
+struct object_reader {
+	const unsigned char *bytes;
+	size_t length;
+	size_t position;
+	int bad;
+};
+
+static unsigned short object_get(struct object_reader *reader)
+{
+	const unsigned char *p = reader->bytes + reader->position;
+
+	if (reader->length - reader->position < 2) {
+		reader->bad = 1;
+		return 0;
+	}
+	reader->position += 2;
+	return (unsigned short)(p[0] << 8 | p[1]);
+}
+
+/* a name, copied into arena and terminated */
+static char *object_get_name(struct object_reader *reader, struct arena *arena, int *length)
+{
+	char *name;
+	int i, n = object_get(reader);
+
+	if ((reader->length - reader->position) / 2 < (size_t)(n + 1) / 2) {
+		reader->bad = 1;
+		n = 0;
+	}
+
+	name = arena_alloc(arena, n + 1);
+	for (i = 0; i < n; i++)
+		name[i] = (char)reader->bytes[reader->position + i];
+	name[n] = '\0';
+	reader->position += (n + 1) / 2 * 2;
+
+	if (length != NULL)
+		*length = n;
+	return name;
+}
+
+static int object_parse(struct object *object, struct object_reader *reader, struct arena *arena)
+{
+	struct object_section *section;
+	struct object_symbol *symbol;
+	struct object_reloc *reloc;
+	int i, j;
+
+	if (object_get(reader) != ('D' << 8 | 'O') || object_get(reader) != OBJECT_VERSION)
+		return 0;
+
+	object->nsections = object_get(reader);
+	object->sections = arena_alloc(arena, object->nsections * sizeof *object->sections + 1);
+	for (i = 0; i < object->nsections && !reader->bad; i++) {
+		section = &object->sections[i];
+		section->name = object_get_name(reader, arena, NULL);
+		section->length = object_get(reader);
+		section->words = arena_alloc(arena, section->length * sizeof *section->words + 1);
+		section->base = 0;
+		for (j = 0; j < section->length; j++)
+			section->words[j] = object_get(reader);
+	}
+
+	object->nsymbols = object_get(reader);
+	object->symbols = arena_alloc(arena, object->nsymbols * sizeof *object->symbols + 1);
+	for (i = 0; i < object->nsymbols && !reader->bad; i++) {
+		symbol = &object->symbols[i];
+		symbol->name = object_get_name(reader, arena, &symbol->length);
+		symbol->flags = object_get(reader);
+		symbol->section = object_get(reader);
+		symbol->value = object_get(reader);
+		if ((symbol->flags & (OBJECT_DEFINED | OBJECT_ABSOLUTE)) == OBJECT_DEFINED
+				&& symbol->section >= object->nsections)
+			return 0;
+	}
+
+	object->nrelocs = object_get(reader);
+	object->relocs = arena_alloc(arena, object->nrelocs * sizeof *object->relocs + 1);
+	for (i = 0; i < object->nrelocs && !reader->bad; i++) {
+		reloc = &object->relocs[i];
+		reloc->section = object_get(reader);
+		reloc->address = object_get(reader);
+		reloc->flags = object_get(reader);
+		reloc->symbol = object_get(reader);
+		if (reloc->section >= object->nsections
+				|| reloc->address >= object->sections[reloc->section].length
+				|| reloc->symbol >= (reloc->flags & OBJECT_SECTION
+					? object->nsections : object->nsymbols))
+			return 0;
+	}
+
+	object->source = object_get_name(reader, arena, NULL);
+	object->nlines = object_get(reader);
+	object->lines = arena_alloc(arena, object->nlines * sizeof *object->lines + 1);
+	for (i = 0; i < object->nlines && !reader->bad; i++) {
+		object->lines[i].section = object_get(reader);
+		object->lines[i].address = object_get(reader);
+		object->lines[i].line = (long)object_get(reader) << 16;
+		object->lines[i].line |= object_get(reader);
+		if (object->lines[i].section >= object->nsections)
+			return 0;
+	}
+
+	return !reader->bad && reader->position == reader->length;
+}
+
+/* NULL, having said why, if it can't be read or isn't an object */
+struct object *object_read(struct arena *arena, const char *filename, FILE *file)
+{
+	struct object_reader reader;
+	struct object *object;
+	unsigned char *buffer = NULL;
+	size_t length = 0, capacity = 0, n;
+	int ok;
+
+	do {
+		if (capacity - length < 4096) {
+			capacity = capacity ? 2 * capacity : 65536;
+			buffer = erealloc(buffer, capacity);
+		}
+		n = fread(buffer + length, 1, capacity - length, file);
+		length += n;
+	} while (n != 0);
+
+	if (ferror(file)) {
+		efprintf(stderr, "%s: can't read it\n", filename);
+		free(buffer);
+		return NULL;
+	}
+
+	object = arena_alloc(arena, sizeof *object);
+	object->filename = filename;
+	reader.bytes = buffer;
+	reader.length = length;
+	reader.position = 0;
+	reader.bad = 0;
+	ok = object_parse(object, &reader, arena);
+	free(buffer);
+
+	if (!ok) {
+		efprintf(stderr, "%s: not an object, or a damaged one\n", filename);
+		return NULL;
+	}
+	return object;
+}
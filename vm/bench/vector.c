@@ -0,0 +1,58 @@
+#define _GNU_SOURCE
+#include <math.h>
+#include <tgmath.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "types.h"
+#include "dfpu17_vector.h"
+
+/*
+ * the DFPU-17's vector kernels against the same work done an element at
+ * a time, as a job without the vector ops has to, over a whole data
+ * bank: 256 singles or 128 doubles. each result is checked against the
+ * element-at-a-time one, bit for bit, before it's timed.
+ */
+
+#define PASSES 200000
+
+static const char *const names[] = {
+	"vadd", "vsub", "vmul", "vdiv", "vfma", "vlt", "vgt", "veq", "vne",
+	"vmin", "vmax", "vmov"
+};
+
+static const char *const reduction_names[] = {"vsum", "vrmin", "vrmax", "vdot"};
+
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+static unsigned long bench_seed = 1;
+
+static double bench_random(void)
+{
+	bench_seed = (bench_seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+	return (double)(bench_seed >> 8) / (0x7fffffffUL >> 8) * 8.0 - 4.0;
+}
+
+#define W f32
+#define N 256
+#define SUFFIX(x) x##_f32
+#include "vector_width.h"
+
+#define W f64
+#define N 128
+#define SUFFIX(x) x##_f64
+#include "vector_width.h"
+
+int main(void)
+{
+	int failed = 0;
+
+	printf("%-6s %-4s %12s %12s %8s\n", "op", "type", "scalar ns/el", "vector ns/el", "speedup");
+	failed |= bench_f32();
+	failed |= bench_f64();
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+/*
+ * the benchmark for one element type. vector.c includes this once for
+ * each, having defined W, the element type; N, the elements in a bank;
+ * and SUFFIX(x), the name to give x for W.
+ */
+
+/* elements i to n one at a time, in the order the spec lays down */
+static void SUFFIX(scalar_vector)(int op, W *d, const W *a, const W *b, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		switch (op) {
+		case DFPU17_VADD: d[i] = a[i] + b[i]; break;
+		case DFPU17_VSUB: d[i] = a[i] - b[i]; break;
+		case DFPU17_VMUL: d[i] = a[i] * b[i]; break;
+		case DFPU17_VDIV: d[i] = a[i] / b[i]; break;
+		case DFPU17_VFMA: d[i] = fma(a[i], b[i], d[i]); break;
+		case DFPU17_VLT:  d[i] = a[i] < b[i] ? 1.0 : 0.0; break;
+		case DFPU17_VGT:  d[i] = a[i] > b[i] ? 1.0 : 0.0; break;
+		case DFPU17_VEQ:  d[i] = a[i] == b[i] ? 1.0 : 0.0; break;
+		case DFPU17_VNE:  d[i] = a[i] != b[i] ? 1.0 : 0.0; break;
+		case DFPU17_VMIN: d[i] = a[i] < b[i] ? a[i] : b[i]; break;
+		case DFPU17_VMAX: d[i] = a[i] > b[i] ? a[i] : b[i]; break;
+		case DFPU17_VMOV: d[i] = a[i]; break;
+		}
+	}
+}
+
+static W SUFFIX(scalar_combine)(int op, W x, W y)
+{
+	switch (op) {
+	case DFPU17_VRMIN: return x < y ? x : y;
+	case DFPU17_VRMAX: return x > y ? x : y;
+	default:           return x + y;
+	}
+}
+
+/* eight partial results, element i into i % 8, then folded in pairs */
+static W SUFFIX(scalar_reduce)(int op, const W *a, const W *b, int n)
+{
+	W lanes[8];
+	int i, j;
+
+	for (j = 0; j < 8; j++)
+		lanes[j] = op == DFPU17_VRMIN ? HUGE_VAL : op == DFPU17_VRMAX ? -HUGE_VAL : 0.0;
+	for (i = 0; i < n; i++) {
+		if (op == DFPU17_VDOT)
+			lanes[i % 8] = lanes[i % 8] + a[i] * b[i];
+		else
+			lanes[i % 8] = SUFFIX(scalar_combine)(op, lanes[i % 8], a[i]);
+	}
+	for (j = 4; j > 0; j /= 2)
+		for (i = 0; i < j; i++)
+			lanes[i] = SUFFIX(scalar_combine)(op, lanes[2 * i], lanes[2 * i + 1]);
+	return lanes[0];
+}
+
+static double SUFFIX(elapsed)(clock_t start)
+{
+	return 1e9 * (clock() - start) / CLOCKS_PER_SEC / PASSES / N;
+}
+
+static int SUFFIX(bench)(void)
+{
+	static W a[N], b[N], d[N], expected[N];
+	W sum = 0.0, r, s;
+	double scalar, vector;
+	clock_t start;
+	int op, i, failed = 0;
+
+	for (i = 0; i < N; i++) {
+		a[i] = bench_random();
+		b[i] = i % 7 == 0 ? a[i] : bench_random();
+	}
+
+	for (op = 0; op < DFPU17_VECTOR_OPS; op++) {
+		memcpy(expected, a, sizeof expected);
+		memcpy(d, a, sizeof d);
+		SUFFIX(scalar_vector)(op, expected, a, b, N);
+		SUFFIX(dfpu17_vector)(op, d, a, b, N);
+		if (memcmp(d, expected, sizeof d) != 0) {
+			printf("%-6s %-4s differs from the scalar result\n", names[op], STR(W));
+			failed = 1;
+			continue;
+		}
+
+		start = clock();
+		for (i = 0; i < PASSES; i++) {
+			SUFFIX(scalar_vector)(op, d, a, b, N);
+			sum += d[i % N];
+		}
+		scalar = SUFFIX(elapsed)(start);
+
+		start = clock();
+		for (i = 0; i < PASSES; i++) {
+			SUFFIX(dfpu17_vector)(op, d, a, b, N);
+			sum += d[i % N];
+		}
+		vector = SUFFIX(elapsed)(start);
+
+		printf("%-6s %-4s %12.3f %12.3f %7.1fx\n", names[op], STR(W), scalar, vector, scalar / vector);
+	}
+
+	for (op = 0; op < DFPU17_VECTOR_REDUCTIONS; op++) {
+		r = SUFFIX(scalar_reduce)(op, a, b, N);
+		s = SUFFIX(dfpu17_reduce)(op, a, b, N);
+		if (memcmp(&r, &s, sizeof r) != 0) {
+			printf("%-6s %-4s differs from the scalar result\n", reduction_names[op], STR(W));
+			failed = 1;
+			continue;
+		}
+
+		start = clock();
+		for (i = 0; i < PASSES; i++)
+			sum += SUFFIX(scalar_reduce)(op, a, b, N);
+		scalar = SUFFIX(elapsed)(start);
+
+		start = clock();
+		for (i = 0; i < PASSES; i++)
+			sum += SUFFIX(dfpu17_reduce)(op, a, b, N);
+		vector = SUFFIX(elapsed)(start);
+
+		printf("%-6s %-4s %12.3f %12.3f %7.1fx\n", reduction_names[op], STR(W), scalar, vector, scalar / vector);
+	}
+
+	/* so that nothing timed can be left out */
+	if (sum != sum)
+		printf("nan\n");
+	return failed;
+}
+
+#undef W
+#undef N
+#undef SUFFIX
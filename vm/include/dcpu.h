@@ -1,5 +1,38 @@
+/* the nominal clock rate of the dcpu-16 in cycles per second */
+#define DCPU_CLOCKRATE 100000
+
+/* how many interrupts can wait before the dcpu catches fire */
+#define DCPU_INTERRUPTS 256
+
 struct dcpu;
 struct hardware;
+
+/**
+ * something to happen at a cycle. devices keep their own events and
+ * schedule them with dcpu_schedule(); the dcpu fires each once its
+ * cycle count reaches at, after the instruction that gets it there, so
+ * a deadline costs nothing until it's due.
+ */
+struct dcpu_event {
+	int at;
+	void (*fire)(struct dcpu *dcpu, struct dcpu_event *event);
+	void *data;
+	struct dcpu_event *next;  /* in the dcpu's list, soonest first */
+	int pending;
+};
+
+/**
+ * what a device needs from the dcpu. only devices that tick are called
+ * after every instruction, and devices that only watch memory are called
+ * after instructions that write it; a device that needs neither, like
+ * one that's only there to be found by HWQ, costs nothing as it runs.
+ */
+enum device_caps {
+	DEVICE_TICKS = 1,       /* cycle is called after every instruction */
+	DEVICE_WATCHES = 2,     /* cycle is called with the word each write is to */
+	DEVICE_INTERRUPTS = 4   /* interrupt is called by HWI */
+};
+
 struct device {
 	u32 id;
 	u16 version;
@@ -7,6 +40,16 @@ struct device {
 	void *data;
 	void (*interrupt)(struct hardware *hardware, struct dcpu *dcpu);
 	void (*cycle)(struct hardware *hardware, u16 *dirty, struct dcpu *dcpu);
+	/* frees the device and everything it holds; NULL if there's nothing to */
+	void (*destroy)(struct device *device);
+	int caps;
+	/**
+	 * for a device that ticks, nonzero if the dcpu can skip ahead to its
+	 * next event without calling cycle in between: the device would do
+	 * nothing meanwhile that the next call can't catch up on. NULL if it
+	 * never can.
+	 */
+	int (*quiet)(struct hardware *hardware);
 };
 /**
  * represents a connection from a hardware device to a dcpu.
@@ -18,21 +61,46 @@ struct device {
 struct hardware {
 	struct device *device;
 };
-enum dcpu_quirks {
-	DCPU_QUIRKS_LEM1802_ALWAYS_ON = 1,
-	DCPU_QUIRKS_LEM1802_USE_16BIT_COLOUR = 2
-};
+struct debugmap;
 struct dcpu {
 	u16 registers[8];
 	u16 ram[65536];
 	u16 pc, sp, ex, ia;
+	u16 instruction;  /* where the one being run starts */
 	int skipping;
 	int cycles;
 	int queue_interrupts;
+
+	/* interrupts waiting to be triggered, oldest first */
+	u16 interrupts[DCPU_INTERRUPTS];
+	int first_interrupt, ninterrupts;
+
+	/* events to fire, and the cycle the soonest is due at */
+	struct dcpu_event *events;
+	int next_event;
 	u16 hw_count;
 	struct hardware *hw;
+
+	/* the devices cycle is called for: every instruction, or only writes */
+	u16 *ticking, *watching;
+	u16 nticking, nwatching;
+
 	int quirks;
+	const struct debugmap *map;  /* or NULL */
+	u32 *profile;                /* or NULL */
+
+	/* the address of the word the instruction being run wrote, if it wrote one */
+	u16 dirty;
+
+	/* where dcpu_throw() goes, and what it was given */
+	jmp_buf fault;
+	const char *fault_desc;
+	const char *fault_what;
 };
-extern const struct dcpu dcpu_init;
-extern const struct device device_init;
-#define DCPU_INIT dcpu_init
+
+/* stop the instruction being run, and the machine, for good */
+extern void dcpu_throw(struct dcpu *dcpu, const char *desc, const char *what);
+
+/* an event already scheduled is moved */
+extern void dcpu_schedule(struct dcpu *dcpu, struct dcpu_event *event, int at);
+extern void dcpu_cancel(struct dcpu *dcpu, struct dcpu_event *event);
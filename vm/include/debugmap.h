@@ -0,0 +1,11 @@
+/**
+ * a debug map written by the assembler (as -g map), for showing an
+ * address as the label it's in, an offset, and the file and line it was
+ * assembled from. labels and lines are kept sorted by address, so that
+ * each lookup is a binary search.
+ */
+struct debugmap;
+
+extern struct debugmap *debugmap_load(const char *filename);
+extern void debugmap_free(struct debugmap *map);
+extern void debugmap_print(const struct debugmap *map, FILE *file, u16 address);
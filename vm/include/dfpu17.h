@@ -1,4 +1,12 @@
+enum dfpu17_dma {
+	DFPU17_DMA_WORD,  /* one word per dcpu instruction */
+	DFPU17_DMA_BURST  /* the whole block at once, when it would finish */
+};
+
 extern void dfpu17_cycle(struct hardware *hardware, u16 *dirty, struct dcpu *dcpu);
 extern void dfpu17_interrupt(struct hardware *hardware, struct dcpu *dcpu);
 extern struct device *make_dfpu17(struct dcpu *dcpu);
+extern void dfpu17_set_dma(struct device *device, int dmamode);
+extern void dfpu17_set_worker(struct device *device);
+extern void dfpu17_set_jit(struct device *device);
 #define dfpu17_get(value, member) get_member_of(struct device_dfpu17, (value), member)
@@ -0,0 +1,241 @@
+/*
+ * the precision-dependent micro-op handlers of the DFPU-17 and the
+ * handler table they belong to. dfpu17.c includes this once for each
+ * precision, having defined:
+ *
+ *   DFPU17_T       the type of a register at this precision
+ *   DFPU17_SUFFIX  appended to the handler and table names
+ *   DFPU17_REG     the registers, viewed as DFPU17_T
+ *   DFPU17_MEM     the primary bank, viewed as DFPU17_T
+ *   DFPU17_W       the type arithmetic is done in
+ *   DFPU17_GET(x)  a register or element widened to DFPU17_W
+ *   DFPU17_PUT(x)  a DFPU17_W rounded back to DFPU17_T
+ *   DFPU17_VW      the type vector instructions are worked in, f32 or
+ *                  f64, which selects the kernels they use
+ *
+ * and, when DFPU17_T isn't DFPU17_VW, DFPU17_GET_N(d, s, n) and
+ * DFPU17_PUT_N(d, s, n) to convert a run of elements at once, and
+ * DFPU17_FMA(a, b, c) for fma on registers if fma in DFPU17_W and PUT
+ * would round twice. when DFPU17_FAST is defined the fast_ functions
+ * from fastmath.h, which work in f32, get handlers too, in a second
+ * table that covers sin to abs. all of these are undefined again at
+ * the end.
+ *
+ * loads, stores, mov and xchg copy bits and never convert.
+ */
+
+#define T   DFPU17_T
+#define REG DFPU17_REG
+#define MEM DFPU17_MEM
+#define W   DFPU17_W
+#define VW  DFPU17_VW
+#define GET DFPU17_GET
+#define PUT DFPU17_PUT
+#define A (op->a)
+#define B (op->b)
+#define C (op->c)
+#define DFPU17_PREC_OP(name) static void DFPU17_CAT(dfpu17_op_##name##_, DFPU17_SUFFIX)(struct hardware *hw, struct dcpu *dcpu, const struct dfpu17_op *op)
+#define BINOP(O) do { W r = GET(REG[A]); W s = GET(REG[B]); REG[A] = PUT(O); } while (0)
+#define UNARYOP(O) do { W a = GET(REG[A]); (void)a; REG[A] = PUT(O); } while (0)
+#define CMP(O) (!(GET(REG[A]) O GET(REG[B])))
+
+DFPU17_PREC_OP(ld)     { (void)dcpu; REG[A] = MEM[IREG[B]]; }
+DFPU17_PREC_OP(st)     { (void)dcpu; MEM[IREG[B]] = REG[A]; }
+DFPU17_PREC_OP(ldi)    { (void)dcpu; REG[A] = MEM[B]; }
+DFPU17_PREC_OP(sti)    { (void)dcpu; MEM[B] = REG[A]; }
+
+DFPU17_PREC_OP(sin)    { (void)dcpu; UNARYOP(sin(a)); }
+DFPU17_PREC_OP(cos)    { (void)dcpu; UNARYOP(cos(a)); }
+DFPU17_PREC_OP(tan)    { (void)dcpu; UNARYOP(tan(a)); }
+DFPU17_PREC_OP(asin)   { (void)dcpu; UNARYOP(asin(a)); }
+DFPU17_PREC_OP(acos)   { (void)dcpu; UNARYOP(acos(a)); }
+DFPU17_PREC_OP(atan)   { (void)dcpu; UNARYOP(atan(a)); }
+DFPU17_PREC_OP(sqrt)   { (void)dcpu; UNARYOP(sqrt(a)); }
+DFPU17_PREC_OP(rnd)    { (void)dcpu; UNARYOP(round(a)); }
+DFPU17_PREC_OP(log10)  { (void)dcpu; UNARYOP(log10(a)); }
+DFPU17_PREC_OP(log2)   { (void)dcpu; UNARYOP(log2(a)); }
+DFPU17_PREC_OP(log)    { (void)dcpu; UNARYOP(log(a)); }
+DFPU17_PREC_OP(abs)    { (void)dcpu; UNARYOP(fabs(a)); }
+
+#ifdef DFPU17_FAST
+DFPU17_PREC_OP(fsin)   { (void)dcpu; UNARYOP(fast_sin(a)); }
+DFPU17_PREC_OP(fcos)   { (void)dcpu; UNARYOP(fast_cos(a)); }
+DFPU17_PREC_OP(ftan)   { (void)dcpu; UNARYOP(fast_tan(a)); }
+DFPU17_PREC_OP(fasin)  { (void)dcpu; UNARYOP(fast_asin(a)); }
+DFPU17_PREC_OP(facos)  { (void)dcpu; UNARYOP(fast_acos(a)); }
+DFPU17_PREC_OP(fatan)  { (void)dcpu; UNARYOP(fast_atan(a)); }
+DFPU17_PREC_OP(flog10) { (void)dcpu; UNARYOP(fast_log10(a)); }
+DFPU17_PREC_OP(flog2)  { (void)dcpu; UNARYOP(fast_log2(a)); }
+DFPU17_PREC_OP(flog)   { (void)dcpu; UNARYOP(fast_log(a)); }
+#endif
+
+DFPU17_PREC_OP(ldz)    { (void)dcpu; UNARYOP(0.0); }
+DFPU17_PREC_OP(ld1)    { (void)dcpu; UNARYOP(1.0); }
+DFPU17_PREC_OP(ldpi)   { (void)dcpu; UNARYOP(M_PI); }
+DFPU17_PREC_OP(lde)    { (void)dcpu; UNARYOP(M_E); }
+DFPU17_PREC_OP(ldsr2)  { (void)dcpu; UNARYOP(sqrt(2.0)); }
+DFPU17_PREC_OP(ldphi)  { (void)dcpu; UNARYOP(1.6180339887498948482); }
+DFPU17_PREC_OP(ldl2e)  { (void)dcpu; UNARYOP(log2(M_E)); }
+DFPU17_PREC_OP(ldl2x)  { (void)dcpu; UNARYOP(log2(10.0)); }
+DFPU17_PREC_OP(ldlg2)  { (void)dcpu; UNARYOP(log10(2)); }
+DFPU17_PREC_OP(ldln2)  { (void)dcpu; UNARYOP(log(2)); }
+
+DFPU17_PREC_OP(mov)    { (void)dcpu; REG[A] = REG[B]; }
+DFPU17_PREC_OP(xchg)   { T t = REG[A]; (void)dcpu; REG[A] = REG[B]; REG[B] = t; }
+DFPU17_PREC_OP(add)    { (void)dcpu; BINOP(r + s); }
+DFPU17_PREC_OP(mul)    { (void)dcpu; BINOP(r * s); }
+DFPU17_PREC_OP(sub)    { (void)dcpu; BINOP(r - s); }
+DFPU17_PREC_OP(rsub)   { (void)dcpu; BINOP(s - r); }
+DFPU17_PREC_OP(div)    { (void)dcpu; BINOP(r / s); }
+DFPU17_PREC_OP(rdiv)   { (void)dcpu; BINOP(s / r); }
+
+DFPU17_PREC_OP(lt)     { (void)dcpu; IREG[C] = CMP(<); }
+DFPU17_PREC_OP(gt)     { (void)dcpu; IREG[C] = CMP(>); }
+DFPU17_PREC_OP(eq)     { (void)dcpu; IREG[C] = CMP(==); }
+DFPU17_PREC_OP(ne)     { (void)dcpu; IREG[C] = CMP(!=); }
+DFPU17_PREC_OP(atan2)  { (void)dcpu; REG[A] = PUT(atan2(GET(REG[B]), GET(REG[C]))); }
+#ifdef DFPU17_FMA
+DFPU17_PREC_OP(fma)    { (void)dcpu; REG[A] = DFPU17_FMA(REG[A], REG[B], REG[C]); }
+#else
+DFPU17_PREC_OP(fma)    { (void)dcpu; REG[A] = PUT(fma(GET(REG[A]), GET(REG[B]), GET(REG[C]))); }
+#endif
+
+#define VCOUNT  ((int)(sizeof MEM / sizeof *MEM))
+#define VLENGTH (VLEN < VCOUNT ? VLEN : VCOUNT)
+
+/**
+ * the elements of a vector start at base and go up by the stride,
+ * wrapping round the bank. unless they're contiguous and already of
+ * the working type they are gathered into scratch.
+ */
+static VW *DFPU17_CAT(dfpu17_vgather_, DFPU17_SUFFIX)(struct hardware *hw, int base, VW *scratch)
+{
+	T *mem = MEM;
+	int i, n = VLENGTH;
+
+	if (VSTRIDE == 1 && base + n <= VCOUNT) {
+#ifdef DFPU17_GET_N
+		DFPU17_GET_N(scratch, mem + base, n);
+		return scratch;
+#else
+		return (VW *)(mem + base);
+#endif
+	}
+
+	for (i = 0; i < n; i++)
+		scratch[i] = GET(mem[(base + i * VSTRIDE) % VCOUNT]);
+	return scratch;
+}
+
+static void DFPU17_CAT(dfpu17_vscatter_, DFPU17_SUFFIX)(struct hardware *hw, int base, const VW *v)
+{
+	T *mem = MEM;
+	int i, n = VLENGTH;
+
+	if (VSTRIDE == 1 && base + n <= VCOUNT) {
+#ifdef DFPU17_PUT_N
+		DFPU17_PUT_N(mem + base, v, n);
+#endif
+		return;
+	}
+
+	for (i = 0; i < n; i++)
+		mem[(base + i * VSTRIDE) % VCOUNT] = PUT(v[i]);
+}
+
+#define VGATHER(base, scratch) DFPU17_CAT(dfpu17_vgather_, DFPU17_SUFFIX)(hw, (base), (scratch))
+#define VSCATTER(base, v) DFPU17_CAT(dfpu17_vscatter_, DFPU17_SUFFIX)(hw, (base), (v))
+#define VECTOR DFPU17_CAT(dfpu17_vector_, DFPU17_VW)
+#define REDUCE DFPU17_CAT(dfpu17_reduce_, DFPU17_VW)
+
+DFPU17_PREC_OP(varith)
+{
+	VW ds[256], as[256], bs[256];
+	VW *d = VGATHER(IREG[A], ds);
+
+	(void)dcpu;
+	VECTOR(op->vop, d, VGATHER(IREG[B], as), VGATHER(IREG[C], bs), VLENGTH);
+	VSCATTER(IREG[A], d);
+}
+
+DFPU17_PREC_OP(vscalar)
+{
+	VW ds[256], bs[256];
+	VW *d = VGATHER(IREG[A], ds);
+	int i, n = VLENGTH;
+
+	(void)dcpu;
+	for (i = 0; i < n; i++)
+		bs[i] = GET(REG[B]);
+	VECTOR(op->vop, d, op->vop == DFPU17_VMOV ? bs : d, bs, n);
+	VSCATTER(IREG[A], d);
+}
+
+DFPU17_PREC_OP(vreduce)
+{
+	VW as[256];
+	VW *a = VGATHER(IREG[B], as);
+
+	(void)dcpu;
+	REG[A] = PUT(REDUCE(op->vop, a, a, VLENGTH));
+}
+
+DFPU17_PREC_OP(vdot)
+{
+	VW as[256], bs[256];
+
+	(void)dcpu;
+	REG[A] = PUT(REDUCE(DFPU17_VDOT, VGATHER(IREG[B], as), VGATHER(IREG[C], bs), VLENGTH));
+}
+
+#undef REDUCE
+#undef VECTOR
+#undef VSCATTER
+#undef VGATHER
+#undef VLENGTH
+#undef VCOUNT
+
+#define X(kind, name) &dfpu17_op_##name,
+#define P(kind, name) &DFPU17_CAT(dfpu17_op_##name##_, DFPU17_SUFFIX),
+static dfpu17_handler *const DFPU17_CAT(dfpu17_handlers_, DFPU17_SUFFIX)[OP_COUNT] = {
+	DFPU17_OPS
+};
+#undef P
+#undef X
+
+#ifdef DFPU17_FAST
+#define F(name) &DFPU17_CAT(dfpu17_op_##name##_, DFPU17_SUFFIX),
+static dfpu17_handler *const DFPU17_CAT(dfpu17_fast_handlers_, DFPU17_SUFFIX)[OP_ABS - OP_SIN + 1] = {
+	F(fsin) F(fcos) F(ftan) F(fasin) F(facos) F(fatan) F(sqrt) F(rnd)
+	F(flog10) F(flog2) F(flog) F(abs)
+};
+#undef F
+#endif
+
+#undef CMP
+#undef UNARYOP
+#undef BINOP
+#undef DFPU17_PREC_OP
+#undef C
+#undef B
+#undef A
+#undef PUT
+#undef GET
+#undef VW
+#undef W
+#undef MEM
+#undef REG
+#undef T
+
+#undef DFPU17_FAST
+#undef DFPU17_FMA
+#undef DFPU17_PUT_N
+#undef DFPU17_GET_N
+#undef DFPU17_VW
+#undef DFPU17_PUT
+#undef DFPU17_GET
+#undef DFPU17_W
+#undef DFPU17_MEM
+#undef DFPU17_REG
+#undef DFPU17_SUFFIX
+#undef DFPU17_T
@@ -0,0 +1,35 @@
+/**
+ * the arithmetic behind the DFPU-17's vector instructions, on
+ * contiguous arrays of n elements. the elementwise operations use
+ * SSE or AVX where the host has them; every path gives bit-identical
+ * results, reductions included, as they all combine the elements in
+ * the order the spec lays down.
+ */
+enum dfpu17_vector_op {
+	DFPU17_VADD,  /* d = a + b */
+	DFPU17_VSUB,  /* d = a - b */
+	DFPU17_VMUL,  /* d = a * b */
+	DFPU17_VDIV,  /* d = a / b */
+	DFPU17_VFMA,  /* d = d + a * b, fused */
+	DFPU17_VLT,   /* d = a < b ? 1.0 : 0.0 */
+	DFPU17_VGT,   /* d = a > b ? 1.0 : 0.0 */
+	DFPU17_VEQ,   /* d = a == b ? 1.0 : 0.0 */
+	DFPU17_VNE,   /* d = a != b ? 1.0 : 0.0 */
+	DFPU17_VMIN,  /* d = a < b ? a : b */
+	DFPU17_VMAX,  /* d = a > b ? a : b */
+	DFPU17_VMOV,  /* d = a */
+	DFPU17_VECTOR_OPS
+};
+
+enum dfpu17_vector_reduction {
+	DFPU17_VSUM,   /* a[0] + a[1] + ... */
+	DFPU17_VRMIN,  /* the least of a, as by DFPU17_VMIN */
+	DFPU17_VRMAX,  /* the greatest of a, as by DFPU17_VMAX */
+	DFPU17_VDOT,   /* a[0] * b[0] + a[1] * b[1] + ... */
+	DFPU17_VECTOR_REDUCTIONS
+};
+
+extern void dfpu17_vector_f32(int op, f32 *d, const f32 *a, const f32 *b, int n);
+extern void dfpu17_vector_f64(int op, f64 *d, const f64 *a, const f64 *b, int n);
+extern f32 dfpu17_reduce_f32(int op, const f32 *a, const f32 *b, int n);
+extern f64 dfpu17_reduce_f64(int op, const f64 *a, const f64 *b, int n);
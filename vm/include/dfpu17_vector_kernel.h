@@ -0,0 +1,213 @@
+/*
+ * the DFPU-17 vector kernels for one element type and instruction
+ * set. dfpu17_vector.c includes this once for each, having defined:
+ *
+ *   KERNEL_W         the element type
+ *   KERNEL_NAME(x)   the name to give the function x
+ *   KERNEL_SCALAR(x) the name of the scalar function x for KERNEL_W
+ *
+ * and, for anything but the scalar code itself:
+ *
+ *   KERNEL_TARGET    the target attribute the functions need, if any
+ *   KERNEL_V         the vector type
+ *   KERNEL_LANES     the number of elements in a KERNEL_V
+ *   KERNEL_LOADU, _STOREU, _SET1, _ADD, _SUB, _MUL, _DIV, _MIN, _MAX,
+ *   _AND, and _LT, _GT, _EQ, _NE giving all-ones lanes where they hold
+ *   KERNEL_ZEROUPPER (optional) run before handing over to the scalar
+ *                    code, which is compiled for SSE: on some hosts every
+ *                    SSE instruction after an AVX one with the upper
+ *                    halves dirty pays for the switch
+ *   KERNEL_FMADD     (optional) a fused x * y + z. a set with it is only
+ *                    for DFPU17_VFMA and has no reduction: DFPU17_VDOT
+ *                    rounds each product before adding it, so fusing
+ *                    would change its results
+ *
+ * the SIMD code leaves the tail that doesn't fill a vector to the
+ * scalar code, and reductions keep their DFPU17_REDUCE_LANES partial
+ * results in the same lanes as the scalar code does, so the results
+ * don't depend on which of them ran.
+ */
+
+#define W KERNEL_W
+
+#ifndef KERNEL_ZEROUPPER
+#define KERNEL_ZEROUPPER()
+#endif
+
+#ifndef KERNEL_V
+
+static W KERNEL_SCALAR(identity)(int op)
+{
+	switch (op) {
+	case DFPU17_VRMIN: return HUGE_VAL;
+	case DFPU17_VRMAX: return -HUGE_VAL;
+	default:           return 0.0;
+	}
+}
+
+static W KERNEL_SCALAR(combine)(int op, W x, W y)
+{
+	switch (op) {
+	case DFPU17_VRMIN: return x < y ? x : y;
+	case DFPU17_VRMAX: return x > y ? x : y;
+	default:           return x + y;
+	}
+}
+
+/* elements i to n */
+static void KERNEL_SCALAR(vector)(int op, W *d, const W *a, const W *b, int i, int n)
+{
+	for (; i < n; i++) {
+		switch (op) {
+		case DFPU17_VADD: d[i] = a[i] + b[i]; break;
+		case DFPU17_VSUB: d[i] = a[i] - b[i]; break;
+		case DFPU17_VMUL: d[i] = a[i] * b[i]; break;
+		case DFPU17_VDIV: d[i] = a[i] / b[i]; break;
+		case DFPU17_VFMA: d[i] = fma(a[i], b[i], d[i]); break;
+		case DFPU17_VLT:  d[i] = a[i] < b[i] ? 1.0 : 0.0; break;
+		case DFPU17_VGT:  d[i] = a[i] > b[i] ? 1.0 : 0.0; break;
+		case DFPU17_VEQ:  d[i] = a[i] == b[i] ? 1.0 : 0.0; break;
+		case DFPU17_VNE:  d[i] = a[i] != b[i] ? 1.0 : 0.0; break;
+		case DFPU17_VMIN: d[i] = a[i] < b[i] ? a[i] : b[i]; break;
+		case DFPU17_VMAX: d[i] = a[i] > b[i] ? a[i] : b[i]; break;
+		case DFPU17_VMOV: d[i] = a[i]; break;
+		}
+	}
+}
+
+/* fold elements i to n into the partial results, then combine those */
+static W KERNEL_SCALAR(reduce)(int op, W lanes[DFPU17_REDUCE_LANES], const W *a, const W *b, int i, int n)
+{
+	int j;
+
+	for (; i < n; i++) {
+		j = i % DFPU17_REDUCE_LANES;
+		if (op == DFPU17_VDOT)
+			lanes[j] = lanes[j] + a[i] * b[i];
+		else
+			lanes[j] = KERNEL_SCALAR(combine)(op, lanes[j], a[i]);
+	}
+
+	for (j = DFPU17_REDUCE_LANES / 2; j > 0; j /= 2) {
+		for (i = 0; i < j; i++)
+			lanes[i] = KERNEL_SCALAR(combine)(op, lanes[2 * i], lanes[2 * i + 1]);
+	}
+
+	return lanes[0];
+}
+
+#else
+
+#define V KERNEL_V
+#define ACCS (DFPU17_REDUCE_LANES / KERNEL_LANES)
+
+KERNEL_TARGET static void KERNEL_NAME(vector)(int op, W *d, const W *a, const W *b, int n)
+{
+	V one = KERNEL_SET1(1.0);
+	V x, y;
+	int i = 0;
+
+	if (op == DFPU17_VFMA) {
+#ifdef KERNEL_FMADD
+		for (; i + KERNEL_LANES <= n; i += KERNEL_LANES) {
+			x = KERNEL_FMADD(KERNEL_LOADU(a + i), KERNEL_LOADU(b + i), KERNEL_LOADU(d + i));
+			KERNEL_STOREU(d + i, x);
+		}
+#endif
+		KERNEL_ZEROUPPER();
+		KERNEL_SCALAR(vector)(op, d, a, b, i, n);
+		return;
+	}
+
+	for (; i + KERNEL_LANES <= n; i += KERNEL_LANES) {
+		x = KERNEL_LOADU(a + i);
+		y = KERNEL_LOADU(b + i);
+		switch (op) {
+		case DFPU17_VADD: x = KERNEL_ADD(x, y); break;
+		case DFPU17_VSUB: x = KERNEL_SUB(x, y); break;
+		case DFPU17_VMUL: x = KERNEL_MUL(x, y); break;
+		case DFPU17_VDIV: x = KERNEL_DIV(x, y); break;
+		case DFPU17_VLT:  x = KERNEL_AND(KERNEL_LT(x, y), one); break;
+		case DFPU17_VGT:  x = KERNEL_AND(KERNEL_GT(x, y), one); break;
+		case DFPU17_VEQ:  x = KERNEL_AND(KERNEL_EQ(x, y), one); break;
+		case DFPU17_VNE:  x = KERNEL_AND(KERNEL_NE(x, y), one); break;
+		case DFPU17_VMIN: x = KERNEL_MIN(x, y); break;
+		case DFPU17_VMAX: x = KERNEL_MAX(x, y); break;
+		default: break;
+		}
+		KERNEL_STOREU(d + i, x);
+	}
+
+	KERNEL_ZEROUPPER();
+	KERNEL_SCALAR(vector)(op, d, a, b, i, n);
+}
+
+#ifndef KERNEL_FMADD
+KERNEL_TARGET static W KERNEL_NAME(reduce)(int op, const W *a, const W *b, int n)
+{
+	V acc[ACCS];
+	V x;
+	W lanes[DFPU17_REDUCE_LANES];
+	int i, j;
+
+	for (j = 0; j < ACCS; j++)
+		acc[j] = KERNEL_SET1(KERNEL_SCALAR(identity)(op));
+
+	for (i = 0; i + DFPU17_REDUCE_LANES <= n; i += DFPU17_REDUCE_LANES) {
+		for (j = 0; j < ACCS; j++) {
+			x = KERNEL_LOADU(a + i + j * KERNEL_LANES);
+			switch (op) {
+			case DFPU17_VRMIN:
+				acc[j] = KERNEL_MIN(acc[j], x);
+				break;
+			case DFPU17_VRMAX:
+				acc[j] = KERNEL_MAX(acc[j], x);
+				break;
+			case DFPU17_VDOT:
+				x = KERNEL_MUL(x, KERNEL_LOADU(b + i + j * KERNEL_LANES));
+				acc[j] = KERNEL_ADD(acc[j], x);
+				break;
+			default:
+				acc[j] = KERNEL_ADD(acc[j], x);
+				break;
+			}
+		}
+	}
+
+	for (j = 0; j < ACCS; j++)
+		KERNEL_STOREU(lanes + j * KERNEL_LANES, acc[j]);
+
+	KERNEL_ZEROUPPER();
+	return KERNEL_SCALAR(reduce)(op, lanes, a, b, i, n);
+}
+#endif
+
+#undef ACCS
+#undef V
+
+#endif
+
+#undef W
+
+#undef KERNEL_W
+#undef KERNEL_NAME
+#undef KERNEL_SCALAR
+#undef KERNEL_TARGET
+#undef KERNEL_V
+#undef KERNEL_LANES
+#undef KERNEL_LOADU
+#undef KERNEL_STOREU
+#undef KERNEL_SET1
+#undef KERNEL_ADD
+#undef KERNEL_SUB
+#undef KERNEL_MUL
+#undef KERNEL_DIV
+#undef KERNEL_MIN
+#undef KERNEL_MAX
+#undef KERNEL_AND
+#undef KERNEL_LT
+#undef KERNEL_GT
+#undef KERNEL_EQ
+#undef KERNEL_NE
+#undef KERNEL_FMADD
+#undef KERNEL_ZEROUPPER
@@ -0,0 +1,18 @@
+/**
+ * approximations to the transcendental functions for f32 arguments,
+ * used by the DFPU-17's fast accuracy mode in place of libm. they are
+ * worked in f64 from a short range reduction and a small polynomial or
+ * table, and stay under one ulp from the true result over the whole
+ * f32 range; docs/dfpu17.txt has the measured bounds. special
+ * arguments give the same infinities and NaNs as libm, and raise the
+ * same invalid and divide-by-zero exceptions.
+ */
+extern f32 fast_sin(f32 x);
+extern f32 fast_cos(f32 x);
+extern f32 fast_tan(f32 x);
+extern f32 fast_asin(f32 x);
+extern f32 fast_acos(f32 x);
+extern f32 fast_atan(f32 x);
+extern f32 fast_log(f32 x);
+extern f32 fast_log2(f32 x);
+extern f32 fast_log10(f32 x);
@@ -0,0 +1,8 @@
+/**
+ * the generic clock: ticks at 60/B per second, counted by cycles and
+ * not by the wall clock, with an interrupt each tick if one's been set.
+ * it neither ticks nor watches memory; each tick is an event the dcpu
+ * fires when the cycle comes, so a program waiting on it can be passed
+ * over until then.
+ */
+extern struct device *make_genclock(struct dcpu *dcpu);
@@ -0,0 +1,21 @@
+/**
+ * conversions between binary16 (f16, kept as its bit pattern) and f32.
+ * narrowing rounds to nearest, ties to even, overflowing to infinity;
+ * NaNs stay NaNs, quietened. F16C is used when the host has it, and
+ * gives the same results as the software conversions.
+ */
+extern f32 f16_to_f32(f16 h);
+extern f16 f32_to_f16(f32 f);
+extern void f16_to_f32_n(f32 *out, const f16 *in, int n);
+extern void f32_to_f16_n(f16 *out, const f32 *in, int n);
+
+/**
+ * a double, and a * b + c, each rounded to binary16 once, so that
+ * arithmetic worked in double gives what binary16 itself would.
+ */
+extern f16 f64_to_f16(f64 d);
+extern f16 f16_fma(f16 a, f16 b, f16 c);
+
+/* the software conversions, whatever the host has, to test the others against */
+extern f32 f16_to_f32_soft(f16 h);
+extern f16 f32_to_f16_soft(f32 f);
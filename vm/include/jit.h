@@ -0,0 +1,23 @@
+/**
+ * a buffer of generated machine code. it is writable while code is
+ * being emitted into it and executable once sealed, never both.
+ */
+struct jit {
+	u8 *code;
+	size_t len;
+	size_t cap;
+};
+
+extern struct jit *jit_alloc(size_t cap);
+extern void jit_free(struct jit *jit);
+
+/* empty the buffer and make it writable, to emit new code into */
+extern void jit_reset(struct jit *jit);
+/* make the code executable, returning its address */
+extern void *jit_seal(struct jit *jit);
+
+extern void jit_emit(struct jit *jit, int n, ...);
+extern void jit_emit_u32(struct jit *jit, u32 x);
+extern void jit_emit_u64(struct jit *jit, u64 x);
+/* overwrite four bytes already emitted, to patch a displacement */
+extern void jit_patch_u32(struct jit *jit, size_t at, u32 x);
@@ -1,3 +1,32 @@
+struct farbfeld_pixel {
+	u8 r, g, b;
+};
+
+struct farbfeld_data {
+	u32 width;
+	u32 height;
+	struct farbfeld_pixel pixels[1];
+};
+
+#define LEM1802_FF_CELLWIDTH 4
+#define LEM1802_FF_CELLHEIGHT 8
+#define LEM1802_FF_ROWS 12
+#define LEM1802_FF_COLS 32
+#define LEM1802_FF_BORDERWIDTH 1
+#define LEM1802_FF_PIXWIDTH (LEM1802_FF_CELLWIDTH * LEM1802_FF_COLS + 2 * LEM1802_FF_BORDERWIDTH)
+#define LEM1802_FF_PIXHEIGHT (LEM1802_FF_CELLHEIGHT * LEM1802_FF_ROWS + 2 * LEM1802_FF_BORDERWIDTH)
+#define LEM1802_FF_PIXSIZE (sizeof(struct farbfeld_pixel) * LEM1802_FF_PIXWIDTH * LEM1802_FF_PIXHEIGHT)
+#define LEM1802_FF_SIZE (sizeof(struct farbfeld_data) + LEM1802_FF_PIXSIZE)
+
 extern void lem1802_cycle(struct hardware *hardware, u16 *dirty, struct dcpu *dcpu);
 extern void lem1802_interrupt(struct hardware *hardware, struct dcpu *dcpu);
 extern struct device *make_lem1802(struct dcpu *dcpu);
+extern void lem1802_set_framerate(struct device *device, int framerate);
+extern void lem1802_set_window(struct device *device, int show_window);
+extern void lem1802_set_capture(struct device *device, const char *filename);
+extern void lem1802_set_terminal(struct device *device, int fd, int colours);
+extern void lem1802_close(struct device *device);
+extern void lem1802_fwrite(FILE *f, const struct farbfeld_data *ffdat);
+extern void lem1802_write(const char *filename, struct farbfeld_data *ffdat);
+extern void lem1802_palette(int use_16bit_colour, const u16 palette[16], struct farbfeld_pixel colours[16]);
+extern void lem1802_draw(const struct farbfeld_pixel colours[16], struct farbfeld_pixel *pixels, const u16 vram[384], const u16 font[256], u8 bordercol, int cycle);
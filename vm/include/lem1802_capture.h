@@ -0,0 +1,25 @@
+/**
+ * a lem1802 capture stream is a sequence of frames sampled at a fixed
+ * interval of emulated cycles. each frame is either a keyframe (the
+ * complete device state followed by the rendered frame as a farbfeld
+ * image) or a delta (the vram cells that changed since the previous
+ * frame, plus the font, palette and border colour if they changed).
+ */
+struct lem1802_capture;
+
+enum lem1802_capture_flags {
+	LEM1802_CAPTURE_16BIT_COLOUR = 1,
+	LEM1802_CAPTURE_BLINK = 2
+};
+
+enum lem1802_capture_format {
+	LEM1802_CAPTURE_Y4M,
+	LEM1802_CAPTURE_FARBFELD
+};
+
+extern struct lem1802_capture *lem1802_capture_open(const char *filename, int cycles_per_frame);
+extern void lem1802_capture_close(struct lem1802_capture *capture);
+extern int  lem1802_capture_due(struct lem1802_capture *capture, int cycles);
+extern void lem1802_capture_resync(struct lem1802_capture *capture, int cycles);
+extern void lem1802_capture_frame(struct lem1802_capture *capture, int cycles, const u16 vram[384], const u16 font[256], const u16 palette[16], u8 bordercol, int flags, const struct farbfeld_data *ffdat);
+extern int  lem1802_capture_convert(const char *input, const char *output, enum lem1802_capture_format format);
@@ -0,0 +1,15 @@
+/**
+ * draws the lem1802 on an ansi terminal, one character cell per vram
+ * cell, surrounded by a one-cell border. only the cells that changed
+ * since the last frame are written.
+ */
+struct lem1802_terminal;
+
+enum lem1802_terminal_colours {
+	LEM1802_TERMINAL_256COLOUR,
+	LEM1802_TERMINAL_TRUECOLOUR
+};
+
+extern struct lem1802_terminal *lem1802_terminal_open(int fd, enum lem1802_terminal_colours colours);
+extern void lem1802_terminal_close(struct lem1802_terminal *terminal);
+extern void lem1802_terminal_present(struct lem1802_terminal *terminal, const u16 vram[384], const u16 font[256], const struct farbfeld_pixel colours[16], u8 bordercol, int cycle);
@@ -0,0 +1,74 @@
+/**
+ * libdcpu: dcpu-16s to embed in another program. each machine is a
+ * struct dcpu of its own, with its own memory, devices and faults, so
+ * any number can be run in one process, each on one thread at a time.
+ *
+ * a machine stops when the program faults -- an invalid instruction,
+ * say -- and dcpu_fault() says why; until then dcpu_step() and
+ * dcpu_run() carry on from where the last call left off.
+ *
+ * dcpu_run() passes over an instruction that only jumps to itself, the
+ * usual way to wait for an interrupt, in one go: straight to whichever
+ * comes first of the next thing a device has scheduled and the end of
+ * the run, with the cycles counted as if it had been run each time.
+ *
+ * the caller includes stddef.h, stdint.h and stdio.h first.
+ */
+struct dcpu;
+struct device;
+struct debugmap;
+
+enum dcpu_quirks {
+	DCPU_QUIRKS_LEM1802_ALWAYS_ON = 1,
+	DCPU_QUIRKS_LEM1802_USE_16BIT_COLOUR = 2
+};
+
+enum dcpu_register {
+	DCPU_A, DCPU_B, DCPU_C, DCPU_X, DCPU_Y, DCPU_Z, DCPU_I, DCPU_J,
+	DCPU_PC, DCPU_SP, DCPU_EX, DCPU_IA
+};
+
+extern struct dcpu *dcpu_create(int quirks);
+/* the devices attached go too */
+extern void dcpu_destroy(struct dcpu *dcpu);
+
+extern void dcpu_load(struct dcpu *dcpu, uint16_t address, const uint16_t *words, size_t n);
+/**
+ * an image the linker made (as -o x.img16), which sets pc to its entry
+ * point, or else a flat big-endian .bin loaded at 0. nonzero, having
+ * said why, if it can't be loaded.
+ */
+extern int dcpu_load_file(struct dcpu *dcpu, const char *filename);
+
+/* devices are numbered in the order they're attached */
+extern void dcpu_attach(struct dcpu *dcpu, struct device *device);
+/* one of the kinds the registry knows, made and attached; NULL if there's no such kind */
+extern struct device *dcpu_attach_named(struct dcpu *dcpu, const char *name);
+
+/* one instruction; nonzero if the machine has faulted */
+extern int dcpu_step(struct dcpu *dcpu);
+/* instructions until at least cycles have passed or it faults; the cycles that did */
+extern long dcpu_run(struct dcpu *dcpu, long cycles);
+extern long dcpu_cycles(const struct dcpu *dcpu);
+/* NULL while it runs; once it faults, where, and what in *what if that's not NULL */
+extern const char *dcpu_fault(const struct dcpu *dcpu, const char **what);
+
+/**
+ * an interrupt, queued as one from hardware would be and triggered
+ * before an instruction once the program lets it. more than 256 waiting
+ * sets the dcpu on fire, which is a fault.
+ */
+extern void dcpu_interrupt(struct dcpu *dcpu, uint16_t message);
+
+/* memory wraps around at 0x10000, as it does for the program */
+extern void dcpu_read(const struct dcpu *dcpu, uint16_t address, uint16_t *words, size_t n);
+extern void dcpu_write(struct dcpu *dcpu, uint16_t address, const uint16_t *words, size_t n);
+extern uint16_t dcpu_register(const struct dcpu *dcpu, enum dcpu_register r);
+extern void dcpu_set_register(struct dcpu *dcpu, enum dcpu_register r, uint16_t value);
+
+/* the registers, and where it is if there's a map, as BREAK shows them */
+extern void dcpu_dump(const struct dcpu *dcpu, FILE *file);
+/* a debug map, to show addresses with; NULL for none */
+extern void dcpu_set_map(struct dcpu *dcpu, const struct debugmap *map);
+/* 65536 counters the cycles spent at each address are added to; NULL to stop */
+extern void dcpu_set_profile(struct dcpu *dcpu, uint32_t *counts);
@@ -0,0 +1,20 @@
+/**
+ * the devices a dcpu can be given by name, which is how the front end's
+ * -d list is made into hardware. a kind without a make function is only
+ * there to be identified: it has an id and nothing else, and costs
+ * nothing while the dcpu runs.
+ */
+struct registry_entry {
+	const char *name;
+
+	/* what HWQ says about a kind that's only identified */
+	u32 id;
+	u16 version;
+	u32 manufacturer;
+	struct device *(*make)(struct dcpu *dcpu);  /* or NULL */
+};
+
+extern const struct registry_entry registry[];
+
+extern const struct registry_entry *registry_lookup(const char *name);
+extern struct device *registry_make(const struct registry_entry *entry, struct dcpu *dcpu);
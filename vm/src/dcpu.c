@@ -1,46 +1,29 @@
-#define _DEFAULT_SOURCE
-
-#include <unistd.h>
-#include <arpa/inet.h>
-#include <errno.h>
+#include <limits.h>
 #include <setjmp.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
-#include <time.h>
 
 #include "types.h"
 #include "utils.h"
-#include "exception.h"
 #include "dcpu.h"
-#include "lem1802.h"
-#include "dfpu17.h"
-
-const struct dcpu dcpu_init = {0};
+#include "libdcpu.h"
+#include "debugmap.h"
 
-u16 *DIRTY(u16 d)
-{
-	u16 *p = emalloc(sizeof *p);
-	*p = d;
-	return p;
-}
-
-void noop_interrupt(struct hardware *hw, struct dcpu *dcpu)
-{
-	(void)hw;
-	(void)dcpu;
-}
+/* the word at d is about to be written; devices are told which once it has */
+#define DIRTY(d) (dcpu->dirty = (d), &dcpu->dirty)
 
-void noop_cycle(struct hardware *hw, u16 *dirty, struct dcpu *dcpu)
+void dcpu_throw(struct dcpu *dcpu, const char *desc, const char *what)
 {
-	(void)hw;
-	(void)dirty;
-	(void)dcpu;
+	dcpu->fault_desc = desc;
+	dcpu->fault_what = what;
+	longjmp(dcpu->fault, 1);
 }
 
-struct hardware *nth_hardware(struct dcpu *dcpu, u16 n)
+static struct hardware *nth_hardware(struct dcpu *dcpu, u16 n)
 {
 	if (n >= dcpu->hw_count)
 		return NULL;
@@ -93,7 +76,7 @@ static u16 *decode_b(struct dcpu *dcpu, u16 b, u16 **dirty)
 			*dirty = NULL;
 			return &NEXTWORD;
 		default:
-			throw("decode_b", "out of range");
+			dcpu_throw(dcpu, "decode_b", "out of range");
 	}
 	#undef NEXTWORD
 
@@ -112,7 +95,7 @@ static u16 const *decode_b_nomut(struct dcpu *dcpu, u16 b)
 static u16 decode_a(struct dcpu *dcpu, u16 a)
 {
 	u16 *dirty_unused;
-	if (a >= 0x40) throw("decode_a", "too large");
+	if (a >= 0x40) dcpu_throw(dcpu, "decode_a", "too large");
 	if (a == 0x18) return dcpu->ram[dcpu->sp++];
 	if (a < 0x20) return *decode_b(dcpu, a, &dirty_unused);
 
@@ -127,19 +110,98 @@ static u16 decode_a_nomut(struct dcpu *dcpu, u16 a)
 	return decode_a(dcpu, a);
 }
 
-static u16 interrupt(struct dcpu *dcpu, u16 message)
+void dcpu_interrupt(struct dcpu *dcpu, uint16_t message)
 {
-	(void)dcpu;
-	(void)message;
-	throw("interrupt", "not yet implemented");
+	/* the fire itself is started before the next instruction */
+	if (dcpu->ninterrupts++ < DCPU_INTERRUPTS)
+		dcpu->interrupts[(dcpu->first_interrupt + dcpu->ninterrupts - 1) % DCPU_INTERRUPTS] = message;
+}
 
-	/* if we get here, throw is broken */
-	abort();
+/* trigger the oldest interrupt waiting, if the program will have it now */
+static void trigger(struct dcpu *dcpu)
+{
+	u16 message;
+
+	if (dcpu->ninterrupts > DCPU_INTERRUPTS)
+		dcpu_throw(dcpu, "interrupt", "too many queued, and the dcpu caught fire");
+	if (dcpu->queue_interrupts || dcpu->skipping)
+		return;
+
+	message = dcpu->interrupts[dcpu->first_interrupt];
+	dcpu->first_interrupt = (dcpu->first_interrupt + 1) % DCPU_INTERRUPTS;
+	dcpu->ninterrupts--;
+
+	/* with no handler, it does nothing */
+	if (dcpu->ia == 0)
+		return;
+
+	dcpu->queue_interrupts = true;
+	dcpu->ram[--dcpu->sp] = dcpu->pc;
+	dcpu->ram[--dcpu->sp] = dcpu->registers[0];
+	dcpu->pc = dcpu->ia;
+	dcpu->registers[0] = message;
+}
+
+void dcpu_schedule(struct dcpu *dcpu, struct dcpu_event *event, int at)
+{
+	struct dcpu_event **p;
+
+	dcpu_cancel(dcpu, event);
+	for (p = &dcpu->events; *p != NULL && (*p)->at <= at; p = &(*p)->next)
+		;
+	event->at = at;
+	event->next = *p;
+	event->pending = 1;
+	*p = event;
+	dcpu->next_event = dcpu->events->at;
+}
+
+void dcpu_cancel(struct dcpu *dcpu, struct dcpu_event *event)
+{
+	struct dcpu_event **p;
+
+	if (!event->pending)
+		return;
+	for (p = &dcpu->events; *p != event; p = &(*p)->next)
+		;
+	*p = event->next;
+	event->pending = 0;
+	dcpu->next_event = dcpu->events != NULL ? dcpu->events->at : INT_MAX;
+}
+
+/* every event that's due, soonest first; one can schedule another */
+static void fire_events(struct dcpu *dcpu)
+{
+	struct dcpu_event *event;
+
+	while ((event = dcpu->events) != NULL && event->at <= dcpu->cycles) {
+		dcpu_cancel(dcpu, event);
+		event->fire(dcpu, event);
+	}
+}
+
+void dcpu_dump(const struct dcpu *dcpu, FILE *file)
+{
+	fprintf(file, " A:0x%04x  B:0x%04x  C:0x%04x  I:0x%04x\n",
+		dcpu->registers[0], dcpu->registers[1],
+		dcpu->registers[2], dcpu->registers[6]);
+	fprintf(file, " X:0x%04x  Y:0x%04x  Z:0x%04x  J:0x%04x\n",
+		dcpu->registers[3], dcpu->registers[4],
+		dcpu->registers[5], dcpu->registers[7]);
+	fprintf(file, "PC:0x%04x SP:0x%04x EX:0x%04x IA:0x%04x\n",
+		dcpu->pc, dcpu->sp, dcpu->ex, dcpu->ia);
+
+	/* where the instruction being run came from */
+	if (dcpu->map != NULL) {
+		fprintf(file, "at 0x%04x", dcpu->instruction);
+		debugmap_print(dcpu->map, file, dcpu->instruction);
+		fputc('\n', file);
+	}
 }
 
 static u16 *instr_cycle(struct dcpu *dcpu)
 {
-	u16 instruction = dcpu->ram[dcpu->pc++];
+	u16 instruction = dcpu->ram[dcpu->instruction = dcpu->pc++];
 	u16 opcode = instruction & 0x001f;
 	u16 enc_b = (instruction & 0x03e0) >> 5;
 	u16 enc_a = (instruction & 0xfc00) >> 10;
@@ -185,14 +247,7 @@ static u16 *instr_cycle(struct dcpu *dcpu)
 		switch (enc_b) {
 		case 0x00:
 			/* BREAK */
-			fprintf(stderr, " A:0x%04x  B:0x%04x  C:0x%04x  I:0x%04x\n",
-				dcpu->registers[0], dcpu->registers[1],
-				dcpu->registers[2], dcpu->registers[6]);
-			fprintf(stderr, " X:0x%04x  Y:0x%04x  Z:0x%04x  J:0x%04x\n",
-				dcpu->registers[3], dcpu->registers[4],
-				dcpu->registers[5], dcpu->registers[7]);
-			fprintf(stderr, "PC:0x%04x SP:0x%04x EX:0x%04x IA:0x%04x\n",
-				dcpu->pc, dcpu->sp, dcpu->ex, dcpu->ia);
+			dcpu_dump(dcpu, stderr);
 			getchar();
 			return NULL;
 		case 0x01:
@@ -202,18 +257,12 @@ static u16 *instr_cycle(struct dcpu *dcpu)
 			return DIRTY(dcpu->sp);
 		case 0x02:
 			/* TRACE */
-			fprintf(stderr, " A:0x%04x  B:0x%04x  C:0x%04x  I:0x%04x\n",
-				dcpu->registers[0], dcpu->registers[1],
-				dcpu->registers[2], dcpu->registers[6]);
-			fprintf(stderr, " X:0x%04x  Y:0x%04x  Z:0x%04x  J:0x%04x\n",
-				dcpu->registers[3], dcpu->registers[4],
-				dcpu->registers[5], dcpu->registers[7]);
-			fprintf(stderr, "PC:0x%04x SP:0x%04x EX:0x%04x IA:0x%04x\n",
-				dcpu->pc, dcpu->sp, dcpu->ex, dcpu->ia);
+			dcpu_dump(dcpu, stderr);
 			return NULL;
 		case 0x08:
+			dcpu_interrupt(dcpu, *pa);
 			dcpu->cycles += 3;
-			return DIRTY(interrupt(dcpu, *pa));
+			return NULL;
 		case 0x09:
 			*pa = dcpu->ia;
 			return dirty;
@@ -238,8 +287,9 @@ static u16 *instr_cycle(struct dcpu *dcpu)
 		}
 		case 0x11:
 		{
-			struct device *device = nth_hardware(dcpu, *pa)->device;
-			if (device != NULL) {
+			struct hardware *hw = nth_hardware(dcpu, *pa);
+			if (hw != NULL) {
+				struct device *device = hw->device;
 				dcpu->registers[0] = device->id;
 				dcpu->registers[1] = device->id >> 16;
 				dcpu->registers[2] = device->version;
@@ -258,7 +308,7 @@ static u16 *instr_cycle(struct dcpu *dcpu)
 		case 0x12:
 		{
 			struct hardware *hw = nth_hardware(dcpu, *pa);
-			if (hw != NULL && hw->device->interrupt != NULL) {
+			if (hw != NULL && (hw->device->caps & DEVICE_INTERRUPTS)) {
 				hw->device->interrupt(hw, dcpu);
 			}
 			dcpu->cycles += 3;
@@ -268,7 +318,7 @@ static u16 *instr_cycle(struct dcpu *dcpu)
 			 */
 			return NULL;
 		}
-		default: throw("unaryopcode", "out of range");
+		default: dcpu_throw(dcpu, "unaryopcode", "out of range");
 		}
 	} else {
 		u16  a = decode_a(dcpu, enc_a);
@@ -394,10 +444,10 @@ static u16 *instr_cycle(struct dcpu *dcpu)
 			return NULL;
 		} else if (opcode == 0x18) {
 			fprintf(stderr, "0x%04x: ", opcode);
-			throw("binaryopcode", "out of range");
+			dcpu_throw(dcpu, "binaryopcode", "out of range");
 		} else if (opcode == 0x19) {
 			fprintf(stderr, "0x%04x: ", opcode);
-			throw("binaryopcode", "out of range");
+			dcpu_throw(dcpu, "binaryopcode", "out of range");
 		} else if (opcode == 0x1a) {
 			u32 c    = (u32)*b + (u32)a + (u32)dcpu->ex;
 			dcpu->ex = c >> 16;
@@ -410,10 +460,10 @@ static u16 *instr_cycle(struct dcpu *dcpu)
 			dcpu->cycles += 2;
 		} else if (opcode == 0x1c) {
 			fprintf(stderr, "0x%04x: ", opcode);
-			throw("binaryopcode", "out of range");
+			dcpu_throw(dcpu, "binaryopcode", "out of range");
 		} else if (opcode == 0x1d) {
 			fprintf(stderr, "0x%04x: ", opcode);
-			throw("binaryopcode", "out of range");
+			dcpu_throw(dcpu, "binaryopcode", "out of range");
 		} else if (opcode == 0x1e) {
 			*b = a;
 			dcpu->registers[6]++;
@@ -425,7 +475,7 @@ static u16 *instr_cycle(struct dcpu *dcpu)
 			dcpu->registers[7]--;
 			dcpu->cycles++;
 		} else {
-			throw("binaryopcode", "out of range");
+			dcpu_throw(dcpu, "binaryopcode", "out of range");
 		}
 	}
 	return dirty;
@@ -433,164 +483,284 @@ static u16 *instr_cycle(struct dcpu *dcpu)
 
 static void cycle(struct dcpu *dcpu)
 {
+	struct hardware *hw;
 	u16 *dirty;
-	int i;
+	int i, before = dcpu->cycles;
 	
+	if (dcpu->ninterrupts != 0)
+		trigger(dcpu);
 	dirty = instr_cycle(dcpu);
+	if (dcpu->profile != NULL)
+		dcpu->profile[dcpu->instruction] += dcpu->cycles - before;
 
-	for (i = 0; i < dcpu->hw_count; i++)
-		dcpu->hw[i].device->cycle(dcpu->hw + i, dirty, dcpu);
+	for (i = 0; i < dcpu->nticking; i++) {
+		hw = dcpu->hw + dcpu->ticking[i];
+		hw->device->cycle(hw, dirty, dcpu);
+	}
+	if (dirty != NULL) {
+		for (i = 0; i < dcpu->nwatching; i++) {
+			hw = dcpu->hw + dcpu->watching[i];
+			hw->device->cycle(hw, dirty, dcpu);
+		}
+	}
+
+	if (dcpu->cycles >= dcpu->next_event)
+		fire_events(dcpu);
 }
 
-u16 programme[] = {
-#include "../examples/mandelbrot.hex"
-};
+/**
+ * whether the instruction just run jumped to itself and did nothing
+ * else, so that it would go on doing the same until an event or an
+ * interrupt: set, add or sub to pc, of a register or a literal.
+ */
+static int idling(const struct dcpu *dcpu)
+{
+	u16 instruction = dcpu->ram[dcpu->instruction];
+	u16 opcode = instruction & 0x001f;
+	u16 b = (instruction & 0x03e0) >> 5;
+	u16 a = (instruction & 0xfc00) >> 10;
+	int i;
 
-#define TIMESLICE 0.01
-#define CLOCKRATE 100000
+	if (opcode < 0x01 || opcode > 0x03 || b != 0x1c || (a >= 0x08 && a < 0x1f))
+		return 0;
+	if (dcpu->skipping || (dcpu->ninterrupts != 0 && !dcpu->queue_interrupts))
+		return 0;
+
+	for (i = 0; i < dcpu->nticking; i++) {
+		const struct hardware *hw = dcpu->hw + dcpu->ticking[i];
+		if (hw->device->quiet == NULL || !hw->device->quiet(dcpu->hw + dcpu->ticking[i]))
+			return 0;
+	}
+	return 1;
+}
 
-static double diffclock(struct timespec b, struct timespec a)
+/**
+ * the cycles the idle loop would run until the next event or end,
+ * whichever is sooner, counted whole iterations at a time so that the
+ * event fires at the cycle it would have.
+ */
+static void fast_forward(struct dcpu *dcpu, int cost, int end)
 {
-	return (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1000000000.0;
+	int until = dcpu->next_event < end ? dcpu->next_event : end, n;
+
+	if (cost <= 0 || until <= dcpu->cycles)
+		return;
+	n = (until - dcpu->cycles + cost - 1) / cost;
+	dcpu->cycles += n * cost;
+	if (dcpu->profile != NULL)
+		dcpu->profile[dcpu->instruction] += n * cost;
+
+	if (dcpu->cycles >= dcpu->next_event)
+		fire_events(dcpu);
 }
 
-static double inseconds(struct timespec a)
+struct dcpu *dcpu_create(int quirks)
 {
-	return a.tv_sec + a.tv_nsec / 1000000000.0;
+	struct dcpu *dcpu = ecalloc(1, sizeof *dcpu);
+
+	dcpu->quirks = quirks;
+	dcpu->next_event = INT_MAX;
+	return dcpu;
 }
 
-int main()
+void dcpu_destroy(struct dcpu *dcpu)
 {
-	struct dcpu dcpu = DCPU_INIT;
-	struct timespec last_start, timeslice_start, current;
-	int last_start_cycles, timeslice_start_cycles;
-	
-	dcpu.quirks = 0;
-	/* turn me on if the program you are testing requires that the monitor
-	 * is automatically turned on at the beginning of execution and mapped
-	 * to 0x8000.
-	 */
-	/* dcpu.quirks |= DCPU_QUIRKS_LEM1802_ALWAYS_ON; */
+	int i;
 
-	/* turn me on if the program you are testing can use a 24-bit colour
-	 * palette. (rrrrrggggggbbbbb instead of 0000rrrrggggbbbb).
-	 */
-	/* dcpu.quirks |= DCPU_QUIRKS_LEM1802_USE_16BIT_COLOUR; */
+	if (dcpu == NULL)
+		return;
+	for (i = 0; i < dcpu->hw_count; i++)
+		if (dcpu->hw[i].device->destroy != NULL)
+			dcpu->hw[i].device->destroy(dcpu->hw[i].device);
+	free(dcpu->hw);
+	free(dcpu->ticking);
+	free(dcpu->watching);
+	free(dcpu);
+}
 
-	memcpy(dcpu.ram, programme, sizeof programme);
+void dcpu_load(struct dcpu *dcpu, uint16_t address, const uint16_t *words, size_t n)
+{
+	dcpu_write(dcpu, address, words, n);
+}
 
-	dcpu.hw_count = 5;
-	dcpu.hw = emalloc(5 * sizeof(struct hardware));
+/* the big-endian word at i of n bytes, or 0 past the end */
+static u16 dcpu_word(const u8 *bytes, size_t n, size_t i)
+{
+	return 2 * i + 1 < n ? (u16)(bytes[2 * i] << 8 | bytes[2 * i + 1]) : 0;
+}
 
-	dcpu.hw[0].device = make_lem1802(&dcpu);
+/* the segments of an image, as the assembler's object_write_image() writes them */
+static int dcpu_load_image(struct dcpu *dcpu, const u8 *bytes, size_t n)
+{
+	size_t i, words = n / 2, length;
+	u16 address, entry = dcpu_word(bytes, n, 2);
+	int nsegments = dcpu_word(bytes, n, 3);
+
+	for (i = 4; nsegments-- > 0; i += length) {
+		if (i >= words)
+			return 0;
+		i += 1 + (dcpu_word(bytes, n, i) + 1) / 2;  /* the name */
+		if (i + 2 > words)
+			return 0;
+		address = dcpu_word(bytes, n, i);
+		length = dcpu_word(bytes, n, i + 1);
+		i += 2;
+		if (i + length > words)
+			return 0;
+		for (; length > 0; length--, i++)
+			dcpu->ram[address++] = dcpu_word(bytes, n, i);
+	}
 
-	dcpu.hw[1].device = make_dfpu17(&dcpu);
+	dcpu->pc = entry;
+	return i == words;
+}
 
-	{
-		struct device d = {0x30cf7406, 0x0001, 0x90099009, NULL, &noop_interrupt, &noop_cycle};
-		dcpu.hw[2].device = emalloc(sizeof(struct device));
-		*dcpu.hw[2].device = d;
+int dcpu_load_file(struct dcpu *dcpu, const char *filename)
+{
+	u8 *bytes = NULL;
+	size_t n = 0, capacity = 0, got;
+	FILE *file;
+	int ok;
+
+	if ((file = fopen(filename, "rb")) == NULL) {
+		fprintf(stderr, "%s: can't open it\n", filename);
+		return 1;
 	}
-	{
-		struct device d = {0x12d0b402, 0x0001, 0x90099009, NULL, &noop_interrupt, &noop_cycle};
-		dcpu.hw[3].device = emalloc(sizeof(struct device));
-		*dcpu.hw[3].device = d;
+	do {
+		if (capacity - n < 4096) {
+			capacity = capacity ? 2 * capacity : 65536;
+			bytes = erealloc(bytes, capacity);
+		}
+		got = fread(bytes + n, 1, capacity - n, file);
+		n += got;
+	} while (got != 0);
+	ok = !ferror(file);
+	fclose(file);
+
+	if (!ok) {
+		fprintf(stderr, "%s: can't read it\n", filename);
+	} else if (n >= 4 && dcpu_word(bytes, n, 0) == ('D' << 8 | 'I')) {
+		if (dcpu_word(bytes, n, 1) != 2 || !dcpu_load_image(dcpu, bytes, n)) {
+			fprintf(stderr, "%s: not an image this can load, or a damaged one\n", filename);
+			ok = 0;
+		}
+	} else if (n % 2 != 0 || n > 2 * 65536) {
+		fprintf(stderr, "%s: not a whole number of words that fit in memory\n", filename);
+		ok = 0;
+	} else {
+		for (got = 0; got < n / 2; got++)
+			dcpu->ram[got] = dcpu_word(bytes, n, got);
 	}
-	{
-		struct device d = {0x74fa4cae, 0x07c2, 0x21544948, NULL, &noop_interrupt, &noop_cycle};
-		dcpu.hw[4].device = emalloc(sizeof(struct device));
-		*dcpu.hw[4].device = d;
+
+	free(bytes);
+	return !ok;
+}
+
+void dcpu_attach(struct dcpu *dcpu, struct device *device)
+{
+	u16 n = dcpu->hw_count++;
+
+	dcpu->hw = erealloc(dcpu->hw, dcpu->hw_count * sizeof *dcpu->hw);
+	dcpu->hw[n].device = device;
+
+	/* a device that ticks sees writes anyway */
+	if (device->caps & DEVICE_TICKS) {
+		dcpu->ticking = erealloc(dcpu->ticking, (dcpu->nticking + 1) * sizeof *dcpu->ticking);
+		dcpu->ticking[dcpu->nticking++] = n;
+	} else if (device->caps & DEVICE_WATCHES) {
+		dcpu->watching = erealloc(dcpu->watching, (dcpu->nwatching + 1) * sizeof *dcpu->watching);
+		dcpu->watching[dcpu->nwatching++] = n;
 	}
+}
 
-	clock_gettime(CLOCK_MONOTONIC, &last_start);
-	timeslice_start = last_start;
-	last_start_cycles = timeslice_start_cycles = dcpu.cycles;
+int dcpu_step(struct dcpu *dcpu)
+{
+	if (dcpu->fault_desc != NULL)
+		return 1;
+	if (!setjmp(dcpu->fault))
+		cycle(dcpu);
+	return dcpu->fault_desc != NULL;
+}
 
-	puts("");
-label:
-	if (!setjmp(except_buf)) {
-		while (1) {
-			clock_gettime(CLOCK_MONOTONIC, &current);
+/**
+ * the jump back is set once for the whole run rather than for each
+ * instruction, which is what makes running for many cycles at a time
+ * cheaper than stepping.
+ */
+long dcpu_run(struct dcpu *dcpu, long cycles)
+{
+	int start = dcpu->cycles, end, before;
+
+	if (dcpu->fault_desc != NULL)
+		return 0;
+	end = cycles < INT_MAX - start ? start + (int)cycles : INT_MAX;
+	if (!setjmp(dcpu->fault)) {
+		while (dcpu->cycles < end) {
+			before = dcpu->cycles;
+			cycle(dcpu);
+			if (dcpu->pc == dcpu->instruction && idling(dcpu))
+				fast_forward(dcpu, dcpu->cycles - before, end);
+		}
+	}
+	return dcpu->cycles - start;
+}
 
-#if 0
-			if (dcpu.cycles - timeslice_start_cycles > CLOCKRATE * TIMESLICE) {
-				if (!(dcpu.cycles - last_start_cycles > CLOCKRATE * diffclock(current, last_start))) {
-					fprintf(stderr, "a");
-				}
-			}
-			if (dcpu.cycles - last_start_cycles > CLOCKRATE * diffclock(current, last_start)) {
-				if (!(dcpu.cycles - timeslice_start_cycles > CLOCKRATE * TIMESLICE)) {
-					fprintf(stderr, "b");
-				}
-			}
-#endif
+long dcpu_cycles(const struct dcpu *dcpu)
+{
+	return dcpu->cycles;
+}
 
-			if (dcpu.cycles - timeslice_start_cycles > CLOCKRATE * TIMESLICE
-				&& dcpu.cycles - last_start_cycles > CLOCKRATE * diffclock(current, last_start)) {
-				double sleeptime = diffclock(timeslice_start, current) + TIMESLICE;
-#if 0
-				fprintf(stderr, "cc=%d, tsc=%d, lsc=%d\n", dcpu.cycles, timeslice_start_cycles, last_start_cycles);
-				fprintf(stderr, "c=%f, ts=%f, ls=%f\n",
-						inseconds(current),
-						inseconds(timeslice_start),
-						inseconds(last_start));
-				fprintf(stderr, "ets=%f, rem=%f\n",
-					inseconds(timeslice_start) + TIMESLICE,
-					inseconds(timeslice_start) + TIMESLICE - inseconds(current));
-				fprintf(stderr, "ec=%f\n", CLOCKRATE * diffclock(current, last_start));
-				
-#endif
-				if (sleeptime > 0) {
-					/* fprintf(stderr, "sleeping for %fms\n", 1000 * sleeptime); */
-					usleep(1000000.0 * sleeptime);
-				}
-				clock_gettime(CLOCK_MONOTONIC, &current);
+const char *dcpu_fault(const struct dcpu *dcpu, const char **what)
+{
+	if (what != NULL)
+		*what = dcpu->fault_what;
+	return dcpu->fault_desc;
+}
 
-#if 0
-				fprintf(stderr, "c=%f, ls=%f\n",
-					inseconds(current),
-					inseconds(last_start));
-				fprintf(stderr, "%d cycles in %fs = %f Hz.\n",
-					dcpu.cycles - last_start_cycles,
-					diffclock(current, last_start),
-					1.0 * (dcpu.cycles - last_start_cycles) /
-					diffclock(current, last_start));
-#endif
+void dcpu_read(const struct dcpu *dcpu, uint16_t address, uint16_t *words, size_t n)
+{
+	size_t i;
 
-				timeslice_start_cycles = dcpu.cycles;
-				timeslice_start = current;
-				continue;
-			}
+	for (i = 0; i < n; i++)
+		words[i] = dcpu->ram[(u16)(address + i)];
+}
 
-#if 0
-			/* fprintf(stderr, "%ld\n", clock2);*/
-			if (diffclock(current, timeslice_start) >= 0.01) {
-				fprintf(stderr, "%d cycles per 10ms.                         \n",
-					(dcpu.cycles - timeslice_start_cycles) / 5);
-				timeslice_start_cycles = dcpu.cycles;
-				timeslice_start = current;
-			}
-#endif
+void dcpu_write(struct dcpu *dcpu, uint16_t address, const uint16_t *words, size_t n)
+{
+	size_t i;
 
-			cycle(&dcpu);
-		}
-	} else {
-		fprintf(stderr, "%s: %s\n", except->desc, except->what);
-		fprintf(stderr, " 0x%04x 0x%04x 0x%04x 0x%04x\n",
-			dcpu.ram[110], dcpu.ram[111],
-			dcpu.ram[112], dcpu.ram[113]);
-		fprintf(stderr, " 0x%04x 0x%04x 0x%04x 0x%04x\n",
-			dcpu.ram[512 + 110], dcpu.ram[512 + 111],
-			dcpu.ram[512 + 112], dcpu.ram[512 + 113]);
-		fprintf(stderr, " A:0x%04x  B:0x%04x  C:0x%04x  I:0x%04x\n",
-			dcpu.registers[0], dcpu.registers[1],
-			dcpu.registers[2], dcpu.registers[6]);
-		fprintf(stderr, " X:0x%04x  Y:0x%04x  Z:0x%04x  J:0x%04x\n",
-			dcpu.registers[3], dcpu.registers[4],
-			dcpu.registers[5], dcpu.registers[7]);
-		fprintf(stderr, "PC:0x%04x SP:0x%04x EX:0x%04x IA:0x%04x\n",
-			dcpu.pc, dcpu.sp, dcpu.ex, dcpu.ia);
-		abort();
-		goto label;
+	for (i = 0; i < n; i++)
+		dcpu->ram[(u16)(address + i)] = words[i];
+}
+
+uint16_t dcpu_register(const struct dcpu *dcpu, enum dcpu_register r)
+{
+	switch (r) {
+	case DCPU_PC: return dcpu->pc;
+	case DCPU_SP: return dcpu->sp;
+	case DCPU_EX: return dcpu->ex;
+	case DCPU_IA: return dcpu->ia;
+	default:      return dcpu->registers[r];
+	}
+}
+
+void dcpu_set_register(struct dcpu *dcpu, enum dcpu_register r, uint16_t value)
+{
+	switch (r) {
+	case DCPU_PC: dcpu->pc = value; break;
+	case DCPU_SP: dcpu->sp = value; break;
+	case DCPU_EX: dcpu->ex = value; break;
+	case DCPU_IA: dcpu->ia = value; break;
+	default:      dcpu->registers[r] = value; break;
 	}
 }
+
+void dcpu_set_map(struct dcpu *dcpu, const struct debugmap *map)
+{
+	dcpu->map = map;
+}
+
+void dcpu_set_profile(struct dcpu *dcpu, uint32_t *counts)
+{
+	dcpu->profile = counts;
+}
@@ -0,0 +1,190 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "utils.h"
+#include "debugmap.h"
+
+struct debugmap_label {
+	u16 address;
+	char *name;
+};
+
+struct debugmap_line {
+	u16 address;
+	int file;
+	long line;
+};
+
+struct debugmap {
+	char **files;
+	int nfiles;
+
+	struct debugmap_label *labels;
+	int nlabels, label_capacity;
+
+	struct debugmap_line *lines;
+	int nlines, line_capacity;
+};
+
+static char *debugmap_strdup(const char *s)
+{
+	char *copy = emalloc(strlen(s) + 1);
+
+	strcpy(copy, s);
+	return copy;
+}
+
+static int by_label_address(const void *a, const void *b)
+{
+	const struct debugmap_label *x = a, *y = b;
+
+	return (x->address > y->address) - (x->address < y->address);
+}
+
+static int by_line_address(const void *a, const void *b)
+{
+	const struct debugmap_line *x = a, *y = b;
+
+	return (x->address > y->address) - (x->address < y->address);
+}
+
+/* one record; 0 if it isn't one */
+static int debugmap_record(struct debugmap *map, char *record)
+{
+	unsigned address;
+	long line;
+	int file, n = 0;
+	char *name;
+
+	record[strcspn(record, "\n")] = '\0';
+
+	if (sscanf(record, "file %d %n", &file, &n) == 1 && n != 0) {
+		if (file != map->nfiles)
+			return 0;
+		map->files = erealloc(map->files, (map->nfiles + 1) * sizeof *map->files);
+		map->files[map->nfiles++] = debugmap_strdup(record + n);
+		return 1;
+	}
+
+	if (sscanf(record, "label %x %n", &address, &n) == 1 && n != 0) {
+		name = record + n;
+		name[strcspn(name, " \t")] = '\0';
+		if (map->nlabels == map->label_capacity) {
+			map->label_capacity = map->label_capacity ? 2 * map->label_capacity : 256;
+			map->labels = erealloc(map->labels, map->label_capacity * sizeof *map->labels);
+		}
+		map->labels[map->nlabels].address = (u16)address;
+		map->labels[map->nlabels++].name = debugmap_strdup(name);
+		return 1;
+	}
+
+	if (sscanf(record, "line %x %d %ld", &address, &file, &line) == 3) {
+		if (file < 0 || file >= map->nfiles)
+			return 0;
+		if (map->nlines == map->line_capacity) {
+			map->line_capacity = map->line_capacity ? 2 * map->line_capacity : 1024;
+			map->lines = erealloc(map->lines, map->line_capacity * sizeof *map->lines);
+		}
+		map->lines[map->nlines].address = (u16)address;
+		map->lines[map->nlines].file = file;
+		map->lines[map->nlines++].line = line;
+		return 1;
+	}
+
+	return record[0] == '\0';
+}
+
+/* NULL, having said why, if it can't be read */
+struct debugmap *debugmap_load(const char *filename)
+{
+	struct debugmap *map;
+	char record[1024];
+	FILE *file;
+	int number = 0;
+
+	if ((file = fopen(filename, "r")) == NULL) {
+		fprintf(stderr, "%s: can't open it\n", filename);
+		return NULL;
+	}
+
+	map = ecalloc(1, sizeof *map);
+	while (fgets(record, sizeof record, file) != NULL) {
+		number++;
+		if (!debugmap_record(map, record)) {
+			fprintf(stderr, "%s:%d: not a debug map record\n", filename, number);
+			fclose(file);
+			debugmap_free(map);
+			return NULL;
+		}
+	}
+	fclose(file);
+
+	qsort(map->labels, map->nlabels, sizeof *map->labels, by_label_address);
+	qsort(map->lines, map->nlines, sizeof *map->lines, by_line_address);
+	return map;
+}
+
+void debugmap_free(struct debugmap *map)
+{
+	int i;
+
+	if (map == NULL)
+		return;
+	for (i = 0; i < map->nfiles; i++)
+		free(map->files[i]);
+	for (i = 0; i < map->nlabels; i++)
+		free(map->labels[i].name);
+	free(map->files);
+	free(map->labels);
+	free(map->lines);
+	free(map);
+}
+
+/* the index of the last of n entries, size bytes apart, at or before address; or -1 */
+static int debugmap_find(const void *entries, int n, size_t size, u16 address)
+{
+	const char *base = entries;
+	int low = 0, high = n;
+
+	/* the address is the first member of both kinds of entry */
+	while (low < high) {
+		int middle = low + (high - low) / 2;
+		if (*(const u16 *)(base + middle * size) <= address)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low - 1;
+}
+
+/**
+ * " label+0x3 (file.dasm16:42)", or as much of it as is known; nothing
+ * without a map.
+ */
+void debugmap_print(const struct debugmap *map, FILE *file, u16 address)
+{
+	const struct debugmap_label *label;
+	const struct debugmap_line *line;
+	int i;
+
+	if (map == NULL)
+		return;
+
+	i = debugmap_find(map->labels, map->nlabels, sizeof *map->labels, address);
+	if (i >= 0) {
+		label = &map->labels[i];
+		if (label->address == address)
+			fprintf(file, " %s", label->name);
+		else
+			fprintf(file, " %s+0x%x", label->name, address - label->address);
+	}
+
+	i = debugmap_find(map->lines, map->nlines, sizeof *map->lines, address);
+	if (i >= 0) {
+		line = &map->lines[i];
+		fprintf(file, " (%s:%ld)", map->files[line->file], line->line);
+	}
+}
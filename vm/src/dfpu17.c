@@ -1,7 +1,10 @@
 #define _GNU_SOURCE
+#include <fenv.h>
 #include <math.h>
+#include <pthread.h>
 #include <tgmath.h>
 #include <setjmp.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,13 +12,156 @@
 
 #include "types.h"
 #include "dcpu.h"
-#include "exception.h"
+#include "libdcpu.h"
 #include "utils.h"
 #include "dfpu17.h"
+#include "dfpu17_vector.h"
+#include "half.h"
+#include "fastmath.h"
+#include "jit.h"
+
+/**
+ * the text bank is compiled into micro-ops whenever it changes, so the
+ * executor never decodes an instruction word. each word holds one op,
+ * or two for a packed pair of short instructions.
+ *
+ * ops marked P depend on the precision. their handlers are generated
+ * for each precision from dfpu17_prec.h, and SET PREC and SET ACCURACY
+ * rebind the program to the right set, so no handler looks at either.
+ */
+#define DFPU17_OPS \
+	X(NOOP, noop) X(WAIT, wait) X(HALT, halt) X(FAIL, fail) \
+	X(DEBUG, debug) X(INVALID, invalid) \
+	X(JC, jc) X(SET, set) X(SWAP, swap) X(ZERO, zero) X(JMP, jmp) \
+	X(INC, inc) X(DEC, dec) X(PUSH, push) X(POP, pop) X(PEEK, peek) \
+	X(JMPI, jmpi) X(LOOP, loop) X(JCI, jci) X(SETI, seti) X(CMPI, cmpi) \
+	P(LD, ld) P(ST, st) P(LDI, ldi) P(STI, sti) \
+	P(SIN, sin) P(COS, cos) P(TAN, tan) P(ASIN, asin) P(ACOS, acos) \
+	P(ATAN, atan) P(SQRT, sqrt) P(RND, rnd) P(LOG10, log10) \
+	P(LOG2, log2) P(LOG, log) P(ABS, abs) \
+	P(LDZ, ldz) P(LD1, ld1) P(LDPI, ldpi) P(LDE, lde) P(LDSR2, ldsr2) \
+	P(LDPHI, ldphi) P(LDL2E, ldl2e) P(LDL2X, ldl2x) P(LDLG2, ldlg2) \
+	P(LDLN2, ldln2) \
+	P(MOV, mov) P(XCHG, xchg) P(ADD, add) P(MUL, mul) P(SUB, sub) \
+	P(RSUB, rsub) P(DIV, div) P(RDIV, rdiv) \
+	P(LT, lt) P(GT, gt) P(EQ, eq) P(NE, ne) P(ATAN2, atan2) P(FMA, fma) \
+	X(VLEN, vlen) X(VLENI, vleni) X(VSTRIDE, vstride) X(VSTRIDEI, vstridei) \
+	P(VARITH, varith) P(VSCALAR, vscalar) P(VREDUCE, vreduce) P(VDOT, vdot)
+
+#define X(kind, name) OP_##kind,
+#define P(kind, name) OP_##kind,
+enum dfpu17_opkind {
+	DFPU17_OPS
+	OP_COUNT
+};
+#undef P
+#undef X
+
+struct dfpu17_op;
+
+typedef void dfpu17_handler(struct hardware *hw, struct dcpu *dcpu, const struct dfpu17_op *op);
+
+struct dfpu17_op {
+	dfpu17_handler *handler;
+	u16 instruction;
+	u8  kind;
+	u8  a, b, c;
+	u8  vop;  /* the dfpu17_vector_op or _reduction of a vector op */
+};
+
+struct dfpu17_word {
+	struct dfpu17_op op[2];
+	u8  count;
+};
+
+struct device_dfpu17;
+
+/**
+ * the text translated to native code, which runs the job from PC until
+ * it stops or, once budget steps have been run, until the next jump. it
+ * returns the number of steps run.
+ */
+typedef int dfpu17_native(struct device_dfpu17 *dfpu17, struct hardware *hw, int budget);
+
+/**
+ * in worker mode EXECUTE hands the job to this thread, which runs it
+ * until it stops. what the dcpu can see of the job -- the status, the
+ * buffer swap and the interrupt -- is published on the dcpu's thread
+ * once the device's ticks reach start + steps, the tick it would have
+ * finished at run inline, one step a tick, so the two are the same to
+ * the program and runs are reproducible.
+ */
+#define DFPU17_WORKER_BATCH 256
+
+struct dfpu17_worker {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t progress;
+	struct hardware hw;
+
+	int busy;      /* a job has been handed over and not yet published */
+	int done;      /* the job has stopped, or been cancelled */
+	int cancel;
+	int quit;      /* the device is going, so the thread should */
+	int start;     /* the device's tick the job was handed over at */
+	int steps;     /* steps run so far, updated every batch */
+
+	/**
+	 * the op that stopped the job: wait, halt, fail or an invalid one,
+	 * or a debug op, which the dcpu's thread runs before handing the
+	 * rest of the job back
+	 */
+	const struct dfpu17_op *stop;
+
+	/* the host's exception flags are per thread, so the worker tests
+	 * its own when the job stops, adding to those raised before a debug op */
+	u16 fpexcept;
+
+	/* the job's translation, or NULL to interpret it */
+	dfpu17_native *native;
+};
+
+#if defined(__x86_64__)
+#define DFPU17_JIT
+#endif
+
+/**
+ * the text as native code, made when a job is handed to the worker if
+ * the text or precision changed since the last one was.
+ */
+#define DFPU17_JIT_SIZE   65536
+#define DFPU17_JIT_FIXUPS 4096
+
+enum dfpu17_jit_target {
+	JT_WORD,     /* the code for a word */
+	JT_RESUME,   /* leave, to carry on at a word */
+	JT_EXIT,     /* leave, to carry on at the word in al */
+	JT_EPILOGUE,
+	JT_TABLE     /* the address of each word's code */
+};
+
+struct dfpu17_translation {
+	struct jit *jit;
+	dfpu17_native *native;  /* NULL once stale */
+
+	size_t word[256];
+	size_t resume[256];
+	size_t exit, epilogue, table;
+
+	/* rel32s to patch once the targets are known */
+	int nfixups;
+	struct dfpu17_fixup {
+		size_t at;
+		u8 target;
+		u8 index;
+	} fixups[DFPU17_JIT_FIXUPS];
+};
 
 struct device_dfpu17 {
 	u16 mode;
 	u16 prec;
+	u16 accuracy;
 	u8  status;
 	u8  error;
 	u16 intrmsg;
@@ -33,30 +179,76 @@ struct device_dfpu17 {
 	u8  fcsp;
 	u8  pc;
 
-	union device_dfpu17_memory {
-		struct device_dfpu17_memory_u16 {
-			u16 registers[16];
-			u16 data0[512];
-			u16 data1[512];
-		} word;
-		struct device_dfpu17_memory_f16 {
-			f16 registers[16];
-			f16 data0[256]; /* unfortunate */
-			f16 data1[256];
-		} half;
-		struct device_dfpu17_memory_f32 {
-			f32 registers[8];
-			f32 data0[256];
-			f32 data1[256];
-		} sngl;
-		struct device_dfpu17_memory_f64 {
-			f64 registers[4];
-			f64 data0[128];
-			f64 data1[128];
-		} dble;
-	} mem;
+	/**
+	 * the registers and the two DATA banks, viewed at each precision.
+	 * which bank is primary is selected by an index, so swapping the
+	 * buffers just flips it.
+	 */
+	union device_dfpu17_registers {
+		u16 word[16];
+		f16 half[16];
+		f32 sngl[8];
+		f64 dble[4];
+	} registers;
+
+	union device_dfpu17_bank {
+		u16 word[512];
+		f16 half[256]; /* unfortunate */
+		f32 sngl[256];
+		f64 dble[128];
+	} banks[2];
+
+	u8  primary;
 
 	u16 text[256];
+	struct dfpu17_word program[256];
+
+	/**
+	 * the calls to dfpu17_cycle while the device is on, which is what
+	 * transfers and jobs are timed in: a word or a step a call, however
+	 * many cycles the dcpu's instruction took.
+	 */
+	int ticks;
+
+	/**
+	 * how transfers between the dcpu's ram and the device are modelled.
+	 * in burst mode the whole block is copied when ticks reaches
+	 * loaddeadline, and loadbase/loadsize describe the block being
+	 * transferred.
+	 */
+	u8  dmamode;
+	int loaddeadline;
+	u16 loadbase;
+	u16 loadsize;
+
+	/* the number of elements and the spacing between them for vectors */
+	u16 vlen;
+	u8  vstride;
+
+	/**
+	 * the floating-point exceptions raised by the last job, and by
+	 * every job since the mode was last set. the host's flags are only
+	 * tested when a job stops, not after every op.
+	 */
+	u16 fpexcept;
+	u16 fpsticky;
+
+	/**
+	 * an EXECUTE_BATCH in progress. while the job for one descriptor
+	 * runs on the primary bank, the secondary stores the previous
+	 * job's output and then loads the next job's input. the counts are
+	 * of descriptors whose jobs have been started, whose input has
+	 * been loaded and whose output has been stored.
+	 */
+	u8  batching;
+	u16 batchtable;
+	u16 batchcount;
+	u16 batchstarted;
+	u16 batchloaded;
+	u16 batchstored;
+
+	struct dfpu17_worker *worker;
+	struct dfpu17_translation *translation;
 };
 
 enum dfpu17_command {
@@ -68,7 +260,9 @@ enum dfpu17_command {
 	GET_DATA,
 	EXECUTE,
 	SWAP_BUFFERS,
-	SET_INTERRUPT_MESSAGE
+	SET_INTERRUPT_MESSAGE,
+	EXECUTE_BATCH,
+	SET_ACCURACY
 };
 
 enum dfpu17_mode {
@@ -83,6 +277,11 @@ enum dfpu17_prec {
 	PREC_HALF
 };
 
+enum dfpu17_accuracy {
+	ACCURACY_EXACT,
+	ACCURACY_FAST
+};
+
 enum dfpu17_status {
 	STATUS_OFF,
 	STATUS_IDLE,
@@ -104,28 +303,20 @@ enum dfpu17_error {
 	ERROR_FPEXCEPT  /* floating-point exception */
 };
 
-void dfpu17_enqueue_interrupt(struct dcpu *dcpu)
+enum dfpu17_fpexcept {
+	FPEXCEPT_INVALID   = 0x1,
+	FPEXCEPT_DIVBYZERO = 0x2,
+	FPEXCEPT_OVERFLOW  = 0x4
+};
+
+void dfpu17_enqueue_interrupt(struct device *device, struct dcpu *dcpu)
 {
-	/* cpu interrupts are not yet implemented */
-	(void)dcpu;
+	dcpu_interrupt(dcpu, dfpu17_get(device, intrmsg));
 }
 
-/* this should probably work by swapping pointers or something instead.. */
 void dfpu17_swap_buffers(struct device *device)
 {
-	u16 temporary[512];
-
-	memcpy(temporary,
-	       dfpu17_get(device, mem.word.data0),
-	       512 * sizeof(u16));
-
-	memcpy(dfpu17_get(device, mem.word.data0),
-	       dfpu17_get(device, mem.word.data1),
-	       512 * sizeof(u16));
-
-	memcpy(dfpu17_get(device, mem.word.data1),
-	       temporary,
-	       512 * sizeof(u16));
+	dfpu17_get(device, primary) ^= 1;
 }
 
 void dfpu17_halt(struct device *device, struct dcpu *dcpu, int status, int error)
@@ -133,9 +324,10 @@ void dfpu17_halt(struct device *device, struct dcpu *dcpu, int status, int error
 	dfpu17_get(device, status) = status;
 	dfpu17_get(device, error) = error;
 
-	if (dfpu17_get(device, mode) == MODE_INT) {
+	/* a batch only swaps and interrupts once, when it's complete */
+	if (dfpu17_get(device, mode) == MODE_INT && !dfpu17_get(device, batching)) {
 		dfpu17_swap_buffers(device);
-		dfpu17_enqueue_interrupt(dcpu);
+		dfpu17_enqueue_interrupt(device, dcpu);
 	}
 }
 
@@ -153,105 +345,17 @@ void invalid_precision(u16 x) {
 #define COUNT dfpu17_get(hw->device, loadcount)
 #define PTR   dfpu17_get(hw->device, loadptr)
 #define TEXT  dfpu17_get(hw->device, text)
-#define DATA  dfpu17_get(hw->device, mem.word.data1)
-#define HREG  dfpu17_get(hw->device, mem.half.registers)
-#define SREG  dfpu17_get(hw->device, mem.sngl.registers)
-#define DREG  dfpu17_get(hw->device, mem.dble.registers)
-#define HMEM  dfpu17_get(hw->device, mem.half.data0)
-#define SMEM  dfpu17_get(hw->device, mem.sngl.data0)
-#define DMEM  dfpu17_get(hw->device, mem.dble.data0)
-#define BINOP(O,R,S) do {\
-	if (PREC == PREC_HALF) {\
-		f16 r = HREG[R];\
-		f16 s = HREG[S];\
-		(void)r; (void)s;\
-		HREG[R] = O;\
-	} else if (PREC == PREC_SINGLE) {\
-		f32 r = SREG[R];\
-		f32 s = SREG[S];\
-		(void)r; (void)s;\
-		SREG[R] = O;\
-	} else {\
-		f64 r = DREG[R];\
-		f64 s = DREG[S];\
-		(void)r; (void)s;\
-		DREG[R] = O;\
-	} } while (0)
-#define UNARYOP(O,A) do {\
-	if (PREC == PREC_HALF) {\
-		f16 a = HREG[A];\
-		(void)a;\
-		HREG[A] = O;\
-	} else if (PREC == PREC_SINGLE) {\
-		f32 a = SREG[A];\
-		(void)a;\
-		SREG[A] = O;\
-	} else {\
-		f64 a = DREG[A];\
-		(void)a;\
-		DREG[A] = O;\
-	} } while (0)
-#define CMP(O,A,B) (!((PREC == PREC_HALF) ? (HREG[A] O HREG[B]) \
-		    : (PREC == PREC_SINGLE) ? (SREG[A] O SREG[B]) \
-		    : (DREG[A] O DREG[B])))
-
-
-void dfpu17_execute_short(struct hardware *hw, struct dcpu *dcpu, u8 instruction)
-{
-	(void)hw;
-	(void)dcpu;
-
-	switch ((instruction >> 4) & 0x7) {
-	case 0x0: { /* one-operand instructions */
-#define A ((instruction >> 0) & 0x3)
-		switch ((instruction >> 2) & 0x3) {
-		case 0x0: /* zero @a */
-			IREG[A] = 0;
-			return;
-		case 0x1: /* inc @a */
-			IREG[A]++;
-			return;
-		case 0x2: /* dec @a */
-			IREG[A]--;
-			return;
-		case 0x3: /* jmp @a */
-			PC = IREG[A];
-			return;
-		}
-#undef A
-	}
-#define A ((instruction >> 2) & 0x3)
-#define B ((instruction >> 0) & 0x3)
-	case 0x1: /* jc @a,@b */
-		if (IREG[A] == 0)
-			PC = IREG[B];
-		return;
-	case 0x2: /* set @a,@b */
-		IREG[A] = IREG[B];
-		return;
-	case 0x3: /* swap @a,@b */
-		SWAP(IREG[A], IREG[B]);
-		return;
-#undef B
-#undef A
-#define R ((instruction >> 2) & 0x3)
-#define S ((instruction >> 0) & 0x3)
-	case 0x4: /* mov %r,%s */
-		BINOP(s, R, S);
-		return;
-	case 0x5: /* add %r,%s */
-		BINOP(r + s, R, S);
-		return;
-	case 0x6: /* sub %r,%s */
-		BINOP(r - s, R, S);
-		return;
-	case 0x7: /* mul %r,%s */
-		BINOP(r * s, R, S);
-		return;
-#undef R
-#undef S
-	}
-}
+#define PRIMARY   dfpu17_get(hw->device, banks)[dfpu17_get(hw->device, primary)]
+#define SECONDARY dfpu17_get(hw->device, banks)[dfpu17_get(hw->device, primary) ^ 1]
+#define DATA  SECONDARY.word
+#define HREG  dfpu17_get(hw->device, registers.half)
+#define SREG  dfpu17_get(hw->device, registers.sngl)
+#define DREG  dfpu17_get(hw->device, registers.dble)
+#define HMEM  PRIMARY.half
+#define SMEM  PRIMARY.sngl
+#define DMEM  PRIMARY.dble
+#define VLEN  dfpu17_get(hw->device, vlen)
+#define VSTRIDE dfpu17_get(hw->device, vstride)
 
 static void print_state(struct hardware *hw, u16 instruction)
 {
@@ -294,399 +398,1280 @@ static void print_state(struct hardware *hw, u16 instruction)
 	fprintf(stderr, "instruction: 0x%04x\n", instruction);
 }
 
-void dfpu17_execute(struct hardware *hw, struct dcpu *dcpu)
+/* the exceptions the calling thread has raised since EXECUTE cleared them */
+static u16 dfpu17_fpexcept(void)
 {
-	u16 instruction = dfpu17_get(hw->device, text)[dfpu17_get(hw->device, pc)++];
+	int raised = fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_OVERFLOW);
 
-#if 0
-	print_state(hw, instruction);
-	if (!setjmp(except_buf)) {
-#endif
-		/*
-		int i, j;
-		fprintf(stderr, "FPU: 0x%04x\n", instruction);
+	return ((raised & FE_INVALID)   ? FPEXCEPT_INVALID   : 0)
+	     | ((raised & FE_DIVBYZERO) ? FPEXCEPT_DIVBYZERO : 0)
+	     | ((raised & FE_OVERFLOW)  ? FPEXCEPT_OVERFLOW  : 0);
+}
 
-		fprintf(stderr, "registers:\n");
-		fprintf(stderr, "\t");
-		for (i = 0; i < 8; i++) {
-			fprintf(stderr, "%f ", SREG[i]);
-		}
-		fprintf(stderr, "\n");
+/**
+ * the effect of an op that stops the device. in worker mode this is
+ * deferred until the job is published.
+ */
+static void dfpu17_finish(struct hardware *hw, struct dcpu *dcpu, const struct dfpu17_op *op, u16 fpexcept)
+{
+	dfpu17_get(hw->device, fpexcept) = fpexcept;
+	dfpu17_get(hw->device, fpsticky) |= fpexcept;
 
-		fprintf(stderr, "memory:\n");
-		for (i = 0; i < 8; i++) {
-			fprintf(stderr, "\t");
-			for (j = 0; j < 16; j++) {
-				fprintf(stderr, "%f ", SMEM[i * 16 + j]);
-			}
-			fprintf(stderr, "\n");
-		} 
-		*/
-
-		if ((instruction & 0x8080) == 0x8080) {
-			/* The MSB is executed first. TODO: explain why */
-			dfpu17_execute_short(hw, dcpu, (instruction >> 8) & 0x7f);
-			dfpu17_execute_short(hw, dcpu, (instruction >> 0) & 0x7f);
-			return;
-		}
+	switch (op->kind) {
+	case OP_WAIT:
+		dfpu17_get(hw->device, status) = STATUS_WAITING;
+		if (fpexcept)
+			dfpu17_get(hw->device, error) = ERROR_FPEXCEPT;
+		break;
+	case OP_HALT:
+		print_state(hw, op->instruction);
+		dfpu17_halt(hw->device, dcpu, STATUS_IDLE, fpexcept ? ERROR_FPEXCEPT : ERROR_NONE);
+		break;
+	case OP_FAIL:
+		dfpu17_halt(hw->device, dcpu, STATUS_IDLE, ERROR_FAIL);
+		break;
+	default:
+		dcpu_throw(dcpu, "dfpu17opcode", "out of range");
+	}
+}
 
-		switch ((instruction >> 12) & 0xf) {
-		case 0x0: /* nullary, @,@ and @ ops */
-			switch ((instruction >> 11) & 0x1) {
-			case 0x0:
-				switch (instruction & 0x7ff) {
-				case 0x0: /* noop */
-					return;
-				case 0x1: /* wait */
-					dfpu17_get(hw->device, status) = STATUS_WAITING;
-					return;
-				case 0x2: /* halt */
-					print_state(hw, instruction);
-					dfpu17_halt(hw->device, dcpu, STATUS_IDLE, ERROR_NONE);
-					return;
-				case 0x3: /* fail */
-					dfpu17_halt(hw->device, dcpu, STATUS_IDLE, ERROR_FAIL);
-					return;
-				case 0x7ff: /* debug */
-					fprintf(stderr, "+===================+\n");
-					fprintf(stderr, "| DEBUG INSTRUCTION |\n");
-					fprintf(stderr, "+===================+\n");
-					print_state(hw, instruction);
-					getchar();
-					return;
-				default:
-					throw("dfpu17opcode", "out of range");
-				}
-			case 0x1:
-				switch ((instruction >> 8) & 0x7) {
-					case 0x0:
-#define A ((instruction >> 2) & 0x3)
-#define B ((instruction >> 0) & 0x3)
-						switch ((instruction >> 4) & 0xf) {
-						case 0x0: /* jc @a,@b */
-							if (IREG[A] == 0)
-								PC = IREG[B];
-							return;
-						case 0x1: /* set @a,@b */
-							IREG[A] = IREG[B];
-							return;
-						case 0x2: /* swap @a,@b */
-							SWAP(IREG[A], IREG[B]);
-							return;
-						default: /* [unassigned] */
-							throw("dfpu17opcode", "out of range");
-						}
-#undef B
-#undef A
-					case 0x1:
-#define A ((instruction >> 0) & 0x3)
-						switch ((instruction >> 2) & 0x3f) {
-						case 0x0: /* zero @a */
-							IREG[A] = 0;
-							return;
-						case 0x1: /* jmp @a */
-							PC = IREG[A];
-							return;
-						case 0x2: /* inc @a */
-							IREG[A]++;
-							return;
-						case 0x3: /* dec @a */
-							IREG[A]--;
-							return;
-						case 0x4: /* push @a */
-							ISP = (ISP - 1);
-							ISP = (ISP % 4);
-							ISTACK[ISP] = IREG[A];
-							return;
-						case 0x5: /* pop @a */
-							IREG[A] = ISTACK[ISP];
-							ISP = (ISP + 1) % 4;
-							return;
-						case 0x6: /* peek @a */
-							IREG[A] = ISTACK[ISP];
-							return;
-						case 0x7: /* [unassigned] */
-							throw("dfpu17opcode", "out of range");
-						default:  /* [unassigned] */
-							throw("dfpu17opcode", "out of range");
-						}
-#undef A
-					case 0x2:
-#define A ((instruction >> 0) & 0xf)
-#define B ((instruction >> 4) & 0x3)
-						switch ((instruction >> 6) & 0x3) {
-						case 0x0: /* ld %a,@b */
-							if (PREC == PREC_HALF)
-								HREG[A] = HMEM[IREG[B]];
-							else if (PREC == PREC_SINGLE)
-								SREG[A] = SMEM[IREG[B]];
-							else
-								DREG[A] = DMEM[IREG[B]];
-							return;
-						case 0x1: /* st @b,%a */
-							if (PREC == PREC_HALF)
-								HMEM[IREG[B]] = HREG[A];
-							else if (PREC == PREC_SINGLE)
-								SMEM[IREG[B]] = SREG[A];
-							else
-								DMEM[IREG[B]] = DREG[A];
-							return;
-						case 0x2: /* [unassigned] */
-							throw("dfpu17opcode", "out of range");
-						case 0x3: /* [unassigned] */
-							throw("dfpu17opcode", "out of range");
-						}
+static void dfpu17_stop(struct hardware *hw, struct dcpu *dcpu, const struct dfpu17_op *op)
+{
+	struct dfpu17_worker *worker = dfpu17_get(hw->device, worker);
+
+	/* only the worker runs ops while it is busy */
+	if (worker != NULL && worker->busy)
+		worker->stop = op;
+	else
+		dfpu17_finish(hw, dcpu, op, dfpu17_fpexcept());
+}
+
+#define A (op->a)
+#define B (op->b)
+#define C (op->c)
+#define DFPU17_OP(name) static void dfpu17_op_##name(struct hardware *hw, struct dcpu *dcpu, const struct dfpu17_op *op)
+
+DFPU17_OP(noop)    { (void)hw; (void)dcpu; (void)op; }
+DFPU17_OP(wait)    { dfpu17_stop(hw, dcpu, op); }
+DFPU17_OP(halt)    { dfpu17_stop(hw, dcpu, op); }
+DFPU17_OP(fail)    { dfpu17_stop(hw, dcpu, op); }
+static void dfpu17_debug(struct hardware *hw, const struct dfpu17_op *op)
+{
+	fprintf(stderr, "+===================+\n");
+	fprintf(stderr, "| DEBUG INSTRUCTION |\n");
+	fprintf(stderr, "+===================+\n");
+	print_state(hw, op->instruction);
+	getchar();
+}
+
+/* on the worker it waits for the dcpu's thread, which has the terminal */
+DFPU17_OP(debug)
+{
+	struct dfpu17_worker *worker = dfpu17_get(hw->device, worker);
+
+	(void)dcpu;
+	if (worker != NULL && worker->busy)
+		worker->stop = op;
+	else
+		dfpu17_debug(hw, op);
+}
+DFPU17_OP(invalid) { dfpu17_stop(hw, dcpu, op); }
+
+DFPU17_OP(jc)      { (void)dcpu; if (IREG[A] == 0) PC = IREG[B]; }
+DFPU17_OP(set)     { (void)dcpu; IREG[A] = IREG[B]; }
+DFPU17_OP(swap)    { (void)dcpu; SWAP(IREG[A], IREG[B]); }
+DFPU17_OP(zero)    { (void)dcpu; IREG[A] = 0; }
+DFPU17_OP(jmp)     { (void)dcpu; PC = IREG[A]; }
+DFPU17_OP(inc)     { (void)dcpu; IREG[A]++; }
+DFPU17_OP(dec)     { (void)dcpu; IREG[A]--; }
+DFPU17_OP(push)
+{
+	(void)dcpu;
+	ISP = (ISP - 1);
+	ISP = (ISP % 4);
+	ISTACK[ISP] = IREG[A];
+}
+DFPU17_OP(pop)
+{
+	(void)dcpu;
+	IREG[A] = ISTACK[ISP];
+	ISP = (ISP + 1) % 4;
+}
+DFPU17_OP(peek)    { (void)dcpu; IREG[A] = ISTACK[ISP]; }
+
+DFPU17_OP(vlen)     { (void)dcpu; VLEN = IREG[A] == 0 ? 256 : IREG[A]; }
+DFPU17_OP(vleni)    { (void)dcpu; VLEN = B == 0 ? 128 : B; }
+DFPU17_OP(vstride)  { (void)dcpu; VSTRIDE = IREG[A]; }
+DFPU17_OP(vstridei) { (void)dcpu; VSTRIDE = B; }
+
+DFPU17_OP(jmpi)    { (void)dcpu; PC = B; }
+DFPU17_OP(loop)
+{
+	(void)dcpu;
+	IREG[A]--;
+	if (IREG[A] != 0)
+		PC = B;
+}
+DFPU17_OP(jci)     { (void)dcpu; if (IREG[A] == 0) PC = B; }
+DFPU17_OP(seti)    { (void)dcpu; IREG[A] = B; }
+DFPU17_OP(cmpi)
+{
+	(void)dcpu;
+	if (IREG[A] > B)
+		IREG[A] = 1;
+	else if (IREG[A] < B)
+		IREG[A] = -1;
+	else
+		IREG[A] = 0;
+}
+#undef DFPU17_OP
+#undef C
 #undef B
 #undef A
-					case 0x7: /* jmp $b */
-#define B ((instruction >> 0) & 0xff)
-						PC = B;
-						return;
-#undef B
-					default: /* [unassigned] */
-						throw("dfpu17opcode", "out of range");
-				}
+
+#define DFPU17_CAT(a, b)  DFPU17_CAT_(a, b)
+#define DFPU17_CAT_(a, b) a##b
+
+#define DFPU17_T      f16
+#define DFPU17_SUFFIX f16
+#define DFPU17_REG    HREG
+#define DFPU17_MEM    HMEM
+#define DFPU17_W      f64
+#define DFPU17_GET(x) ((f64)f16_to_f32(x))
+#define DFPU17_PUT(x) f64_to_f16(x)
+#define DFPU17_FMA    f16_fma
+#define DFPU17_VW     f32
+#define DFPU17_GET_N  f16_to_f32_n
+#define DFPU17_PUT_N  f32_to_f16_n
+#define DFPU17_FAST
+#include "dfpu17_prec.h"
+
+#define DFPU17_T      f32
+#define DFPU17_SUFFIX f32
+#define DFPU17_REG    SREG
+#define DFPU17_MEM    SMEM
+#define DFPU17_W      f32
+#define DFPU17_GET(x) (x)
+#define DFPU17_PUT(x) (x)
+#define DFPU17_VW     f32
+#define DFPU17_FAST
+#include "dfpu17_prec.h"
+
+#define DFPU17_T      f64
+#define DFPU17_SUFFIX f64
+#define DFPU17_REG    DREG
+#define DFPU17_MEM    DMEM
+#define DFPU17_W      f64
+#define DFPU17_GET(x) (x)
+#define DFPU17_PUT(x) (x)
+#define DFPU17_VW     f64
+#include "dfpu17_prec.h"
+
+/* any precision other than half or single runs as double */
+static dfpu17_handler *const *dfpu17_handlers(int prec)
+{
+	switch (prec) {
+	case PREC_HALF:   return dfpu17_handlers_f16;
+	case PREC_SINGLE: return dfpu17_handlers_f32;
+	default:          return dfpu17_handlers_f64;
+	}
+}
+
+/**
+ * the handlers that replace sin to abs in ACCURACY_FAST, or NULL where
+ * libm is kept. double precision always keeps it.
+ */
+static dfpu17_handler *const *dfpu17_fast_handlers(int prec, int accuracy)
+{
+	if (accuracy != ACCURACY_FAST)
+		return NULL;
+
+	switch (prec) {
+	case PREC_HALF:   return dfpu17_fast_handlers_f16;
+	case PREC_SINGLE: return dfpu17_fast_handlers_f32;
+	default:          return NULL;
+	}
+}
+
+static void dfpu17_op(struct dfpu17_op *op, u16 instruction, int kind, u8 a, u8 b, u8 c)
+{
+	op->instruction = instruction;
+	op->kind = kind;
+	op->a = a;
+	op->b = b;
+	op->c = c;
+	op->vop = 0;
+}
+
+static void dfpu17_decode_short(struct dfpu17_op *op, u16 instruction, u8 bits)
+{
+	static const u8 unary[4] = {OP_ZERO, OP_INC, OP_DEC, OP_JMP};
+	static const u8 binary[8] = {0, OP_JC, OP_SET, OP_SWAP, OP_MOV, OP_ADD, OP_SUB, OP_MUL};
+
+	if (((bits >> 4) & 0x7) == 0x0) /* zero/inc/dec/jmp @a */
+		dfpu17_op(op, instruction, unary[(bits >> 2) & 0x3], bits & 0x3, 0, 0);
+	else /* jc/set/swap @a,@b, mov/add/sub/mul %r,%s */
+		dfpu17_op(op, instruction, binary[(bits >> 4) & 0x7], (bits >> 2) & 0x3, bits & 0x3, 0);
+}
+
+static int dfpu17_decode_kind(u16 instruction)
+{
+	static const u8 nullary[4] = {OP_NOOP, OP_WAIT, OP_HALT, OP_FAIL};
+	static const u8 pairs[3] = {OP_JC, OP_SET, OP_SWAP};
+	static const u8 singles[7] = {OP_ZERO, OP_JMP, OP_INC, OP_DEC, OP_PUSH, OP_POP, OP_PEEK};
+	static const u8 immediates[4] = {OP_LOOP, OP_JCI, OP_SETI, OP_CMPI};
+	static const u8 functions[16] = {
+		OP_SIN, OP_COS, OP_TAN, OP_ASIN, OP_ACOS, OP_ATAN, OP_SQRT, OP_RND,
+		OP_LOG10, OP_LOG2, OP_LOG, OP_INVALID, OP_ABS,
+		OP_INVALID, OP_INVALID, OP_INVALID
+	};
+	static const u8 constants[16] = {
+		OP_LDZ, OP_LD1, OP_LDPI, OP_LDE, OP_LDSR2, OP_LDPHI, OP_INVALID, OP_INVALID,
+		OP_LDL2E, OP_LDL2X, OP_LDLG2, OP_LDLN2,
+		OP_INVALID, OP_INVALID, OP_INVALID, OP_INVALID
+	};
+	static const u8 arithmetic[8] = {OP_MOV, OP_XCHG, OP_ADD, OP_MUL, OP_SUB, OP_RSUB, OP_DIV, OP_RDIV};
+	static const u8 comparisons[4] = {OP_LT, OP_GT, OP_EQ, OP_NE};
+
+	switch ((instruction >> 12) & 0xf) {
+	case 0x0: /* nullary, @,@ and @ ops */
+		if (((instruction >> 11) & 0x1) == 0x0) {
+			if ((instruction & 0x7ff) < 4)
+				return nullary[instruction & 0x7ff];
+			return (instruction & 0x7ff) == 0x7ff ? OP_DEBUG : OP_INVALID;
+		}
+		switch ((instruction >> 8) & 0x7) {
+		case 0x0: /* jc/set/swap @a,@b */
+			if (((instruction >> 4) & 0xf) < 3)
+				return pairs[(instruction >> 4) & 0xf];
+			return OP_INVALID;
+		case 0x1: /* zero/jmp/inc/dec/push/pop/peek @a */
+			if (((instruction >> 2) & 0x3f) < 7)
+				return singles[(instruction >> 2) & 0x3f];
+			return OP_INVALID;
+		case 0x2: /* ld %a,@b and st @b,%a */
+			switch ((instruction >> 6) & 0x3) {
+			case 0x0: return OP_LD;
+			case 0x1: return OP_ST;
+			default:  return OP_INVALID;
 			}
-		case 0x1: /* various @/$ ops */
-#define A ((instruction >> 8) & 0x3)
-#define B ((instruction >> 0) & 0xff)
-			switch ((instruction >> 10) & 0x3) {
-			case 0x0: /* loop @a,$b */
-#if 0
-				fprintf(stderr, "looping on @%d=0x%02x to 0x%02x\n",
-					A, IREG[A], B);
+		case 0x7: /* jmp $b */
+			return OP_JMPI;
+		default:
+			return OP_INVALID;
+		}
+	case 0x1: /* loop/jc/set/cmp @a,$b */
+		return immediates[(instruction >> 10) & 0x3];
+	case 0x2: /* ld %,$ */
+		return OP_LDI;
+	case 0x3: /* st %,$ */
+		return OP_STI;
+	case 0x4: /* %,% and % ops */
+		if (((instruction >> 11) & 0x1) == 0x1)
+			return arithmetic[(instruction >> 8) & 0x7];
+		switch ((instruction >> 8) & 0x7) {
+		case 0x0: return functions[(instruction >> 4) & 0xf];
+		case 0x1: return constants[(instruction >> 4) & 0xf];
+		default:  return OP_INVALID;
+		}
+	case 0x5: /* comparisons */
+		return comparisons[(instruction >> 10) & 0x3];
+	case 0x6: /* atan %a,%y,%x */
+		return OP_ATAN2;
+	case 0x7: /* fma %a,%b,%c */
+		return OP_FMA;
+	case 0x8: /* vlen/vstride */
+		if ((instruction & 0x0f78) == 0x0000)
+			return (instruction & 0x4) ? OP_VSTRIDE : OP_VLEN;
+		if ((instruction & 0x0f00) == 0x0100)
+			return OP_VLENI;
+		if ((instruction & 0x0f00) == 0x0200)
+			return OP_VSTRIDEI;
+		return OP_INVALID;
+	case 0x9: /* elementwise @d,@a,@b */
+		if ((instruction & 0x40) || ((instruction >> 8) & 0xf) >= DFPU17_VECTOR_OPS)
+			return OP_INVALID;
+		return OP_VARITH;
+	case 0xa: /* vector-scalar @d,%s */
+		if ((instruction & 0x40) || ((instruction >> 8) & 0xf) > 0x4)
+			return OP_INVALID;
+		return OP_VSCALAR;
+	case 0xb: /* reductions %a,@b and vdot %a,@b,@c */
+		if (instruction & 0x40)
+			return OP_INVALID;
+		if (((instruction >> 8) & 0xf) <= 0x2)
+			return OP_VREDUCE;
+		if (((instruction >> 8) & 0xf) == 0x8)
+			return OP_VDOT;
+		return OP_INVALID;
+	default: /* [unassigned] */
+		return OP_INVALID;
+	}
+}
+
+/**
+ * the operand fields are extracted for every format; each handler only
+ * looks at the ones its instruction has.
+ */
+static void dfpu17_decode(struct dfpu17_word *word, u16 instruction)
+{
+	static const u8 vscalar[5] = {DFPU17_VMOV, DFPU17_VADD, DFPU17_VSUB, DFPU17_VMUL, DFPU17_VDIV};
+	int kind;
+	u8 a, b, c, vop = 0;
+
+	if ((instruction & 0x8080) == 0x8080) {
+		/* The MSB is executed first. TODO: explain why */
+		dfpu17_decode_short(&word->op[0], instruction, (instruction >> 8) & 0x7f);
+		dfpu17_decode_short(&word->op[1], instruction, (instruction >> 0) & 0x7f);
+		word->count = 2;
+		return;
+	}
+
+	kind = dfpu17_decode_kind(instruction);
+
+	switch ((instruction >> 12) & 0xf) {
+	case 0x0:
+		switch ((instruction >> 8) & 0xf) {
+		case 0x8: /* @a,@b */
+			a = (instruction >> 2) & 0x3;
+			b = (instruction >> 0) & 0x3;
+			break;
+		case 0xa: /* %a,@b */
+			a = (instruction >> 0) & 0xf;
+			b = (instruction >> 4) & 0x3;
+			break;
+		case 0xf: /* $b */
+			a = 0;
+			b = (instruction >> 0) & 0xff;
+			break;
+		default: /* @a */
+			a = (instruction >> 0) & 0x3;
+			b = 0;
+			break;
+		}
+		c = 0;
+		break;
+	case 0x1: /* @a,$b */
+		a = (instruction >> 8) & 0x3;
+		b = (instruction >> 0) & 0xff;
+		c = 0;
+		break;
+	case 0x2:
+	case 0x3: /* %a,$b */
+		a = (instruction >> 8) & 0xf;
+		b = (instruction >> 0) & 0xff;
+		c = 0;
+		break;
+	case 0x5: /* @c,%a,%b */
+		a = (instruction >> 0) & 0xf;
+		b = (instruction >> 4) & 0xf;
+		c = (instruction >> 8) & 0x3;
+		break;
+	case 0x4: /* %a and %a,%b */
+	case 0x6:
+	case 0x7: /* %a,%b,%c */
+		a = (instruction >> 0) & 0xf;
+		b = (instruction >> 4) & 0xf;
+		c = (instruction >> 8) & 0xf;
+		break;
+	case 0x8: /* @a or $b */
+		a = (instruction >> 0) & 0x3;
+		b = (instruction >> 0) & 0x7f;
+		c = 0;
+		break;
+	case 0x9: /* @d,@a,@b */
+		a = (instruction >> 4) & 0x3;
+		b = (instruction >> 2) & 0x3;
+		c = (instruction >> 0) & 0x3;
+		vop = (instruction >> 8) & 0xf;
+		break;
+	case 0xa: /* @d,%s */
+		a = (instruction >> 4) & 0x3;
+		b = (instruction >> 0) & 0xf;
+		c = 0;
+		if (kind == OP_VSCALAR)
+			vop = vscalar[(instruction >> 8) & 0xf];
+		break;
+	case 0xb:
+		if (kind == OP_VDOT) { /* %a,@b,@c */
+			a = (instruction >> 4) & 0x3;
+			b = (instruction >> 2) & 0x3;
+			c = (instruction >> 0) & 0x3;
+			vop = DFPU17_VDOT;
+		} else { /* %a,@b */
+			a = (instruction >> 0) & 0xf;
+			b = (instruction >> 4) & 0x3;
+			c = 0;
+			vop = (instruction >> 8) & 0xf;
+		}
+		break;
+	default:
+		a = b = c = 0;
+		break;
+	}
+
+	dfpu17_op(&word->op[0], instruction, kind, a, b, c);
+	word->op[0].vop = vop;
+	dfpu17_op(&word->op[1], instruction, OP_NOOP, 0, 0, 0);
+	word->count = 1;
+}
+
+static dfpu17_handler *dfpu17_handler_for(dfpu17_handler *const *handlers,
+	dfpu17_handler *const *fast, int kind)
+{
+	if (fast != NULL && kind >= OP_SIN && kind <= OP_ABS)
+		return fast[kind - OP_SIN];
+	return handlers[kind];
+}
+
+/**
+ * point count compiled words from first onwards at the handlers for
+ * the current precision and accuracy.
+ */
+static void dfpu17_bind(struct device *device, int first, int count)
+{
+	dfpu17_handler *const *handlers = dfpu17_handlers(dfpu17_get(device, prec));
+	dfpu17_handler *const *fast = dfpu17_fast_handlers(dfpu17_get(device, prec),
+		dfpu17_get(device, accuracy));
+	struct dfpu17_word *word;
+	int i;
+
+	for (i = first; i < first + count; i++) {
+		word = &dfpu17_get(device, program)[i];
+		word->op[0].handler = dfpu17_handler_for(handlers, fast, word->op[0].kind);
+		word->op[1].handler = dfpu17_handler_for(handlers, fast, word->op[1].kind);
+	}
+
+	if (dfpu17_get(device, translation) != NULL)
+		dfpu17_get(device, translation)->native = NULL;
+}
+
+/**
+ * bring the compiled program up to date with count words of TEXT from
+ * first onwards. called whenever TEXT is written.
+ */
+static void dfpu17_compile(struct device *device, int first, int count)
+{
+	int i;
+
+	for (i = first; i < first + count; i++)
+		dfpu17_decode(&dfpu17_get(device, program)[i],
+			dfpu17_get(device, text)[i]);
+
+	dfpu17_bind(device, first, count);
+}
+
+void dfpu17_execute(struct hardware *hw, struct dcpu *dcpu)
+{
+	const struct dfpu17_word *word = &dfpu17_get(hw->device, program)[PC++];
+
+	word->op[0].handler(hw, dcpu, &word->op[0]);
+	if (word->count == 2)
+		word->op[1].handler(hw, dcpu, &word->op[1]);
+}
+
+#ifdef DFPU17_JIT
+
+/**
+ * each word becomes a block of x86-64 that does what its ops would to
+ * struct device_dfpu17, falling through to the next word's block.
+ * floating-point registers and the banks are worked on in memory with
+ * scalar sse, and jumps are native branches. ops without a translation
+ * are called through their handlers.
+ *
+ * while it runs:
+ *   rbx  the device's data
+ *   r12  the struct hardware to call handlers with
+ *   r13d the steps run
+ *   r14d the budget, checked before each jump
+ *   r15  the primary bank
+ *   eax  the next pc, in a word with a computed jump
+ */
+#define J (t->jit)
+#define OFF(member) ((u32)offsetof(struct device_dfpu17, member))
+#define IREG_AT(i)  (OFF(fcreg) + (i))
+
+static void dfpu17_jit_fixup(struct dfpu17_translation *t, int target, int index)
+{
+	struct dfpu17_fixup *f;
+
+	if (t->nfixups == DFPU17_JIT_FIXUPS) {
+		fprintf(stderr, "Too many jumps in DFPU-17 translation\n");
+		abort();
+	}
+
+	f = &t->fixups[t->nfixups++];
+	f->at = J->len;
+	f->target = target;
+	f->index = index;
+	jit_emit_u32(J, 0);
+}
+
+/* modrm and disp32 of [rbx + disp] */
+static void dfpu17_jit_rbx(struct dfpu17_translation *t, int reg, u32 disp)
+{
+	jit_emit(J, 1, 0x80 | reg << 3 | 3);
+	jit_emit_u32(J, disp);
+}
+
+/* movss/addss/... xmm, [rbx + disp], or their sd forms */
+static void dfpu17_jit_sse(struct dfpu17_translation *t, int dbl, int opcode, int xmm, u32 disp)
+{
+	jit_emit(J, 3, dbl ? 0xf2 : 0xf3, 0x0f, opcode);
+	dfpu17_jit_rbx(t, xmm, disp);
+}
+
+/* ucomiss/ucomisd xmm0, [rbx + disp] */
+static void dfpu17_jit_ucomis(struct dfpu17_translation *t, int dbl, u32 disp)
+{
+	if (dbl)
+		jit_emit(J, 1, 0x66);
+	jit_emit(J, 2, 0x0f, 0x2e);
+	dfpu17_jit_rbx(t, 0, disp);
+}
+
+/* jump to a word, or leave for it if the budget is spent: 14 bytes */
+static void dfpu17_jit_jump(struct dfpu17_translation *t, int target)
+{
+	jit_emit(J, 5, 0x45, 0x39, 0xf5, 0x0f, 0x83);  /* cmp r13d, r14d; jae */
+	dfpu17_jit_fixup(t, JT_RESUME, target);
+	jit_emit(J, 1, 0xe9);                          /* jmp */
+	dfpu17_jit_fixup(t, JT_WORD, target);
+}
+
+/* call the op's handler as dfpu17_execute would, with PC past its word */
+static void dfpu17_jit_call(struct dfpu17_translation *t, int k, const struct dfpu17_op *op)
+{
+	u64 handler, arg;
+
+	memcpy(&handler, &op->handler, sizeof handler);
+	arg = (u64)(size_t)op;
+
+	jit_emit(J, 1, 0xc6);                          /* mov byte [pc], k + 1 */
+	dfpu17_jit_rbx(t, 0, OFF(pc));
+	jit_emit(J, 1, (k + 1) & 0xff);
+	jit_emit(J, 5, 0x4c, 0x89, 0xe7, 0x31, 0xf6);  /* mov rdi, r12; xor esi, esi */
+	jit_emit(J, 2, 0x48, 0xba);                    /* mov rdx, op */
+	jit_emit_u64(J, arg);
+	jit_emit(J, 2, 0x48, 0xb8);                    /* mov rax, handler */
+	jit_emit_u64(J, handler);
+	jit_emit(J, 2, 0xff, 0xd0);                    /* call rax */
+}
+
+enum {
+	JIT_NEXT,     /* falls through to the next op */
+	JIT_COMPUTED, /* sets al to the next pc */
+	JIT_LEAVES    /* never falls through */
+};
+
+static int dfpu17_jit_op(struct dfpu17_translation *t, int k, const struct dfpu17_op *op, int dbl)
+{
+	int size = dbl ? 8 : 4;
+	int sib = dbl ? 0xcf : 0x8f;  /* [r15 + rcx * size] */
+	int prefix = dbl ? 0xf2 : 0xf3;
+	u32 a = OFF(registers) + size * op->a;
+	u32 b = OFF(registers) + size * op->b;
+	double constants[10];
+	u64 bits64;
+	u32 bits32;
+	f64 d;
+	f32 f;
+
+	switch (op->kind) {
+	case OP_NOOP:
+		return JIT_NEXT;
+
+	case OP_LD:
+		jit_emit(J, 2, 0x0f, 0xb6);                    /* movzx ecx, @b */
+		dfpu17_jit_rbx(t, 1, IREG_AT(op->b));
+		jit_emit(J, 6, prefix, 0x41, 0x0f, 0x10, 0x04, sib);
+		dfpu17_jit_sse(t, dbl, 0x11, 0, a);
+		return JIT_NEXT;
+	case OP_ST:
+		jit_emit(J, 2, 0x0f, 0xb6);
+		dfpu17_jit_rbx(t, 1, IREG_AT(op->b));
+		dfpu17_jit_sse(t, dbl, 0x10, 0, a);
+		jit_emit(J, 6, prefix, 0x41, 0x0f, 0x11, 0x04, sib);
+		return JIT_NEXT;
+	case OP_LDI:
+		jit_emit(J, 5, prefix, 0x41, 0x0f, 0x10, 0x87); /* [r15 + disp32] */
+		jit_emit_u32(J, size * op->b);
+		dfpu17_jit_sse(t, dbl, 0x11, 0, a);
+		return JIT_NEXT;
+	case OP_STI:
+		dfpu17_jit_sse(t, dbl, 0x10, 0, a);
+		jit_emit(J, 5, prefix, 0x41, 0x0f, 0x11, 0x87);
+		jit_emit_u32(J, size * op->b);
+		return JIT_NEXT;
+
+	case OP_MOV:
+		dfpu17_jit_sse(t, dbl, 0x10, 0, b);
+		dfpu17_jit_sse(t, dbl, 0x11, 0, a);
+		return JIT_NEXT;
+	case OP_XCHG:
+		dfpu17_jit_sse(t, dbl, 0x10, 0, a);
+		dfpu17_jit_sse(t, dbl, 0x10, 1, b);
+		dfpu17_jit_sse(t, dbl, 0x11, 1, a);
+		dfpu17_jit_sse(t, dbl, 0x11, 0, b);
+		return JIT_NEXT;
+	/* a NaN operand is what comes out, and of two NaNs the first. the
+	 * compiler puts s first in the interpreter's r + s and r * s */
+	case OP_ADD:
+	case OP_MUL:
+		dfpu17_jit_sse(t, dbl, 0x10, 0, b);
+		dfpu17_jit_sse(t, dbl, op->kind == OP_ADD ? 0x58 : 0x59, 0, a);
+		dfpu17_jit_sse(t, dbl, 0x11, 0, a);
+		return JIT_NEXT;
+	case OP_SUB:
+	case OP_DIV:
+		dfpu17_jit_sse(t, dbl, 0x10, 0, a);
+		dfpu17_jit_sse(t, dbl, op->kind == OP_SUB ? 0x5c : 0x5e, 0, b);
+		dfpu17_jit_sse(t, dbl, 0x11, 0, a);
+		return JIT_NEXT;
+	case OP_RSUB:
+	case OP_RDIV:
+		dfpu17_jit_sse(t, dbl, 0x10, 0, b);
+		dfpu17_jit_sse(t, dbl, op->kind == OP_RSUB ? 0x5c : 0x5e, 0, a);
+		dfpu17_jit_sse(t, dbl, 0x11, 0, a);
+		return JIT_NEXT;
+	case OP_SQRT:
+		dfpu17_jit_sse(t, dbl, 0x51, 0, a);
+		dfpu17_jit_sse(t, dbl, 0x11, 0, a);
+		return JIT_NEXT;
+	case OP_ABS:
+		if (dbl) {
+			jit_emit(J, 3, 0x48, 0x0f, 0xba);      /* btr qword [a], 63 */
+			dfpu17_jit_rbx(t, 6, a);
+			jit_emit(J, 1, 63);
+		} else {
+			jit_emit(J, 1, 0x81);                  /* and dword [a], 0x7fffffff */
+			dfpu17_jit_rbx(t, 4, a);
+			jit_emit_u32(J, 0x7fffffff);
+		}
+		return JIT_NEXT;
+
+	case OP_LDZ: case OP_LD1: case OP_LDPI: case OP_LDE: case OP_LDSR2:
+	case OP_LDPHI: case OP_LDL2E: case OP_LDL2X: case OP_LDLG2: case OP_LDLN2:
+		/* as dfpu17_prec.h has them, rounded to the precision */
+		constants[0] = 0.0;
+		constants[1] = 1.0;
+		constants[2] = M_PI;
+		constants[3] = M_E;
+		constants[4] = sqrt(2.0);
+		constants[5] = 1.6180339887498948482;
+		constants[6] = log2(M_E);
+		constants[7] = log2(10.0);
+		constants[8] = log10(2);
+		constants[9] = log(2);
+		if (dbl) {
+			d = constants[op->kind - OP_LDZ];
+			memcpy(&bits64, &d, sizeof bits64);
+			jit_emit(J, 2, 0x48, 0xb9);            /* mov rcx, bits */
+			jit_emit_u64(J, bits64);
+			jit_emit(J, 2, 0x48, 0x89);            /* mov [a], rcx */
+			dfpu17_jit_rbx(t, 1, a);
+		} else {
+			f = constants[op->kind - OP_LDZ];
+			memcpy(&bits32, &f, sizeof bits32);
+			jit_emit(J, 1, 0xc7);                  /* mov dword [a], bits */
+			dfpu17_jit_rbx(t, 0, a);
+			jit_emit_u32(J, bits32);
+		}
+		return JIT_NEXT;
+
+	/* @c is 0 if the comparison holds, which ucomis leaves as flags */
+	case OP_LT:
+		dfpu17_jit_sse(t, dbl, 0x10, 0, b);
+		dfpu17_jit_ucomis(t, dbl, a);
+		jit_emit(J, 3, 0x0f, 0x96, 0xc1);              /* setbe cl */
+		goto compared;
+	case OP_GT:
+		dfpu17_jit_sse(t, dbl, 0x10, 0, a);
+		dfpu17_jit_ucomis(t, dbl, b);
+		jit_emit(J, 3, 0x0f, 0x96, 0xc1);              /* setbe cl */
+		goto compared;
+	case OP_EQ:
+		dfpu17_jit_sse(t, dbl, 0x10, 0, a);
+		dfpu17_jit_ucomis(t, dbl, b);
+		jit_emit(J, 8, 0x0f, 0x95, 0xc1, 0x0f, 0x9a, 0xc2, 0x08, 0xd1); /* setne cl; setp dl; or cl, dl */
+		goto compared;
+	case OP_NE:
+		dfpu17_jit_sse(t, dbl, 0x10, 0, a);
+		dfpu17_jit_ucomis(t, dbl, b);
+		jit_emit(J, 8, 0x0f, 0x94, 0xc1, 0x0f, 0x9b, 0xc2, 0x20, 0xd1); /* sete cl; setnp dl; and cl, dl */
+	compared:
+		jit_emit(J, 1, 0x88);                          /* mov @c, cl */
+		dfpu17_jit_rbx(t, 1, IREG_AT(op->c));
+		return JIT_NEXT;
+
+	case OP_SET:
+		jit_emit(J, 1, 0x8a);                          /* mov cl, @b */
+		dfpu17_jit_rbx(t, 1, IREG_AT(op->b));
+		jit_emit(J, 1, 0x88);                          /* mov @a, cl */
+		dfpu17_jit_rbx(t, 1, IREG_AT(op->a));
+		return JIT_NEXT;
+	case OP_SWAP:
+		jit_emit(J, 1, 0x8a);                          /* mov cl, @a */
+		dfpu17_jit_rbx(t, 1, IREG_AT(op->a));
+		jit_emit(J, 1, 0x8a);                          /* mov dl, @b */
+		dfpu17_jit_rbx(t, 2, IREG_AT(op->b));
+		jit_emit(J, 1, 0x88);                          /* mov @a, dl */
+		dfpu17_jit_rbx(t, 2, IREG_AT(op->a));
+		jit_emit(J, 1, 0x88);                          /* mov @b, cl */
+		dfpu17_jit_rbx(t, 1, IREG_AT(op->b));
+		return JIT_NEXT;
+	case OP_ZERO:
+	case OP_SETI:
+		jit_emit(J, 1, 0xc6);                          /* mov byte @a, $b */
+		dfpu17_jit_rbx(t, 0, IREG_AT(op->a));
+		jit_emit(J, 1, op->kind == OP_ZERO ? 0 : op->b);
+		return JIT_NEXT;
+	case OP_INC:
+	case OP_DEC:
+		jit_emit(J, 1, 0xfe);                          /* inc/dec byte @a */
+		dfpu17_jit_rbx(t, op->kind == OP_INC ? 0 : 1, IREG_AT(op->a));
+		return JIT_NEXT;
+	case OP_CMPI:
+		jit_emit(J, 1, 0x80);                          /* cmp byte @a, $b */
+		dfpu17_jit_rbx(t, 7, IREG_AT(op->a));
+		jit_emit(J, 1, op->b);
+		jit_emit(J, 8, 0x0f, 0x97, 0xc1, 0x0f, 0x92, 0xc2, 0x28, 0xd1); /* seta cl; setb dl; sub cl, dl */
+		jit_emit(J, 1, 0x88);
+		dfpu17_jit_rbx(t, 1, IREG_AT(op->a));
+		return JIT_NEXT;
+
+	/* the stack pointer is always 0-3, so % 4 is & 3 */
+	case OP_PUSH:
+		jit_emit(J, 2, 0x0f, 0xb6);                    /* movzx ecx, sp */
+		dfpu17_jit_rbx(t, 1, OFF(fcsp));
+		jit_emit(J, 5, 0xff, 0xc9, 0x83, 0xe1, 0x03);  /* dec ecx; and ecx, 3 */
+		jit_emit(J, 1, 0x88);                          /* mov sp, cl */
+		dfpu17_jit_rbx(t, 1, OFF(fcsp));
+		jit_emit(J, 1, 0x8a);                          /* mov dl, @a */
+		dfpu17_jit_rbx(t, 2, IREG_AT(op->a));
+		jit_emit(J, 3, 0x88, 0x94, 0x0b);              /* mov [rbx + rcx + stack], dl */
+		jit_emit_u32(J, OFF(fcstack));
+		return JIT_NEXT;
+	case OP_POP:
+	case OP_PEEK:
+		jit_emit(J, 2, 0x0f, 0xb6);                    /* movzx ecx, sp */
+		dfpu17_jit_rbx(t, 1, OFF(fcsp));
+		jit_emit(J, 3, 0x8a, 0x94, 0x0b);              /* mov dl, [rbx + rcx + stack] */
+		jit_emit_u32(J, OFF(fcstack));
+		jit_emit(J, 1, 0x88);                          /* mov @a, dl */
+		dfpu17_jit_rbx(t, 2, IREG_AT(op->a));
+		if (op->kind == OP_POP) {
+			jit_emit(J, 5, 0xff, 0xc1, 0x83, 0xe1, 0x03); /* inc ecx; and ecx, 3 */
+			jit_emit(J, 1, 0x88);
+			dfpu17_jit_rbx(t, 1, OFF(fcsp));
+		}
+		return JIT_NEXT;
+
+	case OP_JMPI:
+		dfpu17_jit_jump(t, op->b);
+		return JIT_LEAVES;
+	case OP_JCI:
+		jit_emit(J, 1, 0x80);                          /* cmp byte @a, 0 */
+		dfpu17_jit_rbx(t, 7, IREG_AT(op->a));
+		jit_emit(J, 3, 0, 0x75, 14);                   /* jne past the jump */
+		dfpu17_jit_jump(t, op->b);
+		return JIT_NEXT;
+	case OP_LOOP:
+		jit_emit(J, 1, 0xfe);                          /* dec byte @a */
+		dfpu17_jit_rbx(t, 1, IREG_AT(op->a));
+		jit_emit(J, 2, 0x74, 14);                      /* je past the jump */
+		dfpu17_jit_jump(t, op->b);
+		return JIT_NEXT;
+	case OP_JMP:
+		jit_emit(J, 1, 0x8a);                          /* mov al, @a */
+		dfpu17_jit_rbx(t, 0, IREG_AT(op->a));
+		return JIT_COMPUTED;
+	case OP_JC:
+		jit_emit(J, 1, 0x80);                          /* cmp byte @a, 0 */
+		dfpu17_jit_rbx(t, 7, IREG_AT(op->a));
+		jit_emit(J, 3, 0, 0x75, 6);                    /* jne past the mov */
+		jit_emit(J, 1, 0x8a);                          /* mov al, @b */
+		dfpu17_jit_rbx(t, 0, IREG_AT(op->b));
+		return JIT_COMPUTED;
+
+	case OP_WAIT:
+	case OP_HALT:
+	case OP_FAIL:
+	case OP_DEBUG:
+	case OP_INVALID:
+		dfpu17_jit_call(t, k, op);
+		jit_emit(J, 1, 0xe9);
+		dfpu17_jit_fixup(t, JT_RESUME, (k + 1) & 0xff);
+		return JIT_LEAVES;
+
+	default:
+		dfpu17_jit_call(t, k, op);
+		return JIT_NEXT;
+	}
+}
+
+static dfpu17_native *dfpu17_translate(struct dfpu17_translation *t, struct device *device)
+{
+	int dbl = dfpu17_get(device, prec) != PREC_SINGLE;
+	const struct dfpu17_word *word;
+	struct dfpu17_fixup *f;
+	dfpu17_native *native;
+	size_t to;
+	void *code;
+	int i, k, computed, leaves, next;
+
+	jit_reset(J);
+	t->nfixups = 0;
+
+	/* prologue: save registers and jump to PC */
+	jit_emit(J, 10, 0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57);
+	jit_emit(J, 4, 0x48, 0x83, 0xec, 0x08);            /* sub rsp, 8 */
+	jit_emit(J, 6, 0x48, 0x89, 0xfb, 0x49, 0x89, 0xf4);  /* mov rbx, rdi; mov r12, rsi */
+	jit_emit(J, 6, 0x41, 0x89, 0xd6, 0x45, 0x31, 0xed);  /* mov r14d, edx; xor r13d, r13d */
+	jit_emit(J, 2, 0x0f, 0xb6);                        /* movzx eax, primary */
+	dfpu17_jit_rbx(t, 0, OFF(primary));
+	jit_emit(J, 2, 0x69, 0xc0);                        /* imul eax, eax, sizeof bank */
+	jit_emit_u32(J, sizeof(union device_dfpu17_bank));
+	jit_emit(J, 4, 0x4c, 0x8d, 0xbc, 0x03);            /* lea r15, [rbx + rax + banks] */
+	jit_emit_u32(J, OFF(banks));
+	jit_emit(J, 2, 0x0f, 0xb6);                        /* movzx eax, pc */
+	dfpu17_jit_rbx(t, 0, OFF(pc));
+	jit_emit(J, 3, 0x48, 0x8d, 0x0d);                  /* lea rcx, table */
+	dfpu17_jit_fixup(t, JT_TABLE, 0);
+	jit_emit(J, 3, 0xff, 0x24, 0xc1);                  /* jmp [rcx + rax * 8] */
+
+	for (k = 0; k < 256; k++) {
+		word = &dfpu17_get(device, program)[k];
+		t->word[k] = J->len;
+		jit_emit(J, 3, 0x41, 0xff, 0xc5);              /* inc r13d */
+
+		computed = 0;
+		for (i = 0; i < word->count; i++)
+			computed |= word->op[i].kind == OP_JMP || word->op[i].kind == OP_JC;
+		if (computed) {
+			jit_emit(J, 1, 0xb8);                      /* mov eax, k + 1 */
+			jit_emit_u32(J, (k + 1) & 0xff);
+		}
+
+		leaves = 0;
+		for (i = 0; i < word->count; i++) {
+			next = dfpu17_jit_op(t, k, &word->op[i], dbl);
+			leaves |= next == JIT_LEAVES;
+		}
+
+		if (computed) {
+			jit_emit(J, 8, 0x0f, 0xb6, 0xc0, 0x45, 0x39, 0xf5, 0x0f, 0x83); /* movzx eax, al; cmp r13d, r14d; jae */
+			dfpu17_jit_fixup(t, JT_EXIT, 0);
+			jit_emit(J, 3, 0x48, 0x8d, 0x0d);          /* lea rcx, table */
+			dfpu17_jit_fixup(t, JT_TABLE, 0);
+			jit_emit(J, 3, 0xff, 0x24, 0xc1);          /* jmp [rcx + rax * 8] */
+		} else if (!leaves && k == 255) {
+			dfpu17_jit_jump(t, 0);
+		}
+	}
+
+	for (k = 0; k < 256; k++) {
+		t->resume[k] = J->len;
+		jit_emit(J, 1, 0xc6);                          /* mov byte [pc], k */
+		dfpu17_jit_rbx(t, 0, OFF(pc));
+		jit_emit(J, 2, k, 0xe9);                       /* jmp epilogue */
+		dfpu17_jit_fixup(t, JT_EPILOGUE, 0);
+	}
+
+	t->exit = J->len;
+	jit_emit(J, 1, 0x88);                              /* mov [pc], al */
+	dfpu17_jit_rbx(t, 0, OFF(pc));
+
+	t->epilogue = J->len;
+	jit_emit(J, 7, 0x44, 0x89, 0xe8, 0x48, 0x83, 0xc4, 0x08); /* mov eax, r13d; add rsp, 8 */
+	jit_emit(J, 11, 0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5d, 0x5b, 0xc3);
+
+	while (J->len % 8 != 0)
+		jit_emit(J, 1, 0xcc);
+	t->table = J->len;
+	for (k = 0; k < 256; k++)
+		jit_emit_u64(J, (u64)(size_t)(J->code + t->word[k]));
+
+	for (i = 0; i < t->nfixups; i++) {
+		f = &t->fixups[i];
+		switch (f->target) {
+		case JT_WORD:     to = t->word[f->index];   break;
+		case JT_RESUME:   to = t->resume[f->index]; break;
+		case JT_EXIT:     to = t->exit;             break;
+		case JT_EPILOGUE: to = t->epilogue;         break;
+		default:          to = t->table;            break;
+		}
+		jit_patch_u32(J, f->at, (u32)(to - (f->at + 4)));
+	}
+
+	code = jit_seal(J);
+	memcpy(&native, &code, sizeof native);
+	return native;
+}
+
+#undef IREG_AT
+#undef OFF
+#undef J
+
 #endif
-				IREG[A]--;
-				if (IREG[A] != 0)
-					PC = B;
-				return;
-			case 0x1: /* jc @a,$b */
-				if (IREG[A] == 0)
-					PC = B;
-				return;
-			case 0x2: /* set @a,$b */
-				IREG[A] = B;
-				return;
-			case 0x3: /* cmp @a,$b */
-				if (IREG[A] > B)
-					IREG[A] = 1;
-				else if (IREG[A] < B)
-					IREG[A] = -1;
-				else
-					IREG[A] = 0;
-				return;
-				throw("dfpu17opcode", "out of range");
-			}
-#undef B
-#undef A
-#define A ((instruction >> 8) & 0xf)
-#define B ((instruction >> 0) & 0xff)
-		case 0x2: /* ld %,$ */
-			if (PREC == PREC_HALF)
-				HREG[A] = HMEM[B];
-			else if (PREC == PREC_SINGLE)
-				SREG[A] = SMEM[B];
-			else
-				DREG[A] = DMEM[B];
-			return;
-		case 0x3: /* st %,$ */
-			if (PREC == PREC_HALF)
-				HMEM[B] = HREG[A];
-			else if (PREC == PREC_SINGLE)
-				SMEM[B] = SREG[A];
-			else
-				DMEM[B] = DREG[A];
-			return;
-#undef B
-#undef A
-		case 0x4: /* %,% and % ops */
-			switch ((instruction >> 11) & 0x1) {
-			case 0x0:
-#define A ((instruction >> 0) & 0xf)
-				switch ((instruction >> 8) & 0x7) {
-				case 0x0:
-					switch ((instruction >> 4) & 0xf) {
-					case 0x0: /* sin %a */
-						UNARYOP(sin(a), A);
-						return;
-					case 0x1: /* cos %a */
-						UNARYOP(cos(a), A);
-						return;
-					case 0x2: /* tan %a */
-						UNARYOP(tan(a), A);
-						return;
-					case 0x3: /* asin %a */
-						UNARYOP(asin(a), A);
-						return;
-					case 0x4: /* acos %a */
-						UNARYOP(acos(a), A);
-						return;
-					case 0x5: /* atan %a */
-						UNARYOP(atan(a), A);
-						return;
-					case 0x6: /* sqrt %a */
-						UNARYOP(sqrt(a), A);
-						return;
-					case 0x7: /* rnd %a */
-						UNARYOP(round(a), A);
-						return;
-					case 0x8: /* log10 %a */
-						UNARYOP(log10(a), A);
-						return;
-					case 0x9: /* log2 %a */
-						UNARYOP(log2(a), A);
-						return;
-					case 0xa: /* log %a */
-						UNARYOP(log(a), A);
-						return;
-					case 0xb: /* [unassigned] */
-						throw("dfpu17opcode", "out of range");
-					case 0xc: /* abs %a */
-						UNARYOP(fabs(a), A);
-						return;
-					default:  /* [unassigned] */
-						throw("dfpu17opcode", "out of range");
-					}
-				case 0x1:
-					switch ((instruction >> 4) & 0xf) {
-					case 0x0: /* ldz %a */
-						UNARYOP(0.0, A);
-						return;
-					case 0x1: /* ld1 %a */
-						UNARYOP(1.0, A);
-						return;
-					case 0x2: /* ldpi %a */
-						UNARYOP(M_PI, A);
-						return;
-					case 0x3: /* lde %a */
-						UNARYOP(M_E, A);
-						return;
-					case 0x4: /* ldsr2 %a */
-						UNARYOP(sqrt(2.0), A);
-						return;
-					case 0x5: /* ldphi %a */
-						UNARYOP(1.6180339887498948482, A);
-						return;
-					case 0x6: /* [unassigned] */
-						throw("dfpu17opcode", "out of range");
-					case 0x7: /* [unassigned] */
-						throw("dfpu17opcode", "out of range");
-					case 0x8: /* ldl2e %a */
-						UNARYOP(log2(M_E), A);
-						return;
-					case 0x9: /* ldl2x %a */
-						UNARYOP(log2(10.0), A);
-						return;
-					case 0xa: /* ldlg2 %a */
-						UNARYOP(log10(2), A);
-						return;
-					case 0xb: /* ldln2 */
-						UNARYOP(log(2), A);
-						return;
-					default:  /* [unassigned] */
-						throw("dfpu17opcode", "out of range");
-					}
-				default: /* [unassigned] */
-					throw("dfpu17opcode", "out of range");
-				}
-#undef A
-			case 0x1:
-#define R ((instruction >> 0) & 0xf)
-#define S ((instruction >> 4) & 0xf)
-				switch ((instruction >> 8) & 0x7) {
-				case 0x0: /* mov %r,%s */
-					BINOP(s, R, S);
-					return;
-				case 0x1: /* xchg %r,%s */
-					if (PREC == PREC_HALF)
-						SWAP(HREG[R], HREG[S]);
-					else if (PREC == PREC_SINGLE)
-						SWAP(SREG[R], SREG[S]);
-					else
-						SWAP(DREG[R], DREG[S]);
-					return;
-				case 0x2: /* add %r,%s */
-					BINOP(r + s, R, S);
-					return;
-				case 0x3: /* mul %r,%s */
-					BINOP(r * s, R, S);
-					return;
-				case 0x4: /* sub %r,%s */
-					BINOP(r - s, R, S);
-					return;
-				case 0x5: /* rsub %r,%s */
-					BINOP(s - r, R, S);
-					return;
-				case 0x6: /* div %r,%s */
-					BINOP(r / s, R, S);
-					return;
-				case 0x7: /* rdiv %r,%s */
-					BINOP(s / r, R, S);
-					return;
-				}
-#undef S
-#undef R
-			}
-		case 0x5: /* comparisons */
-#define A ((instruction >> 0) & 0xf)
-#define B ((instruction >> 4) & 0xf)
-#define C ((instruction >> 8) & 0x3)
-			switch ((instruction >> 10) & 0x3) {
-			case 0x0: /* lt @c,%a,%b */
-				IREG[C] = CMP(<, A, B);
-				return;
-			case 0x1: /* gt @c,%a,%b */
-				IREG[C] = CMP(>, A, B);
-				return;
-			case 0x2: /* eq @c,%a,%b */
-				IREG[C] = CMP(==, A, B);
-				return;
-			case 0x3: /* ne @c,%a,%b */
-				IREG[C] = CMP(!=, A, B);
-				return;
+
+/**
+ * the native code to run a job with, or NULL to interpret it. the
+ * text mustn't change under a translation, so a job started while it
+ * is still being loaded is interpreted.
+ */
+static dfpu17_native *dfpu17_translation(struct hardware *hw)
+{
+	struct dfpu17_translation *t = dfpu17_get(hw->device, translation);
+
+	if (t == NULL || PREC == PREC_HALF
+	    || dfpu17_get(hw->device, loadstatus) == LOADSTATUS_LOADING_TEXT)
+		return NULL;
+
+#ifdef DFPU17_JIT
+	if (t->native == NULL)
+		t->native = dfpu17_translate(t, hw->device);
+	return t->native;
+#else
+	return NULL;
+#endif
+}
+
+static void *dfpu17_worker(void *arg)
+{
+	struct dfpu17_worker *worker = arg;
+	struct hardware *hw = &worker->hw;
+	dfpu17_native *native;
+	int steps, cancel;
+
+	pthread_mutex_lock(&worker->lock);
+	for (;;) {
+		while (!worker->quit && (!worker->busy || worker->done))
+			pthread_cond_wait(&worker->wake, &worker->lock);
+		if (worker->quit)
+			break;
+		native = worker->native;
+		pthread_mutex_unlock(&worker->lock);
+
+		feclearexcept(FE_ALL_EXCEPT);
+		steps = 0;
+		cancel = 0;
+		while (worker->stop == NULL && !cancel) {
+			if (native != NULL) {
+				steps += native(hw->device->data, hw, DFPU17_WORKER_BATCH);
+			} else {
+				dfpu17_execute(hw, NULL);
+				if (++steps % DFPU17_WORKER_BATCH != 0)
+					continue;
 			}
-#undef C
-#undef B
-#undef A
-#define A ((instruction >> 0) & 0xf)
-#define B ((instruction >> 4) & 0xf)
-#define C ((instruction >> 8) & 0xf)
-		case 0x6: /* atan %a,%y,%x */
-			if (PREC == PREC_HALF)
-				HREG[A] = atan2(HREG[B], HREG[C]);
-			else if (PREC == PREC_SINGLE)
-				SREG[A] = atan2(SREG[B], SREG[C]);
-			else
-				DREG[A] = atan2(DREG[B], DREG[C]);
-			return;
-		case 0x7: /* fma  %a,%b,%c*/
-			if (PREC == PREC_HALF)
-				HREG[A] = fma(HREG[A], HREG[B], HREG[C]);
-			else if (PREC == PREC_SINGLE)
-				SREG[A] = fma(SREG[A], SREG[B], SREG[C]);
-			else
-				DREG[A] = fma(DREG[A], DREG[B], DREG[C]);
-			return;
-#undef C
-#undef B
-#undef A
+
+			pthread_mutex_lock(&worker->lock);
+			worker->steps = steps;
+			cancel = worker->cancel;
+			pthread_cond_broadcast(&worker->progress);
+			pthread_mutex_unlock(&worker->lock);
 		}
 
-#if 0
-	} else {
-		fprintf(stderr, "((instruction >> 12) & 0xf) == 0x%04x\n",
-			(instruction >> 12) & 0xf);
-		fprintf(stderr, "((instruction >> 11) & 0x1) == 0x%04x\n",
-			(instruction >> 11) & 0x1);
-		fprintf(stderr, "((instruction >> 8) & 0x7) == 0x%04x\n",
-			(instruction >> 8) & 0x7);
-		fprintf(stderr, "invalid instruction: 0x%04x @ 0x%04x\n", instruction, 0);
-		fprintf(stderr, "what");
+		worker->fpexcept |= dfpu17_fpexcept();
+
+		pthread_mutex_lock(&worker->lock);
+		worker->steps = steps;
+		worker->done = 1;
+		pthread_cond_broadcast(&worker->progress);
+	}
+	pthread_mutex_unlock(&worker->lock);
+
+	return NULL;
+}
+
+/* fpexcept is what the job has already raised, if it's being carried on */
+static void dfpu17_submit(struct hardware *hw, u16 fpexcept)
+{
+	struct dfpu17_worker *worker = dfpu17_get(hw->device, worker);
+	dfpu17_native *native = dfpu17_translation(hw);
+
+	pthread_mutex_lock(&worker->lock);
+	worker->native = native;
+	worker->busy = 1;
+	worker->done = 0;
+	worker->cancel = 0;
+	worker->start = dfpu17_get(hw->device, ticks);
+	worker->steps = 0;
+	worker->stop = NULL;
+	worker->fpexcept = fpexcept;
+	pthread_cond_signal(&worker->wake);
+	pthread_mutex_unlock(&worker->lock);
+}
+
+static void dfpu17_publish(struct hardware *hw, struct dcpu *dcpu)
+{
+	struct dfpu17_worker *worker = dfpu17_get(hw->device, worker);
+
+	pthread_mutex_lock(&worker->lock);
+	worker->busy = 0;
+	pthread_mutex_unlock(&worker->lock);
+
+	if (worker->stop != NULL && worker->stop->kind == OP_DEBUG) {
+		dfpu17_debug(hw, worker->stop);
+		dfpu17_submit(hw, worker->fpexcept);
+	} else if (worker->stop != NULL) {
+		dfpu17_finish(hw, dcpu, worker->stop, worker->fpexcept);
+	}
+}
+
+/**
+ * publish the job if it has finished by the current tick. unless wait
+ * is set this doesn't block, so a job still being run is left alone;
+ * with wait set it blocks until the worker is far enough along to say.
+ */
+static void dfpu17_observe(struct hardware *hw, struct dcpu *dcpu, int wait)
+{
+	struct dfpu17_worker *worker = dfpu17_get(hw->device, worker);
+	int finished;
+
+	if (worker == NULL || !worker->busy)
+		return;
+
+	pthread_mutex_lock(&worker->lock);
+	while (wait && !worker->done && worker->steps <= dfpu17_get(hw->device, ticks) - worker->start)
+		pthread_cond_wait(&worker->progress, &worker->lock);
+	finished = worker->done && dfpu17_get(hw->device, ticks) - worker->start >= worker->steps;
+	pthread_mutex_unlock(&worker->lock);
+
+	if (finished)
+		dfpu17_publish(hw, dcpu);
+}
+
+/**
+ * wait for the job and publish it now. commands that would change what
+ * the job is working on do this first, so they take effect after it. a
+ * job stopped by a debug op is handed back, so it's waited for again.
+ */
+static void dfpu17_sync(struct hardware *hw, struct dcpu *dcpu)
+{
+	struct dfpu17_worker *worker = dfpu17_get(hw->device, worker);
+
+	while (worker != NULL && worker->busy) {
+		pthread_mutex_lock(&worker->lock);
+		while (!worker->done)
+			pthread_cond_wait(&worker->progress, &worker->lock);
+		pthread_mutex_unlock(&worker->lock);
+
+		dfpu17_publish(hw, dcpu);
+	}
+}
+
+/**
+ * abandon the job. a job that never stops can only be ended this way,
+ * and where it is abandoned depends on how far the worker had got.
+ */
+static void dfpu17_cancel(struct hardware *hw)
+{
+	struct dfpu17_worker *worker = dfpu17_get(hw->device, worker);
+
+	if (worker == NULL || !worker->busy)
+		return;
+
+	pthread_mutex_lock(&worker->lock);
+	worker->cancel = 1;
+	while (!worker->done)
+		pthread_cond_wait(&worker->progress, &worker->lock);
+	worker->busy = 0;
+	pthread_mutex_unlock(&worker->lock);
+}
+
+void dfpu17_set_worker(struct device *device)
+{
+	struct dfpu17_worker *worker;
+
+	if (dfpu17_get(device, worker) != NULL)
+		return;
+
+	worker = emalloc(sizeof *worker);
+	worker->hw.device = device;
+	worker->busy = 0;
+	worker->done = 0;
+	worker->cancel = 0;
+	worker->quit = 0;
+	worker->start = 0;
+	worker->steps = 0;
+	worker->stop = NULL;
+	worker->fpexcept = 0;
+	worker->native = NULL;
+	pthread_mutex_init(&worker->lock, NULL);
+	pthread_cond_init(&worker->wake, NULL);
+	pthread_cond_init(&worker->progress, NULL);
+
+	if (pthread_create(&worker->thread, NULL, &dfpu17_worker, worker)) {
+		fprintf(stderr, "Couldn't start DFPU-17 worker thread\n");
 		abort();
 	}
+
+	dfpu17_get(device, worker) = worker;
+}
+
+void dfpu17_set_jit(struct device *device)
+{
+	dfpu17_set_worker(device);
+
+#ifdef DFPU17_JIT
+	if (dfpu17_get(device, translation) == NULL) {
+		struct dfpu17_translation *t = emalloc(sizeof *t);
+		t->jit = jit_alloc(DFPU17_JIT_SIZE);
+		t->native = NULL;
+		dfpu17_get(device, translation) = t;
+	}
 #endif
-	/* all possible cases are covered above */
-	abort();
+}
+
+/**
+ * copy a whole block between the dcpu's ram and the device. the block
+ * normally lies within ram, but an unaligned address can make it wrap.
+ */
+static void dfpu17_transfer_block(struct hardware *hw, struct dcpu *dcpu, u16 base, u16 size)
+{
+	u16 *device_mem;
+	u16 i;
+
+	switch (dfpu17_get(hw->device, loadstatus)) {
+	case LOADSTATUS_LOADING_TEXT:
+		device_mem = TEXT;
+		break;
+	case LOADSTATUS_LOADING_DATA:
+	case LOADSTATUS_STORING_DATA:
+		device_mem = DATA;
+		break;
+	default:
+		return;
+	}
+
+	if ((u32)base + size <= 0x10000) {
+		if (dfpu17_get(hw->device, loadstatus) == LOADSTATUS_STORING_DATA)
+			memcpy(dcpu->ram + base, device_mem, size * sizeof(u16));
+		else
+			memcpy(device_mem, dcpu->ram + base, size * sizeof(u16));
+		return;
+	}
+
+	for (i = 0; i < size; i++) {
+		if (dfpu17_get(hw->device, loadstatus) == LOADSTATUS_STORING_DATA)
+			dcpu->ram[(u16)(base + i)] = device_mem[i];
+		else
+			device_mem[i] = dcpu->ram[(u16)(base + i)];
+	}
+}
+
+/**
+ * burst mode: the transfer moves one word per tick, as in word mode, but
+ * nothing is copied until the tick it completes. until then the count
+ * shows the words remaining, as it would in word mode.
+ */
+static void dfpu17_burst(struct hardware *hw, struct dcpu *dcpu)
+{
+	int remaining = dfpu17_get(hw->device, loaddeadline) - dfpu17_get(hw->device, ticks);
+
+	if (remaining > 0) {
+		if (remaining < COUNT)
+			COUNT = remaining;
+		return;
+	}
+
+	dfpu17_transfer_block(hw, dcpu,
+		dfpu17_get(hw->device, loadbase),
+		dfpu17_get(hw->device, loadsize));
+	if (dfpu17_get(hw->device, loadstatus) == LOADSTATUS_LOADING_TEXT)
+		dfpu17_compile(hw->device, 0, dfpu17_get(hw->device, loadsize));
+
+	PTR -= COUNT;
+	COUNT = 0;
+	dfpu17_get(hw->device, loadstatus) = LOADSTATUS_NONE;
+}
+
+static void dfpu17_start_transfer(struct hardware *hw, u8 loadstatus, u16 base, u16 size)
+{
+	dfpu17_get(hw->device, loadbase) = base;
+	dfpu17_get(hw->device, loadsize) = size;
+	dfpu17_get(hw->device, loaddeadline) = dfpu17_get(hw->device, ticks) + size;
+	dfpu17_get(hw->device, loadptr) = base + size;
+	dfpu17_get(hw->device, loadcount) = size;
+	dfpu17_get(hw->device, loadstatus) = loadstatus;
+}
+
+/* start running TEXT on the primary bank, on the worker if there is one */
+static void dfpu17_start(struct hardware *hw)
+{
+	dfpu17_get(hw->device, status) = STATUS_RUNNING;
+	if (dfpu17_get(hw->device, worker) != NULL)
+		dfpu17_submit(hw, 0);
+	else
+		feclearexcept(FE_ALL_EXCEPT);
+}
+
+static void dfpu17_end_batch(struct hardware *hw, struct dcpu *dcpu)
+{
+	dfpu17_get(hw->device, batching) = 0;
+	if (dfpu17_get(hw->device, mode) == MODE_INT)
+		dfpu17_enqueue_interrupt(hw->device, dcpu);
+}
+
+/**
+ * move the batch along once nothing is being transferred. the
+ * descriptors are read from ram as each transfer starts.
+ */
+static void dfpu17_batch(struct hardware *hw, struct dcpu *dcpu)
+{
+	struct dfpu17_worker *worker = dfpu17_get(hw->device, worker);
+	u16 table = dfpu17_get(hw->device, batchtable);
+	u16 count = dfpu17_get(hw->device, batchcount);
+	u16 started = dfpu17_get(hw->device, batchstarted);
+	u16 loaded = dfpu17_get(hw->device, batchloaded);
+	u16 stored = dfpu17_get(hw->device, batchstored);
+
+	if (!dfpu17_get(hw->device, batching) || COUNT != 0)
+		return;
+
+	/* the secondary bank's work while the primary is busy */
+	if (started > 0 && stored < started - 1) {
+		dfpu17_start_transfer(hw, LOADSTATUS_STORING_DATA,
+			dcpu->ram[(u16)(table + 2 * stored + 1)], 512);
+		dfpu17_get(hw->device, batchstored)++;
+		return;
+	}
+	if (loaded < count && loaded < started + 1) {
+		dfpu17_start_transfer(hw, LOADSTATUS_LOADING_DATA,
+			dcpu->ram[(u16)(table + 2 * loaded)], 512);
+		dfpu17_get(hw->device, batchloaded)++;
+		return;
+	}
+
+	if (dfpu17_get(hw->device, status) == STATUS_RUNNING || (worker != NULL && worker->busy))
+		return;
+
+	/* a failed job ends the batch, with its output left on the device */
+	if (started > 0 && dfpu17_get(hw->device, error) == ERROR_FAIL) {
+		dfpu17_end_batch(hw, dcpu);
+		return;
+	}
+
+	if (started < count) {
+		dfpu17_swap_buffers(hw->device);
+		PC = 0;
+		dfpu17_get(hw->device, batchstarted)++;
+		dfpu17_start(hw);
+	} else if (stored < count) {
+		/* the last job's output */
+		dfpu17_swap_buffers(hw->device);
+		dfpu17_start_transfer(hw, LOADSTATUS_STORING_DATA,
+			dcpu->ram[(u16)(table + 2 * stored + 1)], 512);
+		dfpu17_get(hw->device, batchstored)++;
+	} else {
+		dfpu17_end_batch(hw, dcpu);
+	}
+}
+
+void dfpu17_set_dma(struct device *device, int dmamode)
+{
+	dfpu17_get(device, dmamode) = dmamode;
 }
 
 void dfpu17_cycle(struct hardware *hw, u16 *dirty, struct dcpu *dcpu)
@@ -696,6 +1681,7 @@ void dfpu17_cycle(struct hardware *hw, u16 *dirty, struct dcpu *dcpu)
 
 	if (dfpu17_get(hw->device, mode) == MODE_OFF)
 		return;
+	dfpu17_get(hw->device, ticks)++;
 
 #if 0
 	fprintf(stderr, "FPU: status=%d error=%d loadstatus=%d count=%d loadptr=0x%04x\n",
@@ -705,16 +1691,23 @@ void dfpu17_cycle(struct hardware *hw, u16 *dirty, struct dcpu *dcpu)
 			COUNT, PTR);
 #endif
 
-	if (dfpu17_get(hw->device, status) == STATUS_RUNNING)
+	/* while a job is out with the worker, transfers can only go ahead
+	 * once it's known whether the job has finished by this cycle */
+	if (dfpu17_get(hw->device, worker) != NULL && dfpu17_get(hw->device, worker)->busy)
+		dfpu17_observe(hw, dcpu, COUNT != 0);
+	else if (dfpu17_get(hw->device, status) == STATUS_RUNNING)
 		dfpu17_execute(hw, dcpu);
 
-	if (COUNT != 0) {
+	if (COUNT != 0 && dfpu17_get(hw->device, dmamode) == DFPU17_DMA_BURST) {
+		dfpu17_burst(hw, dcpu);
+	} else if (COUNT != 0) {
 		switch (dfpu17_get(hw->device, loadstatus)) {
 		case LOADSTATUS_NONE:
 			COUNT = 0;
 			break;
 		case LOADSTATUS_LOADING_TEXT:
 			TEXT[--COUNT] = dcpu->ram[--PTR];
+			dfpu17_compile(hw->device, COUNT, 1);
 			break;
 		case LOADSTATUS_LOADING_DATA:
 			DATA[--COUNT] = dcpu->ram[--PTR];
@@ -726,6 +1719,8 @@ void dfpu17_cycle(struct hardware *hw, u16 *dirty, struct dcpu *dcpu)
 		if (COUNT == 0)
 			dfpu17_get(hw->device, loadstatus) = 0;
 	}
+
+	dfpu17_batch(hw, dcpu);
 #if 0
 	fprintf(stderr, "status=%d, loadstatus=%d, error=%d\n",
 		dfpu17_get(hw->device, status),
@@ -734,11 +1729,46 @@ void dfpu17_cycle(struct hardware *hw, u16 *dirty, struct dcpu *dcpu)
 #endif
 }
 
+/* off, or on with nothing running, transferring or batched */
+static int dfpu17_quiet(struct hardware *hw)
+{
+	struct dfpu17_worker *worker = dfpu17_get(hw->device, worker);
+
+	if (dfpu17_get(hw->device, mode) == MODE_OFF)
+		return 1;
+	return dfpu17_get(hw->device, status) != STATUS_RUNNING
+	    && (worker == NULL || !worker->busy)
+	    && COUNT == 0
+	    && !dfpu17_get(hw->device, batching);
+}
+
 void dfpu17_interrupt(struct hardware *hw, struct dcpu *dcpu)
 {
+	/* a job or burst that has completed by now must be visible to this
+	 * command */
+	dfpu17_observe(hw, dcpu, 1);
+	if (COUNT != 0 && dfpu17_get(hw->device, dmamode) == DFPU17_DMA_BURST)
+		dfpu17_burst(hw, dcpu);
+
+	/* a batch has the device to itself until it's done */
+	if (dfpu17_get(hw->device, batching)) {
+		switch (dcpu->registers[5]) {
+		case SET_MODE:
+		case GET_STATUS:
+		case SET_INTERRUPT_MESSAGE:
+			break;
+		default:
+			return;
+		}
+	}
+
 	switch (dcpu->registers[5]) {
 	case SET_MODE:
 		fprintf(stderr, "SET MODE TO %d\n", dcpu->registers[0]);
+		dfpu17_cancel(hw);
+		dfpu17_get(hw->device, batching) = 0;
+		dfpu17_get(hw->device, fpexcept) = 0;
+		dfpu17_get(hw->device, fpsticky) = 0;
 		if (dcpu->registers[0] == MODE_OFF) {
 			dfpu17_get(hw->device, mode) = MODE_OFF;
 			dfpu17_get(hw->device, status) = STATUS_OFF;
@@ -751,54 +1781,104 @@ void dfpu17_interrupt(struct hardware *hw, struct dcpu *dcpu)
 		break;
 	case SET_PREC:
 		fprintf(stderr, "SET PRECISION TO %d\n", dcpu->registers[0]);
+		dfpu17_sync(hw, dcpu);
 		dfpu17_get(hw->device, prec) = dcpu->registers[0];
+		dfpu17_bind(hw->device, 0, 256);
+		break;
+	case SET_ACCURACY:
+		fprintf(stderr, "SET ACCURACY TO %d\n", dcpu->registers[0]);
+		dfpu17_sync(hw, dcpu);
+		dfpu17_get(hw->device, accuracy) = dcpu->registers[0];
+		dfpu17_bind(hw->device, 0, 256);
 		break;
 	case GET_STATUS:
 		/* fprintf(stderr, "GET STATUS\n"); */
 		dcpu->registers[0] = (dfpu17_get(hw->device, loadstatus) << 8)
-			           | (dfpu17_get(hw->device, status)     << 0);
+			           | ((dfpu17_get(hw->device, batching) ? STATUS_RUNNING
+			               : dfpu17_get(hw->device, status)) << 0);
 		dcpu->registers[1] = dfpu17_get(hw->device, error);
-		dcpu->registers[2] = 0;
-		dcpu->registers[3] = 0;
+		dcpu->registers[2] = dfpu17_get(hw->device, fpexcept);
+		dcpu->registers[3] = dfpu17_get(hw->device, fpsticky);
+		dcpu->registers[4] = dfpu17_get(hw->device, batchstored);
 		break;
 	case LOAD_DATA:
 		fprintf(stderr, "LOAD DATA @ 0x%04x\n", dcpu->registers[0]);
-		dfpu17_get(hw->device, loadptr) = dcpu->registers[0] + 512;
-		dfpu17_get(hw->device, loadcount) = 512;
-		dfpu17_get(hw->device, loadstatus) = LOADSTATUS_LOADING_DATA;
+		dfpu17_start_transfer(hw, LOADSTATUS_LOADING_DATA, dcpu->registers[0], 512);
 		break;
 	case LOAD_TEXT:
 		fprintf(stderr, "LOAD TEXT @ 0x%04x\n", dcpu->registers[0]);
-		dfpu17_get(hw->device, loadptr) = dcpu->registers[0] + 256;
-		dfpu17_get(hw->device, loadcount) = 256;
-		dfpu17_get(hw->device, loadstatus) = LOADSTATUS_LOADING_TEXT;
+		dfpu17_sync(hw, dcpu);
+		dfpu17_start_transfer(hw, LOADSTATUS_LOADING_TEXT, dcpu->registers[0], 256);
 		break;
 	case GET_DATA:
 		fprintf(stderr, "GET DATA @ 0x%04x\n", dcpu->registers[0]);
-		dfpu17_get(hw->device, loadptr) = dcpu->registers[0] + 512;
-		dfpu17_get(hw->device, loadcount) = 512;
-		dfpu17_get(hw->device, loadstatus) = LOADSTATUS_STORING_DATA;
+		dfpu17_start_transfer(hw, LOADSTATUS_STORING_DATA, dcpu->registers[0], 512);
 		break;
 	case EXECUTE:
 		fprintf(stderr, "EXECUTE\n");
+		dfpu17_sync(hw, dcpu);
 		if (dfpu17_get(hw->device, mode) == MODE_OFF) {
 			break;
 		} else if (dfpu17_get(hw->device, mode) == MODE_INT) {
 			dfpu17_swap_buffers(hw->device);
 		}
-		dfpu17_get(hw->device, status) = STATUS_RUNNING;
+		dfpu17_start(hw);
 		break;
 	case SWAP_BUFFERS:
 		fprintf(stderr, "SWAP BUFFERS\n");
+		dfpu17_sync(hw, dcpu);
 		dfpu17_swap_buffers(hw->device);
 		break;
 	case SET_INTERRUPT_MESSAGE:
 		fprintf(stderr, "SET INTERRUPT MESSAGE TO %d\n", dcpu->registers[0]);
 		dfpu17_get(hw->device, intrmsg) = dcpu->registers[0];
 		break;
+	case EXECUTE_BATCH:
+		fprintf(stderr, "EXECUTE BATCH OF %d @ 0x%04x\n", dcpu->registers[1], dcpu->registers[0]);
+		dfpu17_sync(hw, dcpu);
+		if (dfpu17_get(hw->device, mode) == MODE_OFF)
+			break;
+		dfpu17_get(hw->device, batching) = 1;
+		dfpu17_get(hw->device, batchtable) = dcpu->registers[0];
+		dfpu17_get(hw->device, batchcount) = dcpu->registers[1];
+		dfpu17_get(hw->device, batchstarted) = 0;
+		dfpu17_get(hw->device, batchloaded) = 0;
+		dfpu17_get(hw->device, batchstored) = 0;
+		dfpu17_get(hw->device, error) = ERROR_NONE;
+		dfpu17_batch(hw, dcpu);
+		break;
 	}
 }
 
+static void dfpu17_destroy(struct device *device)
+{
+	struct dfpu17_worker *worker = dfpu17_get(device, worker);
+	struct dfpu17_translation *translation = dfpu17_get(device, translation);
+
+	if (worker != NULL) {
+		/* a job that's running is abandoned, like one that never stops */
+		dfpu17_cancel(&worker->hw);
+
+		pthread_mutex_lock(&worker->lock);
+		worker->quit = 1;
+		pthread_cond_signal(&worker->wake);
+		pthread_mutex_unlock(&worker->lock);
+		pthread_join(worker->thread, NULL);
+
+		pthread_mutex_destroy(&worker->lock);
+		pthread_cond_destroy(&worker->wake);
+		pthread_cond_destroy(&worker->progress);
+		free(worker);
+	}
+
+	if (translation != NULL) {
+		jit_free(translation->jit);
+		free(translation);
+	}
+
+	free(device);
+}
+
 struct device *make_dfpu17(struct dcpu *dcpu)
 {
 	char *data = emalloc(sizeof(struct device) + sizeof(struct device_dfpu17));
@@ -808,6 +1888,7 @@ struct device *make_dfpu17(struct dcpu *dcpu)
 	struct device_dfpu17 d17 = {
 		MODE_OFF,
 		PREC_SINGLE,
+		ACCURACY_EXACT,
 		STATUS_OFF,
 		ERROR_NONE,
 		0x0000,
@@ -818,7 +1899,9 @@ struct device *make_dfpu17(struct dcpu *dcpu)
 		{0x00, 0x00, 0x00, 0x00},
 		0x00,
 		0x00,
-		{0},
+		{{0}},
+		{{{0}}, {{0}}},
+		0,
 		{0},
 	};
 
@@ -829,6 +1912,9 @@ struct device *make_dfpu17(struct dcpu *dcpu)
 		NULL,
 		&dfpu17_interrupt,
 		&dfpu17_cycle,
+		&dfpu17_destroy,
+		DEVICE_TICKS | DEVICE_INTERRUPTS,
+		&dfpu17_quiet
 	};
 
 	d.data = dfpu17;
@@ -836,6 +1922,10 @@ struct device *make_dfpu17(struct dcpu *dcpu)
 	*dfpu17 = d17;
 	*device = d;
 
+	dfpu17_get(device, vlen) = 256;
+	dfpu17_get(device, vstride) = 1;
+	dfpu17_compile(device, 0, 256);
+
 	/* don't need to use this */
 	(void)dcpu;
 
@@ -0,0 +1,230 @@
+#define _GNU_SOURCE
+#include <math.h>
+#include <tgmath.h>
+#include <stdint.h>
+
+#include "types.h"
+#include "dfpu17_vector.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define DFPU17_VECTOR_X86
+#endif
+
+/* partial results kept by a reduction; see docs/dfpu17.txt */
+#define DFPU17_REDUCE_LANES 8
+
+#define KERNEL_W          f32
+#define KERNEL_SCALAR(x)  dfpu17_##x##_scalar_f32
+#include "dfpu17_vector_kernel.h"
+
+#define KERNEL_W          f64
+#define KERNEL_SCALAR(x)  dfpu17_##x##_scalar_f64
+#include "dfpu17_vector_kernel.h"
+
+#ifdef DFPU17_VECTOR_X86
+
+/* SSE and SSE2 are always there on x86-64 */
+#define KERNEL_W          f32
+#define KERNEL_NAME(x)    dfpu17_##x##_sse_f32
+#define KERNEL_SCALAR(x)  dfpu17_##x##_scalar_f32
+#define KERNEL_TARGET
+#define KERNEL_V          __m128
+#define KERNEL_LANES      4
+#define KERNEL_LOADU      _mm_loadu_ps
+#define KERNEL_STOREU     _mm_storeu_ps
+#define KERNEL_SET1       _mm_set1_ps
+#define KERNEL_ADD        _mm_add_ps
+#define KERNEL_SUB        _mm_sub_ps
+#define KERNEL_MUL        _mm_mul_ps
+#define KERNEL_DIV        _mm_div_ps
+#define KERNEL_MIN        _mm_min_ps
+#define KERNEL_MAX        _mm_max_ps
+#define KERNEL_AND        _mm_and_ps
+#define KERNEL_LT         _mm_cmplt_ps
+#define KERNEL_GT         _mm_cmpgt_ps
+#define KERNEL_EQ         _mm_cmpeq_ps
+#define KERNEL_NE         _mm_cmpneq_ps
+#include "dfpu17_vector_kernel.h"
+
+#define KERNEL_W          f64
+#define KERNEL_NAME(x)    dfpu17_##x##_sse_f64
+#define KERNEL_SCALAR(x)  dfpu17_##x##_scalar_f64
+#define KERNEL_TARGET
+#define KERNEL_V          __m128d
+#define KERNEL_LANES      2
+#define KERNEL_LOADU      _mm_loadu_pd
+#define KERNEL_STOREU     _mm_storeu_pd
+#define KERNEL_SET1       _mm_set1_pd
+#define KERNEL_ADD        _mm_add_pd
+#define KERNEL_SUB        _mm_sub_pd
+#define KERNEL_MUL        _mm_mul_pd
+#define KERNEL_DIV        _mm_div_pd
+#define KERNEL_MIN        _mm_min_pd
+#define KERNEL_MAX        _mm_max_pd
+#define KERNEL_AND        _mm_and_pd
+#define KERNEL_LT         _mm_cmplt_pd
+#define KERNEL_GT         _mm_cmpgt_pd
+#define KERNEL_EQ         _mm_cmpeq_pd
+#define KERNEL_NE         _mm_cmpneq_pd
+#include "dfpu17_vector_kernel.h"
+
+#define KERNEL_W          f32
+#define KERNEL_NAME(x)    dfpu17_##x##_avx_f32
+#define KERNEL_SCALAR(x)  dfpu17_##x##_scalar_f32
+#define KERNEL_TARGET     __attribute__((target("avx")))
+#define KERNEL_ZEROUPPER  _mm256_zeroupper
+#define KERNEL_V          __m256
+#define KERNEL_LANES      8
+#define KERNEL_LOADU      _mm256_loadu_ps
+#define KERNEL_STOREU     _mm256_storeu_ps
+#define KERNEL_SET1       _mm256_set1_ps
+#define KERNEL_ADD        _mm256_add_ps
+#define KERNEL_SUB        _mm256_sub_ps
+#define KERNEL_MUL        _mm256_mul_ps
+#define KERNEL_DIV        _mm256_div_ps
+#define KERNEL_MIN        _mm256_min_ps
+#define KERNEL_MAX        _mm256_max_ps
+#define KERNEL_AND        _mm256_and_ps
+#define KERNEL_LT(x, y)   _mm256_cmp_ps((x), (y), _CMP_LT_OQ)
+#define KERNEL_GT(x, y)   _mm256_cmp_ps((x), (y), _CMP_GT_OQ)
+#define KERNEL_EQ(x, y)   _mm256_cmp_ps((x), (y), _CMP_EQ_OQ)
+#define KERNEL_NE(x, y)   _mm256_cmp_ps((x), (y), _CMP_NEQ_UQ)
+#include "dfpu17_vector_kernel.h"
+
+#define KERNEL_W          f64
+#define KERNEL_NAME(x)    dfpu17_##x##_avx_f64
+#define KERNEL_SCALAR(x)  dfpu17_##x##_scalar_f64
+#define KERNEL_TARGET     __attribute__((target("avx")))
+#define KERNEL_ZEROUPPER  _mm256_zeroupper
+#define KERNEL_V          __m256d
+#define KERNEL_LANES      4
+#define KERNEL_LOADU      _mm256_loadu_pd
+#define KERNEL_STOREU     _mm256_storeu_pd
+#define KERNEL_SET1       _mm256_set1_pd
+#define KERNEL_ADD        _mm256_add_pd
+#define KERNEL_SUB        _mm256_sub_pd
+#define KERNEL_MUL        _mm256_mul_pd
+#define KERNEL_DIV        _mm256_div_pd
+#define KERNEL_MIN        _mm256_min_pd
+#define KERNEL_MAX        _mm256_max_pd
+#define KERNEL_AND        _mm256_and_pd
+#define KERNEL_LT(x, y)   _mm256_cmp_pd((x), (y), _CMP_LT_OQ)
+#define KERNEL_GT(x, y)   _mm256_cmp_pd((x), (y), _CMP_GT_OQ)
+#define KERNEL_EQ(x, y)   _mm256_cmp_pd((x), (y), _CMP_EQ_OQ)
+#define KERNEL_NE(x, y)   _mm256_cmp_pd((x), (y), _CMP_NEQ_UQ)
+#include "dfpu17_vector_kernel.h"
+
+/* the same again with FMA3, which is only used for DFPU17_VFMA */
+#define KERNEL_W          f32
+#define KERNEL_NAME(x)    dfpu17_##x##_fma_f32
+#define KERNEL_SCALAR(x)  dfpu17_##x##_scalar_f32
+#define KERNEL_TARGET     __attribute__((target("avx,fma")))
+#define KERNEL_ZEROUPPER  _mm256_zeroupper
+#define KERNEL_V          __m256
+#define KERNEL_LANES      8
+#define KERNEL_LOADU      _mm256_loadu_ps
+#define KERNEL_STOREU     _mm256_storeu_ps
+#define KERNEL_SET1       _mm256_set1_ps
+#define KERNEL_ADD        _mm256_add_ps
+#define KERNEL_SUB        _mm256_sub_ps
+#define KERNEL_MUL        _mm256_mul_ps
+#define KERNEL_DIV        _mm256_div_ps
+#define KERNEL_MIN        _mm256_min_ps
+#define KERNEL_MAX        _mm256_max_ps
+#define KERNEL_AND        _mm256_and_ps
+#define KERNEL_LT(x, y)   _mm256_cmp_ps((x), (y), _CMP_LT_OQ)
+#define KERNEL_GT(x, y)   _mm256_cmp_ps((x), (y), _CMP_GT_OQ)
+#define KERNEL_EQ(x, y)   _mm256_cmp_ps((x), (y), _CMP_EQ_OQ)
+#define KERNEL_NE(x, y)   _mm256_cmp_ps((x), (y), _CMP_NEQ_UQ)
+#define KERNEL_FMADD      _mm256_fmadd_ps
+#include "dfpu17_vector_kernel.h"
+
+#define KERNEL_W          f64
+#define KERNEL_NAME(x)    dfpu17_##x##_fma_f64
+#define KERNEL_SCALAR(x)  dfpu17_##x##_scalar_f64
+#define KERNEL_TARGET     __attribute__((target("avx,fma")))
+#define KERNEL_ZEROUPPER  _mm256_zeroupper
+#define KERNEL_V          __m256d
+#define KERNEL_LANES      4
+#define KERNEL_LOADU      _mm256_loadu_pd
+#define KERNEL_STOREU     _mm256_storeu_pd
+#define KERNEL_SET1       _mm256_set1_pd
+#define KERNEL_ADD        _mm256_add_pd
+#define KERNEL_SUB        _mm256_sub_pd
+#define KERNEL_MUL        _mm256_mul_pd
+#define KERNEL_DIV        _mm256_div_pd
+#define KERNEL_MIN        _mm256_min_pd
+#define KERNEL_MAX        _mm256_max_pd
+#define KERNEL_AND        _mm256_and_pd
+#define KERNEL_LT(x, y)   _mm256_cmp_pd((x), (y), _CMP_LT_OQ)
+#define KERNEL_GT(x, y)   _mm256_cmp_pd((x), (y), _CMP_GT_OQ)
+#define KERNEL_EQ(x, y)   _mm256_cmp_pd((x), (y), _CMP_EQ_OQ)
+#define KERNEL_NE(x, y)   _mm256_cmp_pd((x), (y), _CMP_NEQ_UQ)
+#define KERNEL_FMADD      _mm256_fmadd_pd
+#include "dfpu17_vector_kernel.h"
+
+#define HAVE_AVX (__builtin_cpu_supports("avx"))
+#define HAVE_FMA (__builtin_cpu_supports("avx") && __builtin_cpu_supports("fma"))
+
+#endif
+
+void dfpu17_vector_f32(int op, f32 *d, const f32 *a, const f32 *b, int n)
+{
+#ifdef DFPU17_VECTOR_X86
+	if (op == DFPU17_VFMA && HAVE_FMA)
+		dfpu17_vector_fma_f32(op, d, a, b, n);
+	else if (HAVE_AVX)
+		dfpu17_vector_avx_f32(op, d, a, b, n);
+	else
+		dfpu17_vector_sse_f32(op, d, a, b, n);
+#else
+	dfpu17_vector_scalar_f32(op, d, a, b, 0, n);
+#endif
+}
+
+void dfpu17_vector_f64(int op, f64 *d, const f64 *a, const f64 *b, int n)
+{
+#ifdef DFPU17_VECTOR_X86
+	if (op == DFPU17_VFMA && HAVE_FMA)
+		dfpu17_vector_fma_f64(op, d, a, b, n);
+	else if (HAVE_AVX)
+		dfpu17_vector_avx_f64(op, d, a, b, n);
+	else
+		dfpu17_vector_sse_f64(op, d, a, b, n);
+#else
+	dfpu17_vector_scalar_f64(op, d, a, b, 0, n);
+#endif
+}
+
+f32 dfpu17_reduce_f32(int op, const f32 *a, const f32 *b, int n)
+{
+#ifdef DFPU17_VECTOR_X86
+	if (HAVE_AVX)
+		return dfpu17_reduce_avx_f32(op, a, b, n);
+	return dfpu17_reduce_sse_f32(op, a, b, n);
+#else
+	f32 lanes[DFPU17_REDUCE_LANES];
+	int j;
+
+	for (j = 0; j < DFPU17_REDUCE_LANES; j++)
+		lanes[j] = dfpu17_identity_scalar_f32(op);
+	return dfpu17_reduce_scalar_f32(op, lanes, a, b, 0, n);
+#endif
+}
+
+f64 dfpu17_reduce_f64(int op, const f64 *a, const f64 *b, int n)
+{
+#ifdef DFPU17_VECTOR_X86
+	if (HAVE_AVX)
+		return dfpu17_reduce_avx_f64(op, a, b, n);
+	return dfpu17_reduce_sse_f64(op, a, b, n);
+#else
+	f64 lanes[DFPU17_REDUCE_LANES];
+	int j;
+
+	for (j = 0; j < DFPU17_REDUCE_LANES; j++)
+		lanes[j] = dfpu17_identity_scalar_f64(op);
+	return dfpu17_reduce_scalar_f64(op, lanes, a, b, 0, n);
+#endif
+}
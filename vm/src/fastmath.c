@@ -0,0 +1,313 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "types.h"
+#include "fastmath.h"
+
+/*
+ * sin, cos and tan reduce their argument by the nearest multiple n of
+ * pi/2, using pi/2 split into 25 and 53 bits so that n times the first
+ * part is exact. the reduced argument r is within pi/4 of zero, and the
+ * polynomials below are minimax fits over that interval, good to about
+ * 2^-37 relative. arguments past 2^28 are rare enough to leave to libm.
+ */
+#define FAST_TOINT   6755399441055744.0 /* 1.5 * 2^52 */
+#define FAST_BIG     268435456.0        /* 2^28 */
+#define FAST_PIO2    1.57079632679489655800
+#define FAST_PI      3.14159265358979311600
+#define FAST_INVPIO2 6.36619772367581382433e-01
+#define FAST_PIO2_1  1.57079631090164184570e+00
+#define FAST_PIO2_1T 1.58932547735281966916e-08
+#define FAST_LN2     6.93147180559945286227e-01
+#define FAST_INVLN2  1.44269504088896338700e+00
+#define FAST_INVLN10 4.34294481903251816668e-01
+
+/*
+ * the polynomials for sin(r) / r and cos(r) in z = r^2. they share the
+ * form 1 + z P(z), so each quadrant only picks a row and a factor.
+ */
+static const f64 fast_sincos[2][4] = {
+	{
+		-0.166666666416265235595,
+		 0.0083333293858894631756,
+		-0.000198393348360966317347,
+		 0.0000027183114939898219064
+	}, {
+		-0.499999997251031003120,
+		 0.0416666233237390631894,
+		-0.00138867637746099294692,
+		 0.0000243904487962774090654
+	}
+};
+
+static const f64 fast_t[6] = {
+	0.333331395030791399758,
+	0.133392002712976742718,
+	0.0533812378445670393523,
+	0.0245283181166547278873,
+	0.00297435743359967304927,
+	0.00946564784943673166728
+};
+
+static f64 fast_tan_kernel(f64 r, int odd)
+{
+	f64 z = r * r, w = z * z, s = z * r;
+	f64 u = fast_t[0] + z * fast_t[1];
+	f64 t = fast_t[2] + z * fast_t[3];
+	f64 v = fast_t[4] + z * fast_t[5];
+
+	v = (r + s * u) + (s * w) * (t + w * v);
+	return odd ? -1.0 / v : v;
+}
+
+static int fast_reduce(f64 x, f64 *r)
+{
+	f64 n = x * FAST_INVPIO2 + FAST_TOINT - FAST_TOINT;
+
+	*r = x - n * FAST_PIO2_1 - n * FAST_PIO2_1T;
+	return (int)n;
+}
+
+/*
+ * sin(x) is plus or minus sin(r) or cos(r) by the quadrant. rather than
+ * branch on it, which would mispredict on most arguments, the quadrant
+ * indexes the polynomial and the sign. cos(x) is sin(x + pi/2).
+ */
+static const f64 fast_quadrant_sign[4] = {1.0, 1.0, -1.0, -1.0};
+
+static f32 fast_sin_quadrant(f32 x, int quadrant)
+{
+	const f64 *p;
+	f64 r, a[2], z, w;
+	int n;
+
+	n = fast_reduce(x, &r) + quadrant;
+	p = fast_sincos[n & 1];
+	a[0] = r;
+	a[1] = 1.0;
+	z = r * r;
+	w = z * z;
+	return (f32)(fast_quadrant_sign[n & 3] * a[n & 1]
+		* (1.0 + z * ((p[0] + z * p[1]) + w * (p[2] + z * p[3]))));
+}
+
+f32 fast_sin(f32 x)
+{
+	if (x != x)
+		return x + x;
+	if (!(fabs(x) <= FAST_BIG))
+		return (f32)sin(x);
+	return fast_sin_quadrant(x, 0);
+}
+
+f32 fast_cos(f32 x)
+{
+	if (x != x)
+		return x + x;
+	if (!(fabs(x) <= FAST_BIG))
+		return (f32)cos(x);
+	return fast_sin_quadrant(x, 1);
+}
+
+f32 fast_tan(f32 x)
+{
+	f64 r;
+	int n;
+
+	if (x != x)
+		return x + x;
+	if (!(fabs(x) <= FAST_BIG))
+		return (f32)tan(x);
+
+	n = fast_reduce(x, &r);
+	return (f32)fast_tan_kernel(r, n & 1);
+}
+
+/*
+ * asin(x) is x + x R(x^2) for |x| below a half, R being a rational
+ * fit, and is taken from asin(sqrt((1 - |x|) / 2)) above that.
+ */
+static f64 fast_asin_r(f64 z)
+{
+	f64 p = z * (1.6666586697e-01 + z * (-4.2743422091e-02 + z * -8.6563630030e-03));
+	f64 q = 1.0 + z * -7.0662963390e-01;
+
+	return p / q;
+}
+
+f32 fast_asin(f32 x)
+{
+	f64 a = fabs(x), s;
+
+	if (x != x)
+		return x + x;
+	if (!(a <= 1.0))
+		return (x - x) / (x - x);
+
+	if (a < 0.5)
+		return (f32)(x + x * fast_asin_r((f64)x * x));
+
+	s = sqrt((1.0 - a) * 0.5);
+	s = FAST_PIO2 - 2.0 * (s + s * fast_asin_r((1.0 - a) * 0.5));
+	return (f32)(x < 0 ? -s : s);
+}
+
+f32 fast_acos(f32 x)
+{
+	f64 a = fabs(x), s;
+
+	if (x != x)
+		return x + x;
+	if (!(a <= 1.0))
+		return (x - x) / (x - x);
+
+	if (a < 0.5)
+		return (f32)(FAST_PIO2 - (x + x * fast_asin_r((f64)x * x)));
+
+	s = sqrt((1.0 - a) * 0.5);
+	s = 2.0 * (s + s * fast_asin_r((1.0 - a) * 0.5));
+	return (f32)(x < 0 ? FAST_PI - s : s);
+}
+
+/*
+ * atan reduces |x| to at most one by taking its reciprocal, then picks
+ * the nearest eighth c from the table and sums atan(c) and the series
+ * for atan((x - c) / (1 + xc)), whose argument is under 1/16.
+ */
+static const f64 fast_atan_table[9] = {
+	0,
+	0.12435499454676144,
+	0.24497866312686414,
+	0.35877067027057225,
+	0.46364760900080609,
+	0.55859931534356244,
+	0.64350110879328437,
+	0.71882999962162453,
+	0.78539816339744828
+};
+
+f32 fast_atan(f32 x)
+{
+	f64 a = fabs(x), c, u, z, r;
+	int inv, i;
+
+	if (x != x)
+		return x + x;
+
+	inv = a > 1.0;
+	if (inv)
+		a = 1.0 / a;
+
+	i = (int)(a * 8.0 + 0.5);
+	c = i * 0.125;
+	u = (a - c) / (1.0 + a * c);
+	z = u * u;
+	r = fast_atan_table[i] + u * (1.0 + z * (-1.0 / 3 + z * (1.0 / 5 + z * (-1.0 / 7))));
+
+	if (inv)
+		r = FAST_PIO2 - r;
+	return (f32)(x < 0 ? -r : r);
+}
+
+/*
+ * the logarithms split x into 2^e m, with m in [0.75, 1.5), and take
+ * the top five bits of m's mantissa to pick c, the middle of the 64th
+ * or 32nd of that range m is in, except that c is 1 either side of 1.
+ * the table has 1/c and log(c) for that 1/c as rounded, and log(m/c),
+ * with m/c - 1 in [-1/64, 1/32], is a fit to log1p good to 2^-25.
+ */
+static const f64 fast_log_table[32][2] = {
+	{1.3195876288659794, -0.27731928541623435},
+	{1.292929292929293, -0.25691041378502733},
+	{1.2673267326732673, -0.23690974707835774},
+	{1.2427184466019416, -0.21730127568998131},
+	{1.2190476190476192, -0.19806991376209387},
+	{1.1962616822429906, -0.17920142945771092},
+	{1.1743119266055047, -0.16068238169047352},
+	{1.1531531531531531, -0.14250006260728301},
+	{1.1327433628318584, -0.12464244520727659},
+	{1.1130434782608696, -0.10709813555636712},
+	{1.0940170940170941, -0.089856329121861145},
+	{1.0756302521008403, -0.072906770808087731},
+	{1.0578512396694215, -0.056239718322876109},
+	{1.0406504065040652, -0.039845908547199778},
+	{1.024, -0.023716526617316065},
+	{1, 0},
+	{1, 0},
+	{0.95522388059701491, 0.045809536031294222},
+	{0.92753623188405798, 0.075223421237587518},
+	{0.90140845070422537, 0.10379679368164355},
+	{0.87671232876712324, 0.13157635778871932},
+	{0.85333333333333339, 0.15860503017663852},
+	{0.83116883116883122, 0.18492233849401193},
+	{0.810126582278481, 0.21056476910734964},
+	{0.79012345679012341, 0.23556607131276697},
+	{0.77108433734939763, 0.25995752443692599},
+	{0.75294117647058822, 0.28376817313064462},
+	{0.73563218390804597, 0.30702503529491187},
+	{0.7191011235955056, 0.32975328637246804},
+	{0.70329670329670335, 0.35197642315717809},
+	{0.68817204301075274, 0.373716409793584},
+	{0.67368421052631577, 0.39499380824086899}
+};
+
+static const f64 fast_log1p[3] = {
+	-0.50000053795036048,
+	 0.33337868854308328,
+	-0.2454392930032083
+};
+
+/* log(x), as f64 */
+static f64 fast_log_kernel(f32 x)
+{
+	u32 bits, t;
+	f32 m;
+	f64 r, z;
+	int e = 0;
+
+	memcpy(&bits, &x, sizeof bits);
+	if (bits - 0x800000 >= 0x7f800000 - 0x800000) {
+		/* zero, subnormal, negative, infinity or NaN */
+		if (x != x || x == (f32)HUGE_VAL)
+			return x + x;
+		else if (x == 0)
+			return -1.0 / (x * x);
+		else if (x < 0)
+			return (x - x) / (x - x);
+
+		/* subnormal: make it normal */
+		x *= 8388608.0f;
+		memcpy(&bits, &x, sizeof bits);
+		e = -23;
+	}
+
+	/* 0x3f400000 is 0.75; moving it to 2^30 leaves the exponent of x
+	 * relative to it in the top bits */
+	bits += 0x40000000 - 0x3f400000;
+	e += (int)(bits >> 23) - 128;
+	t = bits & 0x7fffff;
+	bits = 0x3f400000 + t;
+	memcpy(&m, &bits, sizeof m);
+
+	t >>= 18;
+	r = m * fast_log_table[t][0] - 1.0;
+	z = r * r;
+	return e * FAST_LN2 + fast_log_table[t][1] + r
+	     + z * (fast_log1p[0] + r * fast_log1p[1] + z * fast_log1p[2]);
+}
+
+f32 fast_log(f32 x)
+{
+	return (f32)fast_log_kernel(x);
+}
+
+f32 fast_log2(f32 x)
+{
+	return (f32)(fast_log_kernel(x) * FAST_INVLN2);
+}
+
+f32 fast_log10(f32 x)
+{
+	return (f32)(fast_log_kernel(x) * FAST_INVLN10);
+}
@@ -0,0 +1,118 @@
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "types.h"
+#include "utils.h"
+#include "dcpu.h"
+#include "libdcpu.h"
+#include "genclock.h"
+
+enum genclock_command {
+	SET_RATE,
+	GET_TICKS,
+	SET_INTERRUPT
+};
+
+struct device_genclock {
+	struct dcpu_event tick;
+	u16 rate;       /* sixtieths of a second a tick, or 0 if it's off */
+	u16 ticks;      /* since the rate was set */
+	u16 message;    /* or 0 for no interrupts */
+
+	/* sixtieths of a cycle the ticks so far have fallen behind */
+	int remainder;
+};
+
+#define genclock_get(value, member) get_member_of(struct device_genclock, (value), member)
+
+/**
+ * when the next tick is due. the clock rate isn't a multiple of 60, so
+ * each tick is the whole cycles of rate/60 seconds and the fractions
+ * are carried, to keep the ticks exact over any run.
+ */
+static void genclock_schedule(struct device *device, struct dcpu *dcpu, int from)
+{
+	int rate = genclock_get(device, rate);
+	int period = rate * (DCPU_CLOCKRATE / 60);
+
+	genclock_get(device, remainder) += rate * (DCPU_CLOCKRATE % 60);
+	period += genclock_get(device, remainder) / 60;
+	genclock_get(device, remainder) %= 60;
+
+	dcpu_schedule(dcpu, &genclock_get(device, tick), from + period);
+}
+
+static void genclock_tick(struct dcpu *dcpu, struct dcpu_event *event)
+{
+	struct device *device = event->data;
+
+	genclock_get(device, ticks)++;
+	if (genclock_get(device, message) != 0)
+		dcpu_interrupt(dcpu, genclock_get(device, message));
+	genclock_schedule(device, dcpu, event->at);
+}
+
+static void genclock_interrupt(struct hardware *hw, struct dcpu *dcpu)
+{
+	switch (dcpu->registers[0]) {
+	case SET_RATE:
+		genclock_get(hw->device, rate) = dcpu->registers[1];
+		genclock_get(hw->device, ticks) = 0;
+		genclock_get(hw->device, remainder) = 0;
+		if (dcpu->registers[1] == 0)
+			dcpu_cancel(dcpu, &genclock_get(hw->device, tick));
+		else
+			genclock_schedule(hw->device, dcpu, dcpu->cycles);
+		break;
+	case GET_TICKS:
+		dcpu->registers[2] = genclock_get(hw->device, ticks);
+		break;
+	case SET_INTERRUPT:
+		genclock_get(hw->device, message) = dcpu->registers[1];
+		break;
+	}
+}
+
+/* its tick goes with the dcpu, which is only ever destroyed with it */
+static void genclock_destroy(struct device *device)
+{
+	free(device);
+}
+
+struct device *make_genclock(struct dcpu *dcpu)
+{
+	char *data = emalloc(sizeof(struct device) + sizeof(struct device_genclock));
+	struct device *device = (struct device *)data;
+	struct device_genclock *genclock = (struct device_genclock *)(data + sizeof(struct device));
+
+	(void)dcpu;
+
+	{
+		struct device_genclock d = {{0}};
+		*genclock = d;
+	}
+
+	{
+		struct device d = {
+			0x12d0b402,
+			0x0001,
+			0x90099009,
+			NULL,
+			&genclock_interrupt,
+			NULL,
+			&genclock_destroy,
+			DEVICE_INTERRUPTS,
+			NULL
+		};
+		d.data = genclock;
+
+		*device = d;
+	}
+
+	genclock->tick.fire = &genclock_tick;
+	genclock->tick.data = device;
+	return device;
+}
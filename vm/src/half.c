@@ -0,0 +1,224 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "types.h"
+#include "half.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HALF_X86
+#endif
+
+f32 f16_to_f32_soft(f16 h)
+{
+	u32 sign = (u32)(h & 0x8000) << 16;
+	u32 exp = (h >> 10) & 0x1f;
+	u32 mant = h & 0x3ff;
+	u32 bits;
+	f32 f;
+
+	if (exp == 0x1f) {
+		/* infinity or NaN, quietened as F16C does */
+		bits = sign | 0x7f800000 | (mant ? 0x400000 | (mant << 13) : 0);
+	} else if (exp != 0) {
+		bits = sign | ((exp + 112) << 23) | (mant << 13);
+	} else if (mant == 0) {
+		bits = sign;
+	} else {
+		/* subnormal: normalise it, as f32 has the range */
+		exp = 113;
+		while (!(mant & 0x400)) {
+			mant <<= 1;
+			exp--;
+		}
+		bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+	}
+
+	memcpy(&f, &bits, sizeof f);
+	return f;
+}
+
+f16 f32_to_f16_soft(f32 f)
+{
+	u32 bits, sign, mant, m, rem, half, h;
+	int exp, shift;
+
+	memcpy(&bits, &f, sizeof bits);
+	sign = (bits >> 16) & 0x8000;
+	exp = (bits >> 23) & 0xff;
+	mant = bits & 0x7fffff;
+
+	if (exp == 0xff)
+		return sign | 0x7c00 | (mant ? 0x200 | (mant >> 13) : 0);
+
+	/* the exponent rebiased for binary16 */
+	exp -= 112;
+
+	if (exp >= 0x1f)
+		return sign | 0x7c00;
+
+	if (exp >= 1) {
+		/* a carry out of the mantissa goes into the exponent,
+		 * and from the largest finite value to infinity */
+		h = ((u32)exp << 10) | (mant >> 13);
+		rem = mant & 0x1fff;
+		if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+			h++;
+		return sign | h;
+	}
+
+	/* f32 subnormals and anything under half the least subnormal */
+	if (exp < -10)
+		return sign;
+
+	m = mant | 0x800000;
+	shift = 14 - exp;
+	h = m >> shift;
+	rem = m & ((1UL << shift) - 1);
+	half = 1UL << (shift - 1);
+	if (rem > half || (rem == half && (h & 1)))
+		h++;
+	return sign | h;
+}
+
+#ifdef HALF_X86
+
+#define HAVE_F16C (__builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c"))
+
+__attribute__((target("f16c"))) static f32 f16_to_f32_f16c(f16 h)
+{
+	return _cvtsh_ss(h);
+}
+
+__attribute__((target("f16c"))) static f16 f32_to_f16_f16c(f32 f)
+{
+	return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+}
+
+__attribute__((target("avx,f16c"))) static void f16_to_f32_n_f16c(f32 *out, const f16 *in, int n)
+{
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(in + i))));
+	for (; i < n; i++)
+		out[i] = _cvtsh_ss(in[i]);
+}
+
+__attribute__((target("avx,f16c"))) static void f32_to_f16_n_f16c(f16 *out, const f32 *in, int n)
+{
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm_storeu_si128((__m128i *)(out + i),
+			_mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+	for (; i < n; i++)
+		out[i] = _cvtss_sh(in[i], _MM_FROUND_TO_NEAREST_INT);
+}
+
+#endif
+
+f32 f16_to_f32(f16 h)
+{
+#ifdef HALF_X86
+	if (HAVE_F16C)
+		return f16_to_f32_f16c(h);
+#endif
+	return f16_to_f32_soft(h);
+}
+
+f16 f32_to_f16(f32 f)
+{
+#ifdef HALF_X86
+	if (HAVE_F16C)
+		return f32_to_f16_f16c(f);
+#endif
+	return f32_to_f16_soft(f);
+}
+
+void f16_to_f32_n(f32 *out, const f16 *in, int n)
+{
+	int i;
+
+#ifdef HALF_X86
+	if (HAVE_F16C) {
+		f16_to_f32_n_f16c(out, in, n);
+		return;
+	}
+#endif
+	for (i = 0; i < n; i++)
+		out[i] = f16_to_f32_soft(in[i]);
+}
+
+void f32_to_f16_n(f16 *out, const f32 *in, int n)
+{
+	int i;
+
+#ifdef HALF_X86
+	if (HAVE_F16C) {
+		f32_to_f16_n_f16c(out, in, n);
+		return;
+	}
+#endif
+	for (i = 0; i < n; i++)
+		out[i] = f32_to_f16_soft(in[i]);
+}
+
+/**
+ * hi + lo, where lo is too small to change hi, rounded to binary16 once.
+ * it is narrowed to f32 first rounding to odd: an inexact result keeps
+ * its last bit set, so it can't land on a binary16 tie that the exact
+ * value wasn't on, and f32 has bits enough to round to nearest
+ * correctly from there.
+ */
+static f16 f16_round(f64 hi, f64 lo)
+{
+	f32 f;
+	f64 below;
+	u32 bits;
+
+	/* halfway between the largest half, 65504, and 65536 rounds up */
+	if (hi > 65520.0 || (hi == 65520.0 && lo >= 0))
+		return 0x7c00;
+	if (hi < -65520.0 || (hi == -65520.0 && lo <= 0))
+		return 0xfc00;
+
+	f = (f32)hi;
+
+	/* hi - f is exact, and the sum is exact or of the right sign */
+	below = (hi - f) + lo;
+	memcpy(&bits, &f, sizeof bits);
+	if (below != 0 && !(bits & 1)) {
+		/* towards the exact value, to the odd neighbour */
+		if ((below > 0) == !(bits & 0x80000000))
+			bits++;
+		else
+			bits--;
+		memcpy(&f, &bits, sizeof f);
+	}
+	return f32_to_f16(f);
+}
+
+f16 f64_to_f16(f64 d)
+{
+	/* NaNs are left to the conversion, which quietens them */
+	if (d != d)
+		return f32_to_f16((f32)d);
+	return f16_round(d, 0.0);
+}
+
+f16 f16_fma(f16 a, f16 b, f16 c)
+{
+	/* the product of two halves is exact in a double; only the sum rounds */
+	f64 p = (f64)f16_to_f32(a) * f16_to_f32(b);
+	f64 z = f16_to_f32(c);
+	f64 s = p + z, t, lo;
+
+	if (s - s != 0)
+		return f32_to_f16((f32)s);
+
+	/* the sum's rounding error, exactly (Knuth's two-sum) */
+	t = s - p;
+	lo = (p - (s - t)) + (z - t);
+	return f16_round(s, lo);
+}
@@ -0,0 +1,95 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "types.h"
+#include "utils.h"
+#include "jit.h"
+
+struct jit *jit_alloc(size_t cap)
+{
+	struct jit *jit = emalloc(sizeof *jit);
+
+	jit->code = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (jit->code == MAP_FAILED) {
+		fprintf(stderr, "Unable to map %lu bytes for code: %s\n", (unsigned long)cap, strerror(errno));
+		abort();
+	}
+	jit->len = 0;
+	jit->cap = cap;
+
+	return jit;
+}
+
+void jit_free(struct jit *jit)
+{
+	munmap(jit->code, jit->cap);
+	free(jit);
+}
+
+static void jit_protect(struct jit *jit, int prot)
+{
+	if (mprotect(jit->code, jit->cap, prot)) {
+		fprintf(stderr, "Unable to change the protection of code: %s\n", strerror(errno));
+		abort();
+	}
+}
+
+void jit_reset(struct jit *jit)
+{
+	jit_protect(jit, PROT_READ | PROT_WRITE);
+	jit->len = 0;
+}
+
+void *jit_seal(struct jit *jit)
+{
+	jit_protect(jit, PROT_READ | PROT_EXEC);
+	return jit->code;
+}
+
+static void jit_byte(struct jit *jit, u8 b)
+{
+	if (jit->len == jit->cap) {
+		fprintf(stderr, "Generated code doesn't fit in %lu bytes\n", (unsigned long)jit->cap);
+		abort();
+	}
+	jit->code[jit->len++] = b;
+}
+
+void jit_emit(struct jit *jit, int n, ...)
+{
+	va_list ap;
+
+	va_start(ap, n);
+	while (n-- > 0)
+		jit_byte(jit, va_arg(ap, int));
+	va_end(ap);
+}
+
+void jit_emit_u32(struct jit *jit, u32 x)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		jit_byte(jit, (x >> (8 * i)) & 0xff);
+}
+
+void jit_emit_u64(struct jit *jit, u64 x)
+{
+	jit_emit_u32(jit, x & 0xffffffff);
+	jit_emit_u32(jit, x >> 32);
+}
+
+void jit_patch_u32(struct jit *jit, size_t at, u32 x)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		jit->code[at + i] = (x >> (8 * i)) & 0xff;
+}
@@ -1,20 +1,24 @@
+#define _DEFAULT_SOURCE
+
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <setjmp.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 #include <SDL.h>
 
 #include "types.h"
 #include "utils.h"
-#include "exception.h"
 #include "dcpu.h"
+#include "libdcpu.h"
 #include "lem1802.h"
-
-struct farbfeld_data;
+#include "lem1802_capture.h"
+#include "lem1802_terminal.h"
 
 struct device_lem1802 {
 	u16 vramoff;    /* 386 words */
@@ -22,8 +26,33 @@ struct device_lem1802 {
 	u16 paletteoff; /* 16 words */
 	u8  bordercol;
 	SDL_Window *window;
-	int last_render_cycles;
 	int use_16bit_colour;
+
+	/**
+	 * the palette converted to host pixels. colours_valid is cleared
+	 * when the mapped palette memory is written to or remapped.
+	 */
+	struct farbfeld_pixel colours[16];
+	int colours_valid;
+
+	/* set when a command changes the mapping or the border colour */
+	int needs_redraw;
+
+	/**
+	 * presentation is paced by the wall clock, not by emulated cycles.
+	 * needs_present is set whenever the framebuffer is drawn to and
+	 * cleared when it is presented, so unchanged frames are never
+	 * presented and changes within one frame period are coalesced.
+	 */
+	int framerate;
+	int needs_present;
+	int last_blink;
+	struct timespec last_present;
+
+	/* without a window the screen is still drawn, e.g. for capture */
+	int show_window;
+	struct lem1802_capture *capture;
+	struct lem1802_terminal *terminal;
 	struct farbfeld_data *ffdat;
 };
 
@@ -114,25 +143,6 @@ const u16 lem1802_default_16bit_palette[] = {
 	0x52aa, 0x52bf, 0x57ea, 0x57ff, 0xfaaa, 0xfabf, 0xffea, 0xffff
 };
 
-struct farbfeld_pixel {
-	u8 r, g, b;
-};
-
-struct farbfeld_data {
-	u32 width;
-	u32 height;
-	struct farbfeld_pixel pixels[1];
-};
-
-#define LEM1802_FF_CELLWIDTH 4
-#define LEM1802_FF_CELLHEIGHT 8
-#define LEM1802_FF_ROWS 12
-#define LEM1802_FF_COLS 32
-#define LEM1802_FF_BORDERWIDTH 1
-#define LEM1802_FF_PIXWIDTH (LEM1802_FF_CELLWIDTH * LEM1802_FF_COLS + 2 * LEM1802_FF_BORDERWIDTH)
-#define LEM1802_FF_PIXHEIGHT (LEM1802_FF_CELLHEIGHT * LEM1802_FF_ROWS + 2 * LEM1802_FF_BORDERWIDTH)
-#define LEM1802_FF_PIXSIZE (sizeof(struct farbfeld_pixel) * LEM1802_FF_PIXWIDTH * LEM1802_FF_PIXHEIGHT)
-#define LEM1802_FF_SIZE (sizeof(struct farbfeld_data) + LEM1802_FF_PIXSIZE)
 #define LEM1802_SCALE_FACTOR 4
 
 static const struct farbfeld_data lem1802_ff_init = {
@@ -142,10 +152,9 @@ static const struct farbfeld_data lem1802_ff_init = {
 
 #define LEM1802_FF_INIT (lem1802_ff_init)
 
-void lem1802_write(const char *filename, struct farbfeld_data *ffdat)
+void lem1802_fwrite(FILE *f, const struct farbfeld_data *ffdat)
 {
 	size_t i;
-	FILE *f = fopen(filename, "wb");
 	u32 width = htonl(ffdat->width);
 	u32 height = htonl(ffdat->height);
 	u16 vals[4];
@@ -155,13 +164,20 @@ void lem1802_write(const char *filename, struct farbfeld_data *ffdat)
 	fwrite(&height, sizeof(u32), 1, f);
 
 	for (i = 0; i < ffdat->width * ffdat->height; i++) {
-		vals[0] = htons(ffdat->pixels[i].r);
-		vals[1] = htons(ffdat->pixels[i].g);
-		vals[2] = htons(ffdat->pixels[i].b);
+		/* farbfeld channels are 16 bits wide */
+		vals[0] = htons(ffdat->pixels[i].r * 0x101);
+		vals[1] = htons(ffdat->pixels[i].g * 0x101);
+		vals[2] = htons(ffdat->pixels[i].b * 0x101);
 		vals[3] = -1;
 		fwrite(&vals, sizeof(u16), 4, f);
 	}
+}
+
+void lem1802_write(const char *filename, struct farbfeld_data *ffdat)
+{
+	FILE *f = fopen(filename, "wb");
 
+	lem1802_fwrite(f, ffdat);
 	fclose(f);
 }
 
@@ -175,9 +191,9 @@ static struct farbfeld_pixel colour_16bit(const u16 *palette, u16 x)
 {
 	struct farbfeld_pixel p;
 
-	p.r = EXTEND_5_TO_BYTE((palette[(x) & 0xf] >> 11) & 0xf);
-	p.g = EXTEND_6_TO_BYTE((palette[(x) & 0xf] >> 5) & 0xf);
-	p.b = EXTEND_5_TO_BYTE((palette[(x) & 0xf] >> 0) & 0xf);
+	p.r = EXTEND_5_TO_BYTE((palette[(x) & 0xf] >> 11) & 0x1f);
+	p.g = EXTEND_6_TO_BYTE((palette[(x) & 0xf] >> 5) & 0x3f);
+	p.b = EXTEND_5_TO_BYTE((palette[(x) & 0xf] >> 0) & 0x1f);
 
 	return p;
 }
@@ -193,13 +209,25 @@ static struct farbfeld_pixel colour_12bit(const u16 *palette, u16 x)
 	return p;
 }
 
-#define COLOUR(x) (get_member_of(struct device_lem1802, hw->device, use_16bit_colour) \
-		    ? colour_16bit(palette, (x)) \
-		    : colour_12bit(palette, (x)))
+#define COLOUR(x) (colours[(x) & 0xf])
 
 void lem1802_render(struct farbfeld_pixel *pixels, SDL_Window *window);
 
-void lem1802_draw_char(struct hardware *hw, struct farbfeld_pixel *pixels, int i, int j, u16 vram, const u16 font[256], const u16 palette[16], int cycle)
+/**
+ * convert a palette into host pixels. this is done once when the palette
+ * changes rather than for every pixel drawn.
+ */
+void lem1802_palette(int use_16bit_colour, const u16 palette[16], struct farbfeld_pixel colours[16])
+{
+	u16 i;
+
+	for (i = 0; i < 16; i++)
+		colours[i] = use_16bit_colour
+		           ? colour_16bit(palette, i)
+		           : colour_12bit(palette, i);
+}
+
+void lem1802_draw_char(const struct farbfeld_pixel colours[16], struct farbfeld_pixel *pixels, int i, int j, u16 vram, const u16 font[256], int cycle)
 { 
 	int x, y;
 	u8 bg = (vram >> 8) & 0xf;
@@ -223,7 +251,7 @@ void lem1802_draw_char(struct hardware *hw, struct farbfeld_pixel *pixels, int i
 	}
 }
 
-void lem1802_draw(struct hardware *hw, struct farbfeld_pixel *pixels, const u16 vram[386], const u16 font[256], const u16 palette[16], u8 bordercol, int cycle)
+void lem1802_draw(const struct farbfeld_pixel colours[16], struct farbfeld_pixel *pixels, const u16 vram[384], const u16 font[256], u8 bordercol, int cycle)
 {
 	int i, j, k;
 
@@ -243,7 +271,7 @@ void lem1802_draw(struct hardware *hw, struct farbfeld_pixel *pixels, const u16
 
 	for (i = 0; i < LEM1802_FF_ROWS; i++) {
 		for (j = 0; j < LEM1802_FF_COLS; j++) {
-			lem1802_draw_char(hw, pixels, i, j, vram[i * LEM1802_FF_COLS + j], font, palette, cycle);
+			lem1802_draw_char(colours, pixels, i, j, vram[i * LEM1802_FF_COLS + j], font, cycle);
 		}
 	}
 }
@@ -320,7 +348,111 @@ void lem1802_render(struct farbfeld_pixel *pixels, SDL_Window *window)
 #undef COLOUR
 #undef PIXEL
 
-#define REFRESHRATE 100000 / 24
+#define LEM1802_FRAMERATE 60
+
+static double lem1802_diffclock(struct timespec b, struct timespec a)
+{
+	return (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1000000000.0;
+}
+
+/**
+ * present the framebuffer if a frame is pending and at least one frame
+ * period has passed since the last presentation. a framerate of zero
+ * or less presents every change immediately.
+ */
+static void lem1802_present(struct hardware *hw, const u16 *vram, const u16 *font, int cycle)
+{
+	struct device_lem1802 *lem1802 = hw->device->data;
+	struct timespec now;
+
+	if (!lem1802->needs_present)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	if (lem1802->framerate > 0
+	    && lem1802_diffclock(now, lem1802->last_present) * lem1802->framerate < 1.0)
+		return;
+
+	if (lem1802->window != NULL)
+		lem1802_render(lem1802->ffdat->pixels, lem1802->window);
+
+	if (lem1802->terminal != NULL)
+		lem1802_terminal_present(lem1802->terminal, vram, font,
+			lem1802->colours, lem1802->bordercol, cycle);
+
+	lem1802->last_present = now;
+	lem1802->needs_present = 0;
+}
+
+void lem1802_set_framerate(struct device *device, int framerate)
+{
+	get_member_of(struct device_lem1802, device, framerate) = framerate;
+}
+
+void lem1802_set_window(struct device *device, int show_window)
+{
+	get_member_of(struct device_lem1802, device, show_window) = show_window;
+}
+
+void lem1802_set_capture(struct device *device, const char *filename)
+{
+	struct device_lem1802 *lem1802 = device->data;
+	int framerate = lem1802->framerate > 0 ? lem1802->framerate : LEM1802_FRAMERATE;
+
+	lem1802->capture = lem1802_capture_open(filename, DCPU_CLOCKRATE / framerate);
+}
+
+void lem1802_set_terminal(struct device *device, int fd, int colours)
+{
+	get_member_of(struct device_lem1802, device, terminal) = lem1802_terminal_open(fd, colours);
+}
+
+void lem1802_close(struct device *device)
+{
+	struct device_lem1802 *lem1802 = device->data;
+
+	if (lem1802->terminal != NULL) {
+		lem1802_terminal_close(lem1802->terminal);
+		lem1802->terminal = NULL;
+	}
+
+	if (lem1802->capture != NULL) {
+		lem1802_capture_close(lem1802->capture);
+		lem1802->capture = NULL;
+	}
+}
+
+static SDL_Window *lem1802_create_window(void)
+{
+	static int sdl_initialised = 0;
+	SDL_Window *window;
+
+	if (!sdl_initialised) {
+		SDL_SetHint(SDL_HINT_NO_SIGNAL_HANDLERS, "1");
+
+		if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+			fprintf(stderr, "Couldn't initialise SDL: %s\n", SDL_GetError());
+			abort();
+		}
+
+		sdl_initialised = 1;
+	}
+
+	window = SDL_CreateWindow(
+			"LEM1802", 
+			SDL_WINDOWPOS_UNDEFINED, 
+			SDL_WINDOWPOS_UNDEFINED, 
+			LEM1802_SCALE_FACTOR * LEM1802_FF_PIXWIDTH, 
+			LEM1802_SCALE_FACTOR * LEM1802_FF_PIXHEIGHT, 
+			0);
+	if (window == NULL) {
+		fprintf(stderr, "Couldn't create window: %s\n", SDL_GetError());
+		abort();
+	}
+
+	return window;
+}
 
 void lem1802_cycle(struct hardware *hw, u16 *dirty, struct dcpu *dcpu)
 {
@@ -331,19 +463,32 @@ void lem1802_cycle(struct hardware *hw, u16 *dirty, struct dcpu *dcpu)
 	u16 fontoff = get_member_of(struct device_lem1802, hw->device, fontoff);
 	u16 paletteoff = get_member_of(struct device_lem1802, hw->device, paletteoff);
 	u8  bordercol = get_member_of(struct device_lem1802, hw->device, bordercol);
-	int *last_render_cycles = &get_member_of(struct device_lem1802, hw->device, last_render_cycles);
+	int use_16bit_colour = get_member_of(struct device_lem1802, hw->device, use_16bit_colour);
+	int *needs_present = &get_member_of(struct device_lem1802, hw->device, needs_present);
+	int *last_blink = &get_member_of(struct device_lem1802, hw->device, last_blink);
 	struct farbfeld_data **ffdat = &get_member_of(struct device_lem1802, hw->device, ffdat);
-	int is_cycle = (dcpu->cycles / 100000) % 2;
+	struct lem1802_capture *capture = get_member_of(struct device_lem1802, hw->device, capture);
+	int is_cycle = (dcpu->cycles / DCPU_CLOCKRATE) % 2;
+
+	int *colours_valid = &get_member_of(struct device_lem1802, hw->device, colours_valid);
+	int *needs_redraw = &get_member_of(struct device_lem1802, hw->device, needs_redraw);
+	const struct farbfeld_pixel *colours = get_member_of(struct device_lem1802, hw->device, colours);
 
 	/* whether the entire monitor needs to be redrawn */
-	int is_dirty = dirty != NULL && ((fontoff <= *dirty && *dirty < fontoff + 256)
-	                              || (paletteoff <= *dirty && *dirty < paletteoff + 16));
+	int is_dirty = dirty != NULL && fontoff != 0 && fontoff <= *dirty && *dirty < fontoff + 256;
+
+	if (dirty != NULL && paletteoff != 0 && paletteoff <= *dirty && *dirty < paletteoff + 16)
+		*colours_valid = 0;
 
 	if (vramoff == 0) {
-		if (WINDOW != NULL) {
+		if (*ffdat != NULL) {
 			fprintf(stderr, "Screen turned off\n");
 			free(*ffdat);
-			SDL_DestroyWindow(WINDOW);
+			*ffdat = NULL;
+			if (WINDOW != NULL)
+				SDL_DestroyWindow(WINDOW);
+			WINDOW = NULL;
+			*needs_present = 0;
 		}
 		return;
 	}
@@ -356,55 +501,74 @@ void lem1802_cycle(struct hardware *hw, u16 *dirty, struct dcpu *dcpu)
 		font = dcpu->ram + fontoff;
 
 	if (paletteoff == 0)
-		if (get_member_of(struct device_lem1802, hw->device, use_16bit_colour))
-			throw("use_16bit_colour", "unimplemented"); /* palette = lem1802_default_16bit_palette; */
+		if (use_16bit_colour)
+			palette = lem1802_default_16bit_palette;
 		else
 			palette = lem1802_default_12bit_palette;
 	else
 		palette = dcpu->ram + paletteoff;
 
-	if (WINDOW == NULL) {
+	if (!*colours_valid) {
+		lem1802_palette(use_16bit_colour, palette,
+			get_member_of(struct device_lem1802, hw->device, colours));
+		*colours_valid = 1;
+		is_dirty = 1;
+	}
+
+	if (*needs_redraw) {
+		*needs_redraw = 0;
+		is_dirty = 1;
+	}
+
+	if (*ffdat == NULL) {
 		fprintf(stderr, "Screen turned on\n");
 
 		*ffdat = emalloc(LEM1802_FF_SIZE);
 		**ffdat = LEM1802_FF_INIT;
 		memset((*ffdat)->pixels, 0, LEM1802_FF_PIXSIZE);
 
-		WINDOW = SDL_CreateWindow(
-				"LEM1802", 
-				SDL_WINDOWPOS_UNDEFINED, 
-				SDL_WINDOWPOS_UNDEFINED, 
-				LEM1802_SCALE_FACTOR * LEM1802_FF_PIXWIDTH, 
-				LEM1802_SCALE_FACTOR * LEM1802_FF_PIXHEIGHT, 
-				0);
-		if (WINDOW == NULL) {
-			fprintf(stderr, "Couldn't create window: %s\n", SDL_GetError());
-			abort();
-		}
+		if (get_member_of(struct device_lem1802, hw->device, show_window))
+			WINDOW = lem1802_create_window();
+
+		if (capture != NULL)
+			lem1802_capture_resync(capture, dcpu->cycles);
 
 		is_dirty = 1;
 	}
-	
+
+	/* blinking cells change appearance when the blink phase flips */
+	if (is_cycle != *last_blink) {
+		*last_blink = is_cycle;
+		is_dirty = 1;
+	}
+
 	if (is_dirty) {
 		/* the whole screen needs to be redrawn */
-		lem1802_draw(hw, (*ffdat)->pixels, vram, font, palette, bordercol, is_cycle);
+		lem1802_draw(colours, (*ffdat)->pixels, vram, font, bordercol, is_cycle);
+		*needs_present = 1;
 	} else if (dirty != NULL && vramoff <= *dirty && *dirty < vramoff + 384) {
 		/* just this one cell needs to be redrawn */
 		int i = (*dirty - vramoff) / LEM1802_FF_COLS;
 		int j = (*dirty - vramoff) % LEM1802_FF_COLS;
-		lem1802_draw_char(hw, (*ffdat)->pixels, i, j, vram[i * LEM1802_FF_COLS + j], font, palette, is_cycle);
+		lem1802_draw_char(colours, (*ffdat)->pixels, i, j, vram[i * LEM1802_FF_COLS + j], font, is_cycle);
+		*needs_present = 1;
 	}
 
-	if (dcpu->cycles - *last_render_cycles > REFRESHRATE) {
-		lem1802_render((*ffdat)->pixels, WINDOW);
-		*last_render_cycles = dcpu->cycles;
+	if (capture != NULL && lem1802_capture_due(capture, dcpu->cycles)) {
+		int flags = (use_16bit_colour ? LEM1802_CAPTURE_16BIT_COLOUR : 0)
+		          | (is_cycle ? LEM1802_CAPTURE_BLINK : 0);
+		lem1802_capture_frame(capture, dcpu->cycles, vram, font, palette, bordercol, flags, *ffdat);
 	}
 
+	lem1802_present(hw, vram, font, is_cycle);
+
 #undef WINDOW
 }
 
 void lem1802_interrupt(struct hardware *hw, struct dcpu *dcpu)
 {
+	get_member_of(struct device_lem1802, hw->device, needs_redraw) = 1;
+
 	switch (dcpu->registers[0]) {
 	case MEM_MAP_SCREEN:
 		get_member_of(struct device_lem1802, hw->device, vramoff)
@@ -417,6 +581,7 @@ void lem1802_interrupt(struct hardware *hw, struct dcpu *dcpu)
 	case MEM_MAP_PALETTE:
 		get_member_of(struct device_lem1802, hw->device, paletteoff)
 			= dcpu->registers[1];
+		get_member_of(struct device_lem1802, hw->device, colours_valid) = 0;
 		break;
 	case SET_BORDER_COLOUR:
 		get_member_of(struct device_lem1802, hw->device, bordercol)
@@ -425,6 +590,24 @@ void lem1802_interrupt(struct hardware *hw, struct dcpu *dcpu)
 	}
 }
 
+/* what it shows depends only on the cycle count and ram, so it can always catch up */
+static int lem1802_quiet(struct hardware *hw)
+{
+	(void)hw;
+	return 1;
+}
+
+static void lem1802_destroy(struct device *device)
+{
+	struct device_lem1802 *lem1802 = device->data;
+
+	lem1802_close(device);
+	if (lem1802->window != NULL)
+		SDL_DestroyWindow(lem1802->window);
+	free(lem1802->ffdat);
+	free(device);
+}
+
 struct device *make_lem1802(struct dcpu *dcpu)
 {
 	char *data = emalloc(sizeof(struct device) + sizeof(struct device_lem1802));
@@ -441,17 +624,14 @@ struct device *make_lem1802(struct dcpu *dcpu)
 		initial_vramoff = 0;
 	}
 
-	SDL_SetHint(SDL_HINT_NO_SIGNAL_HANDLERS, "1");
-
-	if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-		fprintf(stderr, "Couldn't initialise SDL: %s\n", SDL_GetError());
-		abort();
-	}
-
 	{
 		struct device_lem1802 d = {0};
 		d.vramoff = initial_vramoff;
 		d.use_16bit_colour = use_16bit_colour;
+		d.framerate = LEM1802_FRAMERATE;
+		d.show_window = 1;
+		d.capture = NULL;
+		d.terminal = NULL;
 
 		*lem1802 = d;
 	}
@@ -464,6 +644,9 @@ struct device *make_lem1802(struct dcpu *dcpu)
 			NULL,
 			&lem1802_interrupt,
 			&lem1802_cycle,
+			&lem1802_destroy,
+			DEVICE_TICKS | DEVICE_WATCHES | DEVICE_INTERRUPTS,
+			&lem1802_quiet
 		};
 		d.data = lem1802;
 
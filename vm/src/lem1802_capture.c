@@ -0,0 +1,493 @@
+#define _DEFAULT_SOURCE
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "utils.h"
+#include "dcpu.h"
+#include "lem1802.h"
+#include "lem1802_capture.h"
+
+#define LEM1802_CAPTURE_MAGIC "lem1802c"
+#define LEM1802_CAPTURE_VERSION 1
+
+/* records the writer thread may lag behind before frames are dropped */
+#define LEM1802_CAPTURE_QUEUE 64
+
+/* frames between keyframes, so that a stream can be cut or resumed */
+#define LEM1802_CAPTURE_KEYINTERVAL 600
+
+#define LEM1802_CAPTURE_CELLS 384
+
+enum lem1802_capture_record_type {
+	RECORD_KEYFRAME = 'K',
+	RECORD_DELTA = 'D'
+};
+
+enum lem1802_capture_changes {
+	CHANGED_FONT = 1,
+	CHANGED_PALETTE = 2,
+	CHANGED_BORDER = 4
+};
+
+/* type, cycle, flags, changes, cell count */
+#define LEM1802_CAPTURE_HEADER (1 + 4 + 1 + 1 + 2)
+#define LEM1802_CAPTURE_MAXRECORD (LEM1802_CAPTURE_HEADER \
+		+ 4 * LEM1802_CAPTURE_CELLS + 2 * 256 + 2 * 16 + 1)
+
+struct lem1802_capture_record {
+	size_t size;
+	struct farbfeld_data *ffdat; /* keyframes only */
+	u8 bytes[1];
+};
+
+struct lem1802_capture {
+	FILE *file;
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t nonempty;
+	struct lem1802_capture_record *queue[LEM1802_CAPTURE_QUEUE];
+	unsigned head, count;
+	int closing;
+
+	int cycles_per_frame;
+	int next_frame;
+	int since_keyframe;
+	unsigned long frames, dropped;
+
+	/**
+	 * the state as of the last frame handed to the writer. deltas are
+	 * taken against this, so a dropped frame doesn't break the chain.
+	 */
+	int have_state;
+	u16 vram[LEM1802_CAPTURE_CELLS];
+	u16 font[256];
+	u16 palette[16];
+	u8  bordercol;
+	int flags;
+
+	u8  scratch[LEM1802_CAPTURE_MAXRECORD];
+};
+
+static u8 *put8(u8 *p, u8 x)
+{
+	*p++ = x;
+	return p;
+}
+
+static u8 *put16(u8 *p, u16 x)
+{
+	*p++ = x >> 8;
+	*p++ = x;
+	return p;
+}
+
+static u8 *put32(u8 *p, u32 x)
+{
+	p = put16(p, x >> 16);
+	return put16(p, x);
+}
+
+static u8 *put16s(u8 *p, const u16 *xs, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		p = put16(p, xs[i]);
+	return p;
+}
+
+static void *lem1802_capture_writer(void *arg)
+{
+	struct lem1802_capture *capture = arg;
+	struct lem1802_capture_record *record;
+
+	pthread_mutex_lock(&capture->lock);
+	for (;;) {
+		if (capture->count == 0 && !capture->closing) {
+			/* idle: make what we have so far durable */
+			pthread_mutex_unlock(&capture->lock);
+			fflush(capture->file);
+			pthread_mutex_lock(&capture->lock);
+		}
+		while (capture->count == 0 && !capture->closing)
+			pthread_cond_wait(&capture->nonempty, &capture->lock);
+		if (capture->count == 0)
+			break;
+
+		record = capture->queue[capture->head];
+		capture->head = (capture->head + 1) % LEM1802_CAPTURE_QUEUE;
+		capture->count--;
+		pthread_mutex_unlock(&capture->lock);
+
+		fwrite(record->bytes, 1, record->size, capture->file);
+		if (record->ffdat != NULL) {
+			lem1802_fwrite(capture->file, record->ffdat);
+			free(record->ffdat);
+		}
+		free(record);
+
+		pthread_mutex_lock(&capture->lock);
+	}
+	pthread_mutex_unlock(&capture->lock);
+
+	return NULL;
+}
+
+/* returns 0 if the queue is full and the record was not taken */
+static int lem1802_capture_enqueue(struct lem1802_capture *capture, struct lem1802_capture_record *record)
+{
+	int taken = 0;
+
+	pthread_mutex_lock(&capture->lock);
+	if (capture->count < LEM1802_CAPTURE_QUEUE) {
+		capture->queue[(capture->head + capture->count) % LEM1802_CAPTURE_QUEUE] = record;
+		capture->count++;
+		taken = 1;
+		pthread_cond_signal(&capture->nonempty);
+	}
+	pthread_mutex_unlock(&capture->lock);
+
+	return taken;
+}
+
+struct lem1802_capture *lem1802_capture_open(const char *filename, int cycles_per_frame)
+{
+	struct lem1802_capture *capture = ecalloc(1, sizeof *capture);
+	u8 header[8 + 2 + 4], *p;
+
+	capture->file = fopen(filename, "wb");
+	if (capture->file == NULL) {
+		fprintf(stderr, "Couldn't open capture file %s\n", filename);
+		abort();
+	}
+
+	capture->cycles_per_frame = cycles_per_frame > 0 ? cycles_per_frame : 1;
+
+	memcpy(header, LEM1802_CAPTURE_MAGIC, 8);
+	p = put16(header + 8, LEM1802_CAPTURE_VERSION);
+	put32(p, capture->cycles_per_frame);
+	fwrite(header, 1, sizeof header, capture->file);
+
+	pthread_mutex_init(&capture->lock, NULL);
+	pthread_cond_init(&capture->nonempty, NULL);
+
+	if (pthread_create(&capture->writer, NULL, &lem1802_capture_writer, capture)) {
+		fprintf(stderr, "Couldn't start capture writer thread\n");
+		abort();
+	}
+
+	return capture;
+}
+
+void lem1802_capture_close(struct lem1802_capture *capture)
+{
+	pthread_mutex_lock(&capture->lock);
+	capture->closing = 1;
+	pthread_cond_signal(&capture->nonempty);
+	pthread_mutex_unlock(&capture->lock);
+
+	pthread_join(capture->writer, NULL);
+	fclose(capture->file);
+
+	fprintf(stderr, "Captured %lu frames (%lu dropped)\n",
+		capture->frames, capture->dropped);
+
+	pthread_cond_destroy(&capture->nonempty);
+	pthread_mutex_destroy(&capture->lock);
+	free(capture);
+}
+
+int lem1802_capture_due(struct lem1802_capture *capture, int cycles)
+{
+	return cycles >= capture->next_frame;
+}
+
+/* the next frame is captured immediately and as a keyframe */
+void lem1802_capture_resync(struct lem1802_capture *capture, int cycles)
+{
+	capture->have_state = 0;
+	capture->next_frame = cycles;
+}
+
+void lem1802_capture_frame(struct lem1802_capture *capture, int cycles, const u16 vram[384], const u16 font[256], const u16 palette[16], u8 bordercol, int flags, const struct farbfeld_data *ffdat)
+{
+	struct lem1802_capture_record *record;
+	u8 *p = capture->scratch;
+	int keyframe = !capture->have_state
+	            || capture->since_keyframe >= LEM1802_CAPTURE_KEYINTERVAL;
+	size_t size;
+
+	capture->next_frame = cycles - cycles % capture->cycles_per_frame
+	                    + capture->cycles_per_frame;
+
+	p = put8(p, keyframe ? RECORD_KEYFRAME : RECORD_DELTA);
+	p = put32(p, cycles);
+	p = put8(p, flags);
+
+	if (keyframe) {
+		p = put8(p, bordercol);
+		p = put16s(p, vram, LEM1802_CAPTURE_CELLS);
+		p = put16s(p, font, 256);
+		p = put16s(p, palette, 16);
+	} else {
+		u8 changes = 0, *pcount;
+		u16 i, count = 0;
+
+		if (memcmp(font, capture->font, sizeof capture->font))
+			changes |= CHANGED_FONT;
+		if (memcmp(palette, capture->palette, sizeof capture->palette))
+			changes |= CHANGED_PALETTE;
+		if (bordercol != capture->bordercol)
+			changes |= CHANGED_BORDER;
+
+		p = put8(p, changes);
+		pcount = p;
+		p += 2;
+
+		for (i = 0; i < LEM1802_CAPTURE_CELLS; i++) {
+			if (vram[i] != capture->vram[i]) {
+				p = put16(p, i);
+				p = put16(p, vram[i]);
+				count++;
+			}
+		}
+		put16(pcount, count);
+
+		/**
+		 * nothing changed, not even the blink phase: the decoder
+		 * repeats the previous frame
+		 */
+		if (count == 0 && changes == 0 && flags == capture->flags)
+			return;
+
+		if (changes & CHANGED_FONT)
+			p = put16s(p, font, 256);
+		if (changes & CHANGED_PALETTE)
+			p = put16s(p, palette, 16);
+		if (changes & CHANGED_BORDER)
+			p = put8(p, bordercol);
+	}
+
+	size = p - capture->scratch;
+	record = emalloc(sizeof *record + size);
+	record->size = size;
+	record->ffdat = NULL;
+	memcpy(record->bytes, capture->scratch, size);
+
+	if (keyframe) {
+		record->ffdat = emalloc(LEM1802_FF_SIZE);
+		memcpy(record->ffdat, ffdat, LEM1802_FF_SIZE);
+	}
+
+	if (!lem1802_capture_enqueue(capture, record)) {
+		/* the writer is behind: drop this frame rather than stall */
+		free(record->ffdat);
+		free(record);
+		capture->dropped++;
+		return;
+	}
+
+	capture->frames++;
+	capture->have_state = 1;
+	capture->since_keyframe = keyframe ? 0 : capture->since_keyframe + 1;
+	memcpy(capture->vram, vram, sizeof capture->vram);
+	memcpy(capture->font, font, sizeof capture->font);
+	memcpy(capture->palette, palette, sizeof capture->palette);
+	capture->bordercol = bordercol;
+	capture->flags = flags;
+}
+
+/* decoding */
+
+struct lem1802_capture_reader {
+	FILE *file;
+	int eof;
+};
+
+static u32 get8(struct lem1802_capture_reader *r)
+{
+	int c = fgetc(r->file);
+
+	if (c == EOF) {
+		r->eof = 1;
+		return 0;
+	}
+	return c;
+}
+
+static u32 get16(struct lem1802_capture_reader *r)
+{
+	u32 hi = get8(r);
+	return (hi << 8) | get8(r);
+}
+
+static u32 get32(struct lem1802_capture_reader *r)
+{
+	u32 hi = get16(r);
+	return (hi << 16) | get16(r);
+}
+
+static void get16s(struct lem1802_capture_reader *r, u16 *xs, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		xs[i] = get16(r);
+}
+
+static void lem1802_capture_emit(FILE *out, enum lem1802_capture_format format, const char *output, unsigned long n, const struct farbfeld_data *ffdat)
+{
+	static u8 planes[3][LEM1802_FF_PIXWIDTH * LEM1802_FF_PIXHEIGHT];
+	size_t i, npixels = ffdat->width * ffdat->height;
+	char filename[4096];
+	FILE *f;
+
+	if (format == LEM1802_CAPTURE_FARBFELD) {
+		sprintf(filename, "%.4080s%06lu.ff", output, n);
+		f = fopen(filename, "wb");
+		if (f == NULL) {
+			fprintf(stderr, "Couldn't open %s for writing\n", filename);
+			abort();
+		}
+		lem1802_fwrite(f, ffdat);
+		fclose(f);
+		return;
+	}
+
+	/* bt.601 studio-swing, full chroma resolution */
+	for (i = 0; i < npixels; i++) {
+		int r = ffdat->pixels[i].r;
+		int g = ffdat->pixels[i].g;
+		int b = ffdat->pixels[i].b;
+
+		planes[0][i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+		planes[1][i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+		planes[2][i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+	}
+
+	fputs("FRAME\n", out);
+	fwrite(planes, 1, sizeof planes, out);
+}
+
+int lem1802_capture_convert(const char *input, const char *output, enum lem1802_capture_format format)
+{
+	struct lem1802_capture_reader r = {NULL, 0};
+	struct farbfeld_data *ffdat;
+	FILE *out = NULL;
+	char magic[8];
+	u16 vram[LEM1802_CAPTURE_CELLS] = {0}, font[256] = {0}, palette[16] = {0};
+	struct farbfeld_pixel colours[16];
+	u8 bordercol = 0;
+	u32 cycles_per_frame, first_cycle = 0;
+	unsigned long emitted = 0;
+	int have_frame = 0;
+
+	r.file = fopen(input, "rb");
+	if (r.file == NULL) {
+		fprintf(stderr, "Couldn't open %s\n", input);
+		return -1;
+	}
+
+	if (fread(magic, 1, 8, r.file) != 8 || memcmp(magic, LEM1802_CAPTURE_MAGIC, 8)
+	    || get16(&r) != LEM1802_CAPTURE_VERSION) {
+		fprintf(stderr, "%s is not a lem1802 capture\n", input);
+		fclose(r.file);
+		return -1;
+	}
+	cycles_per_frame = get32(&r);
+
+	if (format == LEM1802_CAPTURE_Y4M) {
+		out = fopen(output, "wb");
+		if (out == NULL) {
+			fprintf(stderr, "Couldn't open %s for writing\n", output);
+			fclose(r.file);
+			return -1;
+		}
+		fprintf(out, "YUV4MPEG2 W%d H%d F%d:%lu Ip A1:1 C444\n",
+			LEM1802_FF_PIXWIDTH, LEM1802_FF_PIXHEIGHT,
+			DCPU_CLOCKRATE, (unsigned long)cycles_per_frame);
+	}
+
+	ffdat = emalloc(LEM1802_FF_SIZE);
+	ffdat->width = LEM1802_FF_PIXWIDTH;
+	ffdat->height = LEM1802_FF_PIXHEIGHT;
+
+	for (;;) {
+		u32 type = get8(&r), cycle, flags, frame;
+		long skip;
+
+		if (r.eof)
+			break;
+
+		cycle = get32(&r);
+		flags = get8(&r);
+
+		if (type == RECORD_KEYFRAME) {
+			bordercol = get8(&r);
+			get16s(&r, vram, LEM1802_CAPTURE_CELLS);
+			get16s(&r, font, 256);
+			get16s(&r, palette, 16);
+			/* we rerender from the state, so skip the image */
+			skip = 16 + 8L * LEM1802_FF_PIXWIDTH * LEM1802_FF_PIXHEIGHT;
+			fseek(r.file, skip, SEEK_CUR);
+		} else if (type == RECORD_DELTA) {
+			u32 changes = get8(&r), count = get16(&r), i;
+
+			for (i = 0; i < count; i++) {
+				u32 index = get16(&r);
+				u16 word = get16(&r);
+				if (index < LEM1802_CAPTURE_CELLS)
+					vram[index] = word;
+			}
+			if (changes & CHANGED_FONT)
+				get16s(&r, font, 256);
+			if (changes & CHANGED_PALETTE)
+				get16s(&r, palette, 16);
+			if (changes & CHANGED_BORDER)
+				bordercol = get8(&r);
+		} else {
+			fprintf(stderr, "%s: unknown record type 0x%02x\n", input, type);
+			break;
+		}
+
+		if (r.eof) {
+			fprintf(stderr, "%s: truncated record\n", input);
+			break;
+		}
+
+		if (!have_frame)
+			first_cycle = cycle;
+
+		/**
+		 * unchanged frames aren't recorded, so the previous image is
+		 * repeated up until the frame this record belongs to.
+		 */
+		frame = (cycle - first_cycle) / cycles_per_frame;
+		while (have_frame && emitted < frame)
+			lem1802_capture_emit(out, format, output, emitted++, ffdat);
+
+		lem1802_palette(flags & LEM1802_CAPTURE_16BIT_COLOUR, palette, colours);
+		lem1802_draw(colours, ffdat->pixels, vram, font, bordercol,
+			flags & LEM1802_CAPTURE_BLINK);
+		have_frame = 1;
+	}
+
+	if (have_frame)
+		lem1802_capture_emit(out, format, output, emitted++, ffdat);
+
+	fprintf(stderr, "Converted %lu frames\n", emitted);
+
+	free(ffdat);
+	if (out != NULL)
+		fclose(out);
+	fclose(r.file);
+
+	return 0;
+}
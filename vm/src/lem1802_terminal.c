@@ -0,0 +1,215 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "utils.h"
+#include "dcpu.h"
+#include "lem1802.h"
+#include "lem1802_terminal.h"
+
+#define LEM1802_TERMINAL_CELLS (LEM1802_FF_ROWS * LEM1802_FF_COLS)
+
+/**
+ * enough for every cell of a frame to need a cursor movement, two
+ * truecolour escapes and a three-byte character, plus the border.
+ */
+#define LEM1802_TERMINAL_BUFSIZE (64 * (LEM1802_TERMINAL_CELLS + 2 * (LEM1802_FF_ROWS + LEM1802_FF_COLS + 4)))
+
+/* what a cell looks like on the terminal, for diffing */
+struct lem1802_terminal_cell {
+	struct farbfeld_pixel fg, bg;
+	const char *glyph;
+};
+
+struct lem1802_terminal {
+	int fd;
+	enum lem1802_terminal_colours colours;
+
+	int have_frame;
+	struct farbfeld_pixel border;
+	struct lem1802_terminal_cell cells[LEM1802_TERMINAL_CELLS];
+
+	/* the state of the terminal as of the end of the buffer */
+	int row, col;
+	int have_colours;
+	struct farbfeld_pixel fg, bg;
+
+	size_t len;
+	char buf[LEM1802_TERMINAL_BUFSIZE];
+};
+
+static void lem1802_terminal_puts(struct lem1802_terminal *term, const char *s)
+{
+	size_t n = strlen(s);
+
+	memcpy(term->buf + term->len, s, n);
+	term->len += n;
+}
+
+static void lem1802_terminal_flush(struct lem1802_terminal *term)
+{
+	size_t done = 0;
+
+	while (done < term->len) {
+		ssize_t n = write(term->fd, term->buf + done, term->len - done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Unable to write to terminal: %s\n", strerror(errno));
+			abort();
+		}
+		done += n;
+	}
+	term->len = 0;
+}
+
+static int same_pixel(struct farbfeld_pixel a, struct farbfeld_pixel b)
+{
+	return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+/* nearest entry of the xterm 6x6x6 colour cube */
+static int xterm_index(struct farbfeld_pixel p)
+{
+	return 16 + 36 * ((p.r * 5 + 127) / 255)
+	          +  6 * ((p.g * 5 + 127) / 255)
+	          +  1 * ((p.b * 5 + 127) / 255);
+}
+
+static void lem1802_terminal_colour(struct lem1802_terminal *term, struct farbfeld_pixel fg, struct farbfeld_pixel bg)
+{
+	char escape[64];
+
+	if (term->have_colours && same_pixel(fg, term->fg) && same_pixel(bg, term->bg))
+		return;
+
+	if (term->colours == LEM1802_TERMINAL_TRUECOLOUR)
+		sprintf(escape, "\033[38;2;%d;%d;%d;48;2;%d;%d;%dm",
+			fg.r, fg.g, fg.b, bg.r, bg.g, bg.b);
+	else
+		sprintf(escape, "\033[38;5;%d;48;5;%dm",
+			xterm_index(fg), xterm_index(bg));
+
+	lem1802_terminal_puts(term, escape);
+	term->have_colours = 1;
+	term->fg = fg;
+	term->bg = bg;
+}
+
+/* rows and columns are those of the border, i.e. cells start at 1,1 */
+static void lem1802_terminal_put(struct lem1802_terminal *term, int row, int col, struct farbfeld_pixel fg, struct farbfeld_pixel bg, const char *glyph)
+{
+	if (row != term->row || col != term->col) {
+		char escape[32];
+		sprintf(escape, "\033[%d;%dH", row + 1, col + 1);
+		lem1802_terminal_puts(term, escape);
+	}
+
+	lem1802_terminal_colour(term, fg, bg);
+	lem1802_terminal_puts(term, glyph);
+	term->row = row;
+	term->col = col + 1;
+}
+
+static const char *lem1802_terminal_glyph(u16 vram, const u16 font[256], int cycle)
+{
+	/* ascii, with "" in place of the non-printing characters */
+	static const char ascii[128][2] = {
+		"", "", "", "", "", "", "", "", "", "", "", "", "", "", "", "",
+		"", "", "", "", "", "", "", "", "", "", "", "", "", "", "", "",
+		" ", "!", "\"", "#", "$", "%", "&", "'", "(", ")", "*", "+", ",", "-", ".", "/",
+		"0", "1", "2", "3", "4", "5", "6", "7", "8", "9", ":", ";", "<", "=", ">", "?",
+		"@", "A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L", "M", "N", "O",
+		"P", "Q", "R", "S", "T", "U", "V", "W", "X", "Y", "Z", "[", "\\", "]", "^", "_",
+		"`", "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m", "n", "o",
+		"p", "q", "r", "s", "t", "u", "v", "w", "x", "y", "z", "{", "|", "}", "~", ""
+	};
+	u8 ch = vram & 0x7f;
+	u8 blink = (vram >> 7) & 0x1;
+	u32 glyph = ((u32)font[ch * 2] << 16) | font[ch * 2 + 1];
+
+	if ((blink && !cycle) || glyph == 0)
+		return " ";
+	if (glyph == 0xffffffff)
+		return "\342\226\210"; /* full block */
+	if (ascii[ch][0] != '\0')
+		return ascii[ch];
+	return "\342\226\222";         /* medium shade */
+}
+
+struct lem1802_terminal *lem1802_terminal_open(int fd, enum lem1802_terminal_colours colours)
+{
+	struct lem1802_terminal *term = emalloc(sizeof *term);
+
+	term->fd = fd;
+	term->colours = colours;
+	term->have_frame = 0;
+	term->have_colours = 0;
+	term->row = term->col = -1;
+	term->len = 0;
+
+	/* clear the screen and hide the cursor */
+	lem1802_terminal_puts(term, "\033[2J\033[?25l");
+	lem1802_terminal_flush(term);
+
+	return term;
+}
+
+void lem1802_terminal_close(struct lem1802_terminal *term)
+{
+	char escape[32];
+
+	/* reset attributes, put the cursor below the screen and show it */
+	sprintf(escape, "\033[0m\033[%d;1H\033[?25h", LEM1802_FF_ROWS + 3);
+	lem1802_terminal_puts(term, escape);
+	lem1802_terminal_flush(term);
+
+	free(term);
+}
+
+void lem1802_terminal_present(struct lem1802_terminal *term, const u16 vram[384], const u16 font[256], const struct farbfeld_pixel colours[16], u8 bordercol, int cycle)
+{
+	struct farbfeld_pixel border = colours[bordercol & 0xf];
+	int i, j;
+
+	if (!term->have_frame || !same_pixel(border, term->border)) {
+		for (i = 0; i < LEM1802_FF_ROWS + 2; i++) {
+			for (j = 0; j < LEM1802_FF_COLS + 2; j++) {
+				if (i == 0 || j == 0 || i == LEM1802_FF_ROWS + 1 || j == LEM1802_FF_COLS + 1)
+					lem1802_terminal_put(term, i, j, border, border, " ");
+			}
+		}
+		term->border = border;
+	}
+
+	for (i = 0; i < LEM1802_FF_ROWS; i++) {
+		for (j = 0; j < LEM1802_FF_COLS; j++) {
+			u16 v = vram[i * LEM1802_FF_COLS + j];
+			struct lem1802_terminal_cell *last = &term->cells[i * LEM1802_FF_COLS + j];
+			struct lem1802_terminal_cell cell;
+
+			cell.fg = colours[(v >> 12) & 0xf];
+			cell.bg = colours[(v >> 8) & 0xf];
+			cell.glyph = lem1802_terminal_glyph(v, font, cycle);
+
+			if (term->have_frame && cell.glyph == last->glyph
+			    && same_pixel(cell.fg, last->fg) && same_pixel(cell.bg, last->bg))
+				continue;
+
+			lem1802_terminal_put(term, i + 1, j + 1, cell.fg, cell.bg, cell.glyph);
+			*last = cell;
+		}
+	}
+
+	term->have_frame = 1;
+
+	if (term->len > 0)
+		lem1802_terminal_flush(term);
+}
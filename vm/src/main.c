@@ -0,0 +1,265 @@
+#define _DEFAULT_SOURCE
+
+#include <unistd.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "types.h"
+#include "utils.h"
+#include "dcpu.h"
+#include "libdcpu.h"
+#include "debugmap.h"
+#include "lem1802.h"
+#include "lem1802_capture.h"
+#include "lem1802_terminal.h"
+#include "dfpu17.h"
+#include "registry.h"
+
+static const u16 programme[] = {
+#include "../examples/mandelbrot.hex"
+};
+
+#define TIMESLICE 0.01
+#define CLOCKRATE DCPU_CLOCKRATE
+
+static double diffclock(struct timespec b, struct timespec a)
+{
+	return (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1000000000.0;
+}
+
+#define PROFILE_TOP 20
+
+/* the hardware there's been since before -d */
+#define DEVICES "lem1802,dfpu17,keyboard,clock,hmd2043"
+
+/* cycles spent at each address, with -p */
+static u32 *profile;
+
+/* the addresses the most cycles were spent at */
+static void report_profile(const struct debugmap *map)
+{
+	u32 total = 0, best;
+	int i, n, address;
+
+	for (i = 0; i < 65536; i++)
+		total += profile[i];
+	fprintf(stderr, "%lu cycles\n", (unsigned long)total);
+
+	for (n = 0; n < PROFILE_TOP && total != 0; n++) {
+		best = 0;
+		address = -1;
+		for (i = 0; i < 65536; i++) {
+			if (profile[i] > best) {
+				best = profile[i];
+				address = i;
+			}
+		}
+		if (address < 0)
+			break;
+
+		fprintf(stderr, "%5.1f%%  0x%04x", 100.0 * best / total, address);
+		debugmap_print(map, stderr, address);
+		fputc('\n', stderr);
+		profile[address] = 0;
+	}
+}
+
+/* what the front end's options say about the devices */
+struct options {
+	int headless;
+	int terminal;  /* a LEM1802_TERMINAL_ palette, or -1 */
+	int burst, worker, jit;
+	const char *capture;
+};
+
+static volatile sig_atomic_t interrupted;
+
+static void on_interrupt(int sig)
+{
+	(void)sig;
+	interrupted = 1;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-H] [-t|-T] [-b] [-w|-j] [-c capture] [-d devices] [-m map] [-p]\n"
+	                "          [program]\n", argv0);
+	fprintf(stderr, "       %s -x capture output\n", argv0);
+	fprintf(stderr, "  -H          don't open a window for the screen\n");
+	fprintf(stderr, "  -t          draw the screen on this terminal in truecolour\n");
+	fprintf(stderr, "              instead of opening a window\n");
+	fprintf(stderr, "  -T          the same, with the 256-colour palette\n");
+	fprintf(stderr, "  -b          let the dfpu-17 copy each transfer as a single\n");
+	fprintf(stderr, "              block when it completes\n");
+	fprintf(stderr, "  -w          run dfpu-17 jobs on a thread of their own\n");
+	fprintf(stderr, "  -j          the same, translating the dfpu-17 text to\n");
+	fprintf(stderr, "              native code where the host allows\n");
+	fprintf(stderr, "  -c capture  record the screen to a capture file\n");
+	fprintf(stderr, "  -d devices  the hardware to attach, in order, as a list of\n");
+	fprintf(stderr, "              names (%s)\n", DEVICES);
+	fprintf(stderr, "  -m map      show addresses as labels and source lines,\n");
+	fprintf(stderr, "              from the assembler's debug map (as -g)\n");
+	fprintf(stderr, "  -p          count the cycles spent at each address, and\n");
+	fprintf(stderr, "              report where the most went when interrupted\n");
+	fprintf(stderr, "  program     an image from the linker (as -o x.img16) or a\n");
+	fprintf(stderr, "              .bin, instead of the example built in\n");
+	fprintf(stderr, "  -x          convert a capture to a Y4M video (if output\n");
+	fprintf(stderr, "              ends in .y4m) or to a sequence of farbfeld\n");
+	fprintf(stderr, "              images named output000000.ff, ...\n");
+	exit(EXIT_FAILURE);
+}
+
+static int convert(const char *input, const char *output)
+{
+	size_t n = strlen(output);
+	enum lem1802_capture_format format = LEM1802_CAPTURE_FARBFELD;
+
+	if (n >= 4 && !strcmp(output + n - 4, ".y4m"))
+		format = LEM1802_CAPTURE_Y4M;
+
+	return lem1802_capture_convert(input, output, format) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* each device named in the list, with its options; 0, having said why, if one isn't known */
+static int attach_devices(struct dcpu *dcpu, const char *list, const struct options *options)
+{
+	const struct registry_entry *entry;
+	struct device *device;
+	char *names = emalloc(strlen(list) + 1), *name;
+
+	strcpy(names, list);
+	for (name = strtok(names, ","); name != NULL; name = strtok(NULL, ",")) {
+		if ((device = dcpu_attach_named(dcpu, name)) == NULL) {
+			fprintf(stderr, "no device called %s; there are", name);
+			for (entry = registry; entry->name != NULL; entry++)
+				fprintf(stderr, " %s", entry->name);
+			fputc('\n', stderr);
+			free(names);
+			return 0;
+		}
+
+		if (strcmp(name, "lem1802") == 0) {
+			/* the screen is presented at most this many times per second of
+			 * wall-clock time, however fast or slow the emulated cpu runs.
+			 */
+			lem1802_set_framerate(device, 60);
+			lem1802_set_window(device, !options->headless);
+			if (options->capture != NULL)
+				lem1802_set_capture(device, options->capture);
+			if (options->terminal != -1)
+				lem1802_set_terminal(device, STDOUT_FILENO, options->terminal);
+		} else if (strcmp(name, "dfpu17") == 0) {
+			if (options->burst)
+				dfpu17_set_dma(device, DFPU17_DMA_BURST);
+			if (options->worker)
+				dfpu17_set_worker(device);
+			if (options->jit)
+				dfpu17_set_jit(device);
+		}
+	}
+
+	free(names);
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	struct options options = {0, -1, 0, 0, 0, NULL};
+	struct dcpu *dcpu;
+	struct debugmap *debugmap = NULL;
+	struct timespec start, current;
+	const char *map = NULL, *devices = DEVICES, *fault, *what;
+	int opt, quirks = 0, converting = 0;
+	u16 words[4];
+	double ahead;
+
+	while ((opt = getopt(argc, argv, "HtTbwjc:d:xm:p")) != -1) {
+		switch (opt) {
+		case 'H': options.headless = 1; break;
+		case 't': options.headless = 1; options.terminal = LEM1802_TERMINAL_TRUECOLOUR; break;
+		case 'T': options.headless = 1; options.terminal = LEM1802_TERMINAL_256COLOUR; break;
+		case 'b': options.burst = 1; break;
+		case 'w': options.worker = 1; break;
+		case 'j': options.jit = 1; break;
+		case 'c': options.capture = optarg; break;
+		case 'd': devices = optarg; break;
+		case 'x': converting = 1; break;
+		case 'm': map = optarg; break;
+		case 'p': profile = ecalloc(65536, sizeof *profile); break;
+		default: usage(argv[0]);
+		}
+	}
+
+	if (converting) {
+		if (argc - optind != 2)
+			usage(argv[0]);
+		return convert(argv[optind], argv[optind + 1]);
+	}
+	if (argc - optind > 1)
+		usage(argv[0]);
+
+	/* turn me on if the program you are testing requires that the monitor
+	 * is automatically turned on at the beginning of execution and mapped
+	 * to 0x8000.
+	 */
+	/* quirks |= DCPU_QUIRKS_LEM1802_ALWAYS_ON; */
+
+	/* turn me on if the program you are testing can use a 24-bit colour
+	 * palette. (rrrrrggggggbbbbb instead of 0000rrrrggggbbbb).
+	 */
+	/* quirks |= DCPU_QUIRKS_LEM1802_USE_16BIT_COLOUR; */
+
+	dcpu = dcpu_create(quirks);
+	if (optind < argc) {
+		if (dcpu_load_file(dcpu, argv[optind]))
+			return EXIT_FAILURE;
+	} else {
+		dcpu_load(dcpu, 0, programme, sizeof programme / sizeof *programme);
+	}
+	if (map != NULL && (debugmap = debugmap_load(map)) == NULL)
+		return EXIT_FAILURE;
+	dcpu_set_map(dcpu, debugmap);
+	if (profile != NULL) {
+		dcpu_set_profile(dcpu, profile);
+		signal(SIGINT, on_interrupt);
+	}
+
+	if (!attach_devices(dcpu, devices, &options))
+		return EXIT_FAILURE;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	puts("");
+	/* run a slice at a time, sleeping off however far ahead of the wall clock it gets */
+	while (!interrupted && dcpu_fault(dcpu, NULL) == NULL) {
+		dcpu_run(dcpu, CLOCKRATE * TIMESLICE);
+		clock_gettime(CLOCK_MONOTONIC, &current);
+		ahead = dcpu_cycles(dcpu) / (double)CLOCKRATE - diffclock(current, start);
+		if (ahead > 0)
+			usleep(1000000.0 * ahead);
+	}
+
+	if ((fault = dcpu_fault(dcpu, &what)) != NULL) {
+		fprintf(stderr, "%s: %s\n", fault, what);
+		dcpu_read(dcpu, 110, words, 4);
+		fprintf(stderr, " 0x%04x 0x%04x 0x%04x 0x%04x\n",
+			words[0], words[1], words[2], words[3]);
+		dcpu_read(dcpu, 512 + 110, words, 4);
+		fprintf(stderr, " 0x%04x 0x%04x 0x%04x 0x%04x\n",
+			words[0], words[1], words[2], words[3]);
+		dcpu_dump(dcpu, stderr);
+	}
+	if (profile != NULL)
+		report_profile(debugmap);
+
+	dcpu_destroy(dcpu);
+	debugmap_free(debugmap);
+	free(profile);
+	return fault != NULL ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,67 @@
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "utils.h"
+#include "dcpu.h"
+#include "libdcpu.h"
+#include "lem1802.h"
+#include "dfpu17.h"
+#include "genclock.h"
+#include "registry.h"
+
+const struct registry_entry registry[] = {
+	{"lem1802",  0, 0, 0, &make_lem1802},
+	{"dfpu17",   0, 0, 0, &make_dfpu17},
+	{"keyboard", 0x30cf7406, 0x0001, 0x90099009, NULL},
+	{"clock",    0, 0, 0, &make_genclock},
+	{"hmd2043",  0x74fa4cae, 0x07c2, 0x21544948, NULL},
+	{NULL, 0, 0, 0, NULL}
+};
+
+const struct registry_entry *registry_lookup(const char *name)
+{
+	const struct registry_entry *entry;
+
+	for (entry = registry; entry->name != NULL; entry++)
+		if (strcmp(entry->name, name) == 0)
+			return entry;
+	return NULL;
+}
+
+static void registry_destroy(struct device *device)
+{
+	free(device);
+}
+
+struct device *registry_make(const struct registry_entry *entry, struct dcpu *dcpu)
+{
+	struct device *device;
+
+	if (entry->make != NULL)
+		return entry->make(dcpu);
+
+	/* no hooks and no caps, so the dcpu never calls it */
+	device = ecalloc(1, sizeof *device);
+	device->id = entry->id;
+	device->version = entry->version;
+	device->manufacturer = entry->manufacturer;
+	device->destroy = &registry_destroy;
+	return device;
+}
+
+struct device *dcpu_attach_named(struct dcpu *dcpu, const char *name)
+{
+	const struct registry_entry *entry = registry_lookup(name);
+	struct device *device;
+
+	if (entry == NULL)
+		return NULL;
+	device = registry_make(entry, dcpu);
+	dcpu_attach(dcpu, device);
+	return device;
+}
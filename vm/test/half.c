@@ -0,0 +1,286 @@
+#define _GNU_SOURCE
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "half.h"
+
+/*
+ * the binary16 conversions and arithmetic against references worked
+ * out here from the definition: every half widened, every rounding
+ * boundary narrowed from f32 and from double, fma on random operands
+ * done exactly in integers, and the functions of the exact accuracy
+ * mode over every half.
+ */
+
+#define FMA_TRIALS 2000000
+
+static unsigned long failures;
+
+static void fail(const char *what, unsigned long in, unsigned long got, unsigned long expected)
+{
+	if (failures++ < 20)
+		printf("%s(0x%08lx) = 0x%04lx, not 0x%04lx\n", what, in, got, expected);
+}
+
+static u32 f32_bits(f32 f)
+{
+	u32 bits;
+
+	memcpy(&bits, &f, sizeof bits);
+	return bits;
+}
+
+static f32 bits_f32(u32 bits)
+{
+	f32 f;
+
+	memcpy(&f, &bits, sizeof f);
+	return f;
+}
+
+/* a finite half's value, from its fields */
+static double half_value(f16 h)
+{
+	int exp = (h >> 10) & 0x1f, mant = h & 0x3ff;
+	double v = exp ? ldexp(0x400 | mant, exp - 25) : ldexp(mant, -24);
+
+	return h & 0x8000 ? -v : v;
+}
+
+static void test_widening(void)
+{
+	unsigned long h;
+	u32 soft, hard, expected;
+
+	for (h = 0; h < 0x10000; h++) {
+		soft = f32_bits(f16_to_f32_soft(h));
+		hard = f32_bits(f16_to_f32(h));
+		if ((h & 0x7c00) == 0x7c00)
+			expected = (u32)(h & 0x8000) << 16 | 0x7f800000
+			         | (h & 0x3ff ? 0x400000 | (u32)(h & 0x3ff) << 13 : 0);
+		else
+			expected = f32_bits((f32)half_value(h));
+		if (soft != expected)
+			fail("f16_to_f32_soft", h, soft, expected);
+		if (hard != expected)
+			fail("f16_to_f32", h, hard, expected);
+	}
+}
+
+static void check_narrowing(f32 f, f16 expected)
+{
+	f16 soft = f32_to_f16_soft(f), hard = f32_to_f16(f);
+
+	if (soft != expected)
+		fail("f32_to_f16_soft", f32_bits(f), soft, expected);
+	if (hard != expected)
+		fail("f32_to_f16", f32_bits(f), hard, expected);
+}
+
+static void check_double(double d, f16 expected)
+{
+	f16 got = f64_to_f16(d);
+
+	if (got != expected)
+		fail("f64_to_f16", f32_bits((f32)d), got, expected);
+}
+
+/* the nearer of h and h + 1 to a value strictly between them, or the even one */
+static f16 nearer(f16 h, int side)
+{
+	return side < 0 ? h : side > 0 ? h + 1 : h & 1 ? h + 1 : h;
+}
+
+/* each half, and the values either side of and at its midpoint with the next */
+static void test_narrowing(void)
+{
+	unsigned long h;
+	double mid;
+	unsigned sign;
+	f32 m;
+
+	for (h = 0; h < 0x7c00; h++) {
+		for (sign = 0; sign <= 0x8000; sign += 0x8000) {
+			/* 65536 stands in for the half after the largest */
+			mid = (fabs(half_value(h)) + (h == 0x7bff ? 65536.0 : fabs(half_value(h + 1)))) / 2;
+			if (sign)
+				mid = -mid;
+			m = (f32)mid;
+
+			check_narrowing((f32)half_value(sign | h), sign | h);
+			check_narrowing(m, sign | nearer(h, 0));
+			check_narrowing(bits_f32(f32_bits(m) - 1), sign | nearer(h, -1));
+			check_narrowing(bits_f32(f32_bits(m) + 1), sign | nearer(h, 1));
+
+			/* a double just off the midpoint, which would round to it in f32 */
+			check_double(mid, sign | nearer(h, 0));
+			check_double(mid - ldexp(mid, -40), sign | nearer(h, -1));
+			check_double(mid + ldexp(mid, -40), sign | nearer(h, 1));
+		}
+	}
+
+	check_narrowing(bits_f32(0x7f800000), 0x7c00);
+	check_narrowing(bits_f32(0xff800000), 0xfc00);
+	check_narrowing(FLT_MAX, 0x7c00);
+	check_narrowing(FLT_MIN, 0x0000);
+	check_narrowing(bits_f32(0x80000001), 0x8000);
+	check_narrowing(bits_f32(0x7fc00000), 0x7e00);
+	check_narrowing(bits_f32(0x7f802000), 0x7e01);
+	check_double(1e300, 0x7c00);
+	check_double(-1e-300, 0x8000);
+	check_double(ldexp(1, -25), 0x0000);
+	check_double(ldexp(1, -25) + ldexp(1, -60), 0x0001);
+}
+
+static unsigned long test_seed = 1;
+
+static unsigned long test_random(unsigned long n)
+{
+	test_seed = (test_seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+	return (test_seed >> 8) % n;
+}
+
+/* a random half in [2^-8, 2^8), either sign */
+static f16 random_half(void)
+{
+	return (f16)(test_random(2) << 15 | (7 + test_random(16)) << 10 | test_random(0x400));
+}
+
+/* a half's value in units of 2^-36, which every half the test uses is a whole number of */
+static int64_t half_units(f16 h)
+{
+	int exp = (h >> 10) & 0x1f;
+	int64_t units = (int64_t)(exp ? 0x400 | (h & 0x3ff) : h & 0x3ff) << (exp ? exp - 1 : 0) << 11;
+
+	return h & 0x8000 ? -units : units;
+}
+
+/* the half nearest a number of units of 2^-36, ties to even */
+static f16 round_units(int64_t units)
+{
+	f16 sign = units < 0 ? 0x8000 : 0, low = 0, high = 0x7c00, middle;
+	int64_t x = units < 0 ? -units : units, below, above;
+
+	if (x == 0)
+		return 0;
+	while (high - low > 1) {
+		middle = low + (high - low) / 2;
+		if (half_units(middle) <= x)
+			low = middle;
+		else
+			high = middle;
+	}
+	below = x - half_units(low);
+	above = (low == 0x7bff ? (int64_t)65536 << 36 : half_units(low + 1)) - x;
+	return sign | nearer(low, below == 0 ? -1 : (below > above) - (below < above));
+}
+
+static void test_fma(void)
+{
+	f16 a, b, c, got, expected;
+	int64_t exact;
+	long i;
+
+	for (i = 0; i < FMA_TRIALS; i++) {
+		a = random_half();
+		b = random_half();
+		c = random_half();
+		exact = half_units(a) * half_units(b) / ((int64_t)1 << 36) + half_units(c);
+		/* the product's units are whole when its exponent is at least -36 */
+		if (half_units(a) * half_units(b) % ((int64_t)1 << 36) != 0)
+			continue;
+		got = f16_fma(a, b, c);
+		expected = round_units(exact);
+		if (got != expected)
+			fail("f16_fma", (unsigned long)a << 16 | b, got, expected);
+	}
+}
+
+/* as the DFPU-17's exact accuracy mode works them out */
+static const char *const function_names[] = {
+	"sin", "cos", "tan", "asin", "acos", "atan", "log10", "log2", "log", "sqrt"
+};
+
+static double function(int f, double x)
+{
+	switch (f) {
+	case 0: return sin(x);
+	case 1: return cos(x);
+	case 2: return tan(x);
+	case 3: return asin(x);
+	case 4: return acos(x);
+	case 5: return atan(x);
+	case 6: return log10(x);
+	case 7: return log2(x);
+	case 8: return log(x);
+	default: return sqrt(x);
+	}
+}
+
+static long double function_l(int f, long double x)
+{
+	switch (f) {
+	case 0: return sinl(x);
+	case 1: return cosl(x);
+	case 2: return tanl(x);
+	case 3: return asinl(x);
+	case 4: return acosl(x);
+	case 5: return atanl(x);
+	case 6: return log10l(x);
+	case 7: return log2l(x);
+	case 8: return logl(x);
+	default: return sqrtl(x);
+	}
+}
+
+/* that no half either side of got is nearer the long double result */
+static void test_functions(void)
+{
+	unsigned long h;
+	long double y, d, dn;
+	f16 got, n;
+	int f, k;
+
+	if (LDBL_MANT_DIG <= DBL_MANT_DIG) {
+		printf("no long double wider than double to check the functions with\n");
+		return;
+	}
+
+	for (f = 0; f < 10; f++) {
+		for (h = 0; h < 0x10000; h++) {
+			if ((h & 0x7c00) == 0x7c00)
+				continue;
+			got = f64_to_f16(function(f, half_value(h)));
+			y = function_l(f, half_value(h));
+			if (y != y || (got & 0x7c00) == 0x7c00)
+				continue;
+			d = fabsl(y - half_value(got));
+			for (k = -1; k <= 1; k += 2) {
+				n = got + k;
+				if ((n & 0x7fff) == 0x7fff || (n & 0x7c00) == 0x7c00)
+					continue;
+				dn = fabsl(y - half_value(n));
+				if (dn < d || (dn == d && !(n & 1)))
+					fail(function_names[f], h, got, n);
+			}
+		}
+	}
+}
+
+int main(void)
+{
+	test_widening();
+	printf("f16 to f32: every half, %lu wrong\n", failures);
+	test_narrowing();
+	printf("f32 and double to f16: every rounding boundary, %lu wrong\n", failures);
+	test_fma();
+	printf("fma: %d random operands, %lu wrong\n", FMA_TRIALS, failures);
+	test_functions();
+	printf("exact mode functions: every half, %lu wrong\n", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}